@@ -15,7 +15,7 @@ normal = "\033[0m"
 
 
 test_files = "inputs/custom/*.x"
-rep_policies = ["lru", "rand", "rrip"]
+rep_policies = ["lru", "rand", "srrip", "brrip", "drrip", "plru", "lfu", "fifo"]
 
 
 def main(sweep):
@@ -64,7 +64,7 @@ def process_task(task_data):
     i, policy, params, in_idx, p_idx = task_data
 
     # Run the simulation
-    sim_out = run(i, f"./sim_{policy}", params)
+    sim_out = run(i, "./sim", policy, params)
 
     # Parse sim output
     sim_out = sim_out.split("\n")
@@ -93,7 +93,7 @@ def process_task(task_data):
     }
 
 
-def run(i, exec, params):
+def run(i, exec, policy, params):
     simproc = subprocess.Popen(
         [exec, i],
         executable=exec,
@@ -107,8 +107,9 @@ def run(i, exec, params):
     if os.path.exists(cmdfile):
         cmds += open(cmdfile).read().encode("utf-8")
 
-    # Send bench command followed by the cache parameters
-    cmds += b"\nbench\n"
+    # Select the replacement policy, then send bench command followed by the cache parameters
+    cmds += f"\npolicy icache {policy}\npolicy dcache {policy}\n".encode("utf-8")
+    cmds += b"bench\n"
     param_str = (
         f"{params[0]} {params[1]} {params[2]} {params[3]} {params[4]} {params[5]}\n"
     )
@@ -1,16 +1,13 @@
 #include "cache.h"
+#include "repl_policy.h"
 #include "shell.h"
 #include <assert.h>
 #include <stdlib.h>
 
 #define DRAM_ACCESS_CYCLES 50
 
-#define IMMEDIATE_RRPV 0
-#define LONG_RRPV 2
-#define DISTANT_RRPV 3
-
 void alloc_cache(Cache *c, uint32_t capacity, uint8_t num_ways,
-                 uint8_t block_size) {
+                 uint8_t block_size, const ReplPolicy *policy) {
     c->block_size = block_size;
     c->num_sets = capacity / (block_size * num_ways);
     c->num_ways = num_ways;
@@ -41,14 +38,11 @@ void alloc_cache(Cache *c, uint32_t capacity, uint8_t num_ways,
 
             block->tag = 0;
             block->valid = 0;
-#ifdef LRU
-            block->recency = b;
-#endif
-#ifdef RRIP
-            block->rrpv = LONG_RRPV;
-#endif
         }
     }
+    c->set_meta = calloc(c->num_sets, sizeof(uint32_t));
+
+    set_cache_policy(c, policy);
 }
 
 void free_cache(Cache *c) {
@@ -60,32 +54,14 @@ void free_cache(Cache *c) {
 
     // free the sets
     free(c->sets);
+    free(c->set_meta);
 }
 
-#ifdef LRU
-void update_lru(Cache *c, size_t set, size_t block) {
-    uint32_t prev_recency = c->sets[set].blocks[block].recency;
-
-    // increment the recency for valid blocks that were prev. more recent
-    for (size_t b = 0; b < c->num_ways; b++) {
-        if (c->sets[set].blocks[b].valid &&
-            c->sets[set].blocks[b].recency < prev_recency) {
-            c->sets[set].blocks[b].recency++;
-        }
-    }
-
-    // and most recently updated block gets the lru pos 0;
-    c->sets[set].blocks[block].recency = 0;
-}
-#endif
-
-#ifdef RRIP
-void update_rrip(Cache *c, size_t set, size_t block) {
-    c->sets[set].blocks[block].rrpv = IMMEDIATE_RRPV;
+void set_cache_policy(Cache *c, const ReplPolicy *policy) {
+    c->policy = policy;
+    c->policy->init(c);
 }
 
-#endif
-
 uint32_t cache_access(Cache *c, uint32_t address) {
     assert((address % 4 == 0) && "Address should be multiple of 4 bytes");
 
@@ -97,13 +73,8 @@ uint32_t cache_access(Cache *c, uint32_t address) {
     for (size_t b = 0; b < c->num_ways; b++) {
         if (c->sets[set].blocks[b].tag == tag && c->sets[set].blocks[b].valid) {
             // HIT since tag matches and block is valid
-            // -> update LRU positions of set's blocks
-#ifdef LRU
-            update_lru(c, set, b);
-#endif
-#ifdef RRIP
-            update_rrip(c, set, b);
-#endif
+            // -> update replacement state of set's blocks
+            c->policy->on_hit(c, set, b);
             return 0;
         }
     }
@@ -122,67 +93,15 @@ uint32_t cache_access(Cache *c, uint32_t address) {
         }
     }
 
-    // 2. blocks all valid, so replace a block
-
-#ifdef RAND
-    // random policy chooses random block in set
-    if (!found) {
-        victim = rand() % c->num_ways;
-    }
-#endif
-
-#ifdef LRU
-    if (!found) {
-        // LRU chooses the least recently used block
-        for (size_t b = 0; b < c->num_ways; b++) {
-            if (c->sets[set].blocks[b].recency == (c->num_ways - 1)) {
-                victim = b;
-                break;
-            }
-        }
-    }
-#endif
-
-#ifdef RRIP
-    // https://people.csail.mit.edu/emer/media/papers/2010.06.isca.rrip.pdf
-
-    // Modify victim selection in cache_access:
+    // 2. blocks all valid, so the policy chooses a block to replace
     if (!found) {
-        // Find a block with RRPV = DISTANT_RRPV
-        int found_victim = 0;
-        while (!found_victim) {
-            for (size_t b = 0; b < c->num_ways; b++) {
-                if (c->sets[set].blocks[b].rrpv == DISTANT_RRPV) {
-                    victim = b;
-                    found_victim = 1;
-                    break;
-                }
-            }
-
-            // If no DISTANT_RRPV found, increment all RRPVs and try again
-            if (!found_victim) {
-                for (size_t b = 0; b < c->num_ways; b++) {
-                    if (c->sets[set].blocks[b].valid &&
-                        c->sets[set].blocks[b].rrpv < DISTANT_RRPV) {
-                        c->sets[set].blocks[b].rrpv++;
-                    }
-                }
-            }
-        }
+        victim = c->policy->pick_victim(c, set);
     }
-    // New blocks inserted with LONG_RRPV
-    c->sets[set].blocks[victim].rrpv = LONG_RRPV;
-#endif
 
     // replace victim block
     c->sets[set].blocks[victim].tag = tag;
     c->sets[set].blocks[victim].valid = 1;
+    c->policy->on_fill(c, set, victim);
 
-#ifdef LRU
-    update_lru(c, set, victim);
-#endif
-#ifdef RRIP
-    update_rrip(c, set, victim);
-#endif
     return DRAM_ACCESS_CYCLES;
-}
\ No newline at end of file
+}
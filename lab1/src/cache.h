@@ -12,26 +12,21 @@
 #define DCACHE_SIZE (64 * 1024)
 #define DCACHE_WAYS 8
 
-// select caching policy
-#define RAND
-// #define LRU
-// #define RRIP // 2-bit Static RRIP
+// default caching policy, can be changed at runtime with the policy command
+#define CACHE_POLICY "rand"
 
 typedef struct Block {
     uint32_t tag;
     uint8_t valid; // valid bit (0 = invalid, 1 = valid)
-#ifdef LRU
-    uint32_t recency; // recency = 0 -> most recently used
-#endif
-#ifdef RRIP
-    uint32_t rrpv; // reference prediction values
-#endif
+    uint32_t meta; // replacement metadata (recency, RRPV, ...) of the policy
 } Block;
 
 typedef struct Set {
     Block *blocks; // array of blocks
 } Set;
 
+struct ReplPolicy;
+
 // model the cache as a tree, with blocks as leafs
 typedef struct Cache {
     uint32_t num_sets;
@@ -42,26 +37,27 @@ typedef struct Cache {
     // for indexing:
     uint8_t set_bits;
     uint8_t block_bits;
+
+    // replacement policy and its per-cache state
+    const struct ReplPolicy *policy;
+    uint32_t *set_meta; // one word per set (e.g. tree-PLRU bits)
+    uint32_t psel;      // DRRIP set dueling policy selector
+    uint32_t tick;      // fill counter (FIFO stamps, BRRIP throttle)
 } Cache;
 
 /**
  * @param uint16_t capacity in bytes
  * @param uint8_t block_size in bytes
+ * @param policy replacement policy used by this cache
  */
 void alloc_cache(Cache *c, uint32_t capacity, uint8_t num_ways,
-                 uint8_t block_size);
+                 uint8_t block_size, const struct ReplPolicy *policy);
 
 /* Release memory dynamically allocated for a cache */
 void free_cache(Cache *c);
 
-#ifdef LRU
-/* Mark a block withing a set as least recently used */
-void update_lru(Cache *c, size_t set, size_t block);
-#endif
-
-#ifdef RRIP
-void update_rrip(Cache *c, size_t set, size_t block);
-#endif
+/* Switch the replacement policy of a cache, keeps the cached blocks */
+void set_cache_policy(Cache *c, const struct ReplPolicy *policy);
 
 /**
  * @param uint32_t address 4 byte aligned adress to access
@@ -9,6 +9,7 @@
 #include "pipe.h"
 #include "cache.h"
 #include "mips.h"
+#include "repl_policy.h"
 #include "shell.h"
 #include <assert.h>
 #include <math.h>
@@ -38,8 +39,26 @@ void pipe_init() {
     pipe.PC = 0x00400000;
 
     // Initialize the caches
-    alloc_cache(&pipe.icache, ICACHE_SIZE, ICACHE_WAYS, BLOCK_SIZE);
-    alloc_cache(&pipe.dcache, DCACHE_SIZE, DCACHE_WAYS, BLOCK_SIZE);
+    alloc_cache(&pipe.icache, ICACHE_SIZE, ICACHE_WAYS, BLOCK_SIZE,
+                find_repl_policy(CACHE_POLICY));
+    alloc_cache(&pipe.dcache, DCACHE_SIZE, DCACHE_WAYS, BLOCK_SIZE,
+                find_repl_policy(CACHE_POLICY));
+}
+
+int pipe_set_policy(const char *cache_name, const char *policy_name) {
+    const ReplPolicy *policy = find_repl_policy(policy_name);
+    if (policy == NULL) {
+        return -1;
+    }
+
+    if (strcmp(cache_name, "icache") == 0) {
+        set_cache_policy(&pipe.icache, policy);
+    } else if (strcmp(cache_name, "dcache") == 0) {
+        set_cache_policy(&pipe.dcache, policy);
+    } else {
+        return -1;
+    }
+    return 0;
 }
 
 void pipe_cycle() {
@@ -104,6 +104,10 @@ extern Pipe_State pipe;
 /* called during simulator startup */
 void pipe_init();
 
+/* select the replacement policy of "icache" or "dcache" by name,
+ * returns 0 on success and -1 for an unknown cache or policy */
+int pipe_set_policy(const char *cache_name, const char *policy_name);
+
 /* this function calls the others */
 void pipe_cycle();
 
@@ -0,0 +1,272 @@
+#include "repl_policy.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK(c, set, way) (c->sets[set].blocks[way])
+
+// ======================
+// LRU: meta = recency, 0 -> most recently used, num_ways - 1 -> LRU
+
+static void lru_init(Cache *c) {
+    // recencies of a set always form a permutation of [0, num_ways)
+    for (size_t s = 0; s < c->num_sets; s++) {
+        for (size_t b = 0; b < c->num_ways; b++) {
+            BLOCK(c, s, b).meta = b;
+        }
+    }
+}
+
+static void update_lru(Cache *c, uint32_t set, uint32_t block) {
+    uint32_t prev_recency = BLOCK(c, set, block).meta;
+
+    // increment the recency for blocks that were prev. more recent
+    for (size_t b = 0; b < c->num_ways; b++) {
+        if (BLOCK(c, set, b).meta < prev_recency) {
+            BLOCK(c, set, b).meta++;
+        }
+    }
+
+    // and most recently updated block gets the lru pos 0;
+    BLOCK(c, set, block).meta = 0;
+}
+
+static uint32_t lru_victim(Cache *c, uint32_t set) {
+    // evict the least recently used block
+    for (size_t b = 0; b < c->num_ways; b++) {
+        if (BLOCK(c, set, b).meta == c->num_ways - 1) {
+            return b;
+        }
+    }
+    assert(0 && "LRU recencies are not a permutation");
+    return 0;
+}
+
+// ======================
+// Random: no metadata
+
+static void no_init(Cache *c) {}
+
+static void no_update(Cache *c, uint32_t set, uint32_t way) {}
+
+static uint32_t rand_victim(Cache *c, uint32_t set) {
+    return rand() % c->num_ways;
+}
+
+// ======================
+// RRIP family: meta = 2-bit RRPV
+// https://people.csail.mit.edu/emer/media/papers/2010.06.isca.rrip.pdf
+
+static void rrip_init(Cache *c) {
+    for (size_t s = 0; s < c->num_sets; s++) {
+        for (size_t b = 0; b < c->num_ways; b++) {
+            BLOCK(c, s, b).meta = DISTANT_RRPV;
+        }
+    }
+    c->psel = PSEL_MAX / 2;
+    c->tick = 0;
+}
+
+static void rrip_hit(Cache *c, uint32_t set, uint32_t way) {
+    // hit priority: predict near-immediate re-reference
+    BLOCK(c, set, way).meta = IMMEDIATE_RRPV;
+}
+
+static uint32_t rrip_victim(Cache *c, uint32_t set) {
+    // age the whole set until some block reaches DISTANT_RRPV, done in one
+    // step by adding the distance of the oldest block to DISTANT_RRPV
+    uint32_t max_rrpv = 0;
+    for (size_t b = 0; b < c->num_ways; b++) {
+        if (BLOCK(c, set, b).meta > max_rrpv) {
+            max_rrpv = BLOCK(c, set, b).meta;
+        }
+    }
+
+    uint32_t age = DISTANT_RRPV - max_rrpv;
+    uint32_t victim = 0;
+    int found = 0;
+    for (size_t b = 0; b < c->num_ways; b++) {
+        BLOCK(c, set, b).meta += age;
+        if (!found && BLOCK(c, set, b).meta == DISTANT_RRPV) {
+            victim = b;
+            found = 1;
+        }
+    }
+    return victim;
+}
+
+static void srrip_fill(Cache *c, uint32_t set, uint32_t way) {
+    BLOCK(c, set, way).meta = LONG_RRPV;
+}
+
+static void brrip_fill(Cache *c, uint32_t set, uint32_t way) {
+    // mostly insert at distant, infrequently at long re-reference interval
+    BLOCK(c, set, way).meta =
+        (c->tick++ % BRRIP_THROTTLE == 0) ? LONG_RRPV : DISTANT_RRPV;
+}
+
+typedef enum { DUEL_FOLLOWER, DUEL_SRRIP_LEADER, DUEL_BRRIP_LEADER } DuelRole;
+
+static DuelRole drrip_role(Cache *c, uint32_t set) {
+    // spread the leader sets evenly over the cache
+    uint32_t stride = c->num_sets / DUEL_LEADER_SETS;
+    if (stride < 2) {
+        stride = 2;
+    }
+
+    if (set % stride == 0) {
+        return DUEL_SRRIP_LEADER;
+    }
+    if (set % stride == 1) {
+        return DUEL_BRRIP_LEADER;
+    }
+    return DUEL_FOLLOWER;
+}
+
+static void drrip_fill(Cache *c, uint32_t set, uint32_t way) {
+    // a fill means a miss: leader sets train the policy selector
+    switch (drrip_role(c, set)) {
+    case DUEL_SRRIP_LEADER:
+        if (c->psel < PSEL_MAX) {
+            c->psel++;
+        }
+        srrip_fill(c, set, way);
+        break;
+    case DUEL_BRRIP_LEADER:
+        if (c->psel > 0) {
+            c->psel--;
+        }
+        brrip_fill(c, set, way);
+        break;
+    case DUEL_FOLLOWER:
+        // high PSEL -> SRRIP leaders miss more -> follow BRRIP
+        if (c->psel > PSEL_MAX / 2) {
+            brrip_fill(c, set, way);
+        } else {
+            srrip_fill(c, set, way);
+        }
+        break;
+    }
+}
+
+// ======================
+// Tree-PLRU: set_meta[set] holds the num_ways - 1 tree node bits, node n
+// (heap order, root = 1) at bit n - 1. A node bit points towards the
+// pseudo-LRU half of its subtree (0 = left, 1 = right).
+
+static uint32_t plru_levels(Cache *c) {
+    uint32_t levels = 0;
+    while ((1u << levels) < c->num_ways) {
+        levels++;
+    }
+    return levels;
+}
+
+static void plru_init(Cache *c) {
+    assert((c->num_ways & (c->num_ways - 1)) == 0 &&
+           "tree-PLRU needs power-of-two ways");
+    assert(c->num_ways <= 32 && "tree-PLRU bits must fit in one word");
+    memset(c->set_meta, 0, c->num_sets * sizeof(uint32_t));
+}
+
+static void plru_touch(Cache *c, uint32_t set, uint32_t way) {
+    uint32_t levels = plru_levels(c);
+    uint32_t node = 1;
+
+    // walk from the root to the accessed leaf, pointing each node away from it
+    for (uint32_t l = 0; l < levels; l++) {
+        uint32_t dir = (way >> (levels - 1 - l)) & 1;
+        if (dir) {
+            c->set_meta[set] &= ~(1u << (node - 1));
+        } else {
+            c->set_meta[set] |= 1u << (node - 1);
+        }
+        node = 2 * node + dir;
+    }
+}
+
+static uint32_t plru_victim(Cache *c, uint32_t set) {
+    uint32_t levels = plru_levels(c);
+    uint32_t node = 1;
+
+    // follow the node bits down to the pseudo-LRU leaf
+    for (uint32_t l = 0; l < levels; l++) {
+        node = 2 * node + ((c->set_meta[set] >> (node - 1)) & 1);
+    }
+    return node - c->num_ways;
+}
+
+// ======================
+// LFU: meta = saturating use count, ties broken towards the lowest way
+
+static void lfu_init(Cache *c) {
+    for (size_t s = 0; s < c->num_sets; s++) {
+        for (size_t b = 0; b < c->num_ways; b++) {
+            BLOCK(c, s, b).meta = 0;
+        }
+    }
+}
+
+static void lfu_hit(Cache *c, uint32_t set, uint32_t way) {
+    if (BLOCK(c, set, way).meta < UINT32_MAX) {
+        BLOCK(c, set, way).meta++;
+    }
+}
+
+static void lfu_fill(Cache *c, uint32_t set, uint32_t way) {
+    BLOCK(c, set, way).meta = 1;
+}
+
+static uint32_t min_meta_victim(Cache *c, uint32_t set) {
+    uint32_t victim = 0;
+    for (size_t b = 1; b < c->num_ways; b++) {
+        if (BLOCK(c, set, b).meta < BLOCK(c, set, victim).meta) {
+            victim = b;
+        }
+    }
+    return victim;
+}
+
+// ======================
+// FIFO: meta = insertion stamp taken from the per-cache fill counter
+
+static void fifo_init(Cache *c) {
+    lfu_init(c);
+    c->tick = 0;
+}
+
+static void fifo_fill(Cache *c, uint32_t set, uint32_t way) {
+    BLOCK(c, set, way).meta = c->tick++;
+}
+
+// ======================
+
+const ReplPolicy repl_lru = {"lru", lru_init, update_lru, update_lru,
+                             lru_victim};
+const ReplPolicy repl_rand = {"rand", no_init, no_update, no_update,
+                              rand_victim};
+const ReplPolicy repl_srrip = {"srrip", rrip_init, rrip_hit, srrip_fill,
+                               rrip_victim};
+const ReplPolicy repl_brrip = {"brrip", rrip_init, rrip_hit, brrip_fill,
+                               rrip_victim};
+const ReplPolicy repl_drrip = {"drrip", rrip_init, rrip_hit, drrip_fill,
+                               rrip_victim};
+const ReplPolicy repl_plru = {"plru", plru_init, plru_touch, plru_touch,
+                              plru_victim};
+const ReplPolicy repl_lfu = {"lfu", lfu_init, lfu_hit, lfu_fill,
+                             min_meta_victim};
+const ReplPolicy repl_fifo = {"fifo", fifo_init, no_update, fifo_fill,
+                              min_meta_victim};
+
+const ReplPolicy *const repl_policies[] = {
+    &repl_lru,   &repl_rand, &repl_srrip, &repl_brrip, &repl_drrip,
+    &repl_plru,  &repl_lfu,  &repl_fifo,  NULL};
+
+const ReplPolicy *find_repl_policy(const char *name) {
+    for (size_t i = 0; repl_policies[i] != NULL; i++) {
+        if (strcmp(repl_policies[i]->name, name) == 0) {
+            return repl_policies[i];
+        }
+    }
+    return NULL;
+}
@@ -123,6 +123,9 @@ void help() {
   printf("rdump                  -  dump architectural registers      \n");
   printf("mdump low high         -  dump memory from low to high      \n");
   printf("input reg_no reg_value - set GPR reg_no to reg_value  \n");
+  printf("policy cache name      -  set replacement policy of cache   \n");
+  printf("                          (icache|dcache, lru|rand|srrip|   \n");
+  printf("                          brrip|drrip|plru|lfu|fifo)        \n");
   printf("?                      -  display this help menu            \n");
   printf("quit                   -  exit the program                  \n\n");
 }
@@ -208,9 +211,9 @@ void bench() {
     return;
   }
   
-  // configure caches to spec
-  alloc_cache(&pipe.icache, params[0], params[1], params[2]);
-  alloc_cache(&pipe.dcache, params[3], params[4], params[5]);
+  // configure caches to spec, keeping the selected replacement policies
+  alloc_cache(&pipe.icache, params[0], params[1], params[2], pipe.icache.policy);
+  alloc_cache(&pipe.dcache, params[3], params[4], params[5], pipe.dcache.policy);
 
   printf("Simulating...\n\n");
   while (RUN_BIT)
@@ -270,6 +273,7 @@ void mdump(int start, int stop) {
 /***************************************************************/
 void get_command() {
   char buffer[20];
+  char cache_name[20], policy_name[20];
   int start, stop, cycles;
   int register_no, register_value;
 
@@ -312,6 +316,15 @@ void get_command() {
     }
     break;
 
+  case 'P':
+  case 'p':
+    if (scanf("%19s %19s", cache_name, policy_name) != 2)
+        break;
+
+    if (pipe_set_policy(cache_name, policy_name) != 0)
+        printf("Unknown cache or policy: %s %s\n", cache_name, policy_name);
+    break;
+
   case 'I':
   case 'i':
    if (scanf("%i %i", &register_no, &register_value) != 2)
@@ -0,0 +1,91 @@
+/*
+ * Host-side microbenchmark of the tag store: lookup throughput for
+ * 16-way L2 sets, comparing a scalar tag loop with cache_find_way.
+ *
+ * make lookupbench && ./lookupbench
+ * (make SIMD=-mavx2 lookupbench for 8-wide tag compares)
+ */
+
+#include "cache.h"
+#include "hierarchy.h"
+#include "repl_policy.h"
+#include <stdio.h>
+#include <time.h>
+
+#define NUM_LOOKUPS (1 << 24)
+
+// globals normally defined by shell.c
+uint32_t stat_cycles;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int scalar_find_way(Cache *c, uint32_t set, uint32_t tag) {
+    const uint32_t *tags = set_tags(c, set);
+    for (uint32_t w = 0; w < c->num_ways; w++) {
+        if (tags[w] == tag && ((c->valid[set] >> w) & 1)) {
+            return w;
+        }
+    }
+    return -1;
+}
+
+static void report(const char *name, double secs, uint32_t hits) {
+    printf("%-14s %8.1f Mlookups/s  (%u hits)\n", name, NUM_LOOKUPS / secs / 1e6, hits);
+}
+
+int main() {
+    init_default_hierarchy();
+    Cache *l2 = find_cache("l2");
+
+    // fill every way of every set so lookups scan full 16-way sets
+    srand(1);
+    for (uint32_t i = 0; i < l2->num_sets * l2->num_ways; i++) {
+        cache_insert_block(l2, (uint32_t)rand() << 5);
+    }
+
+    // random address stream, roughly half of them hit
+    uint32_t *addrs = malloc(NUM_LOOKUPS * sizeof(uint32_t));
+    for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+        uint32_t set = rand() % l2->num_sets;
+        uint32_t way = rand() % l2->num_ways;
+        uint32_t tag = set_tags(l2, set)[way] + (rand() & 1);
+        addrs[i] = (tag << (l2->set_bits + l2->block_bits)) | (set << l2->block_bits);
+    }
+
+    int (*variants[])(Cache *, uint32_t, uint32_t) = {scalar_find_way, cache_find_way};
+    const char *names[] = {"scalar", "cache_find_way"};
+
+    printf("%u sets x %u ways, %d lookups\n", l2->num_sets, l2->num_ways, NUM_LOOKUPS);
+    for (int v = 0; v < 2; v++) {
+        uint32_t hits = 0;
+        double start = now_sec();
+        for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+            uint32_t tag = addrs[i] >> (l2->set_bits + l2->block_bits);
+            uint32_t set = (addrs[i] >> l2->block_bits) & (l2->num_sets - 1);
+            hits += variants[v](l2, set, tag) >= 0;
+        }
+        report(names[v], now_sec() - start, hits);
+    }
+
+    // lookup followed by the LRU update on a hit
+    uint32_t hits = 0;
+    double start = now_sec();
+    for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+        uint32_t tag = addrs[i] >> (l2->set_bits + l2->block_bits);
+        uint32_t set = (addrs[i] >> l2->block_bits) & (l2->num_sets - 1);
+        int way = cache_find_way(l2, set, tag);
+        if (way >= 0) {
+            l2->policy->on_hit(l2, set, way);
+            hits++;
+        }
+    }
+    report("lookup + LRU", now_sec() - start, hits);
+
+    free(addrs);
+    free_hierarchy();
+    return 0;
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/python3
+
+# Simulator throughput benchmark (make perfbench): runs every input at fixed
+# configurations with ./perfsim, the simulator built with host timers, and
+# reports simulated instructions and cycles per host second, peak RSS and the
+# host time share of each component. Compares the throughput against a saved
+# baseline and exits with 1 if a run got slower by more than the threshold.
+
+import argparse, glob, json, os, re, subprocess, sys, tempfile
+
+sim = "./perfsim"
+
+# shell commands of each configuration, run before an input's .cmd file
+configs = {
+    "default": "",
+    "ddr4": "dram ddr4\nscheduler frfcfs\n",
+}
+
+# runs shorter than this are too noisy to compare
+min_seconds = 0.05
+
+bold="\033[1m"
+green="\033[0;32m"
+red="\033[0;31m"
+normal="\033[0m"
+
+
+def run(input_file, config_cmds):
+    cmds = config_cmds
+    cmdfile = os.path.splitext(input_file)[0] + ".cmd"
+    if os.path.exists(cmdfile):
+        cmds += open(cmdfile).read()
+    cmds += "\ngo\nrdump\nstats\nquit\n"
+
+    # the simulator prints every cache access: output to a file, so that a
+    # reader of a pipe can't slow it down
+    with tempfile.TemporaryFile() as f:
+        subprocess.run([sim, input_file], input=cmds.encode("utf-8"), stdout=f,
+                       stderr=subprocess.DEVNULL)
+        f.seek(0)
+        out = f.read()
+
+    result = {}
+    for key, pattern in (("cycles", rb"^Cycles: (\d+)"), ("retired", rb"^RetiredInstr: (\d+)")):
+        m = re.search(pattern, out, re.M)
+        result[key] = int(m.group(1)) if m else 0
+    host = re.search(rb"^Host time: ([\d.]+) s, pipeline ([\d.-]+)%, caches ([\d.-]+)%, "
+                     rb"memory ([\d.-]+)%, other [\d.-]+%, peak RSS (\d+) KB", out, re.M)
+    if host is None:
+        return None
+    result["seconds"] = float(host.group(1))
+    result["shares"] = [float(host.group(i)) for i in (2, 3, 4)]
+    result["rss_kb"] = int(host.group(5))
+    secs = max(result["seconds"], 1e-9)
+    result["inst_per_sec"] = result["retired"] / secs
+    result["cycles_per_sec"] = result["cycles"] / secs
+    return result
+
+
+# Best of repeat runs, by host time
+def best_run(input_file, config_cmds, repeat):
+    best = None
+    for _ in range(repeat):
+        r = run(input_file, config_cmds)
+        if r is not None and (best is None or r["seconds"] < best["seconds"]):
+            best = r
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("inputs", nargs="*", default=sorted(glob.glob("inputs/*/*.x")))
+    parser.add_argument("--baseline", default="bench/perf_baseline.json")
+    parser.add_argument("--save", action="store_true", help="replace the baseline")
+    parser.add_argument("--repeat", type=int, default=1, help="runs per input, the fastest counts")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="slowdown against the baseline reported as a regression")
+    args = parser.parse_args()
+
+    baseline = {}
+    if os.path.exists(args.baseline) and not args.save:
+        baseline = json.load(open(args.baseline))
+
+    print(bold + "Input".ljust(32) + "Config".ljust(9) + "Minst/s".rjust(9) + "Mcyc/s".rjust(9) +
+          "Host s".rjust(9) + "RSS MB".rjust(8) + "pipe%".rjust(7) + "cache%".rjust(7) +
+          "mem%".rjust(7) + "  vs baseline" + normal)
+
+    results = {}
+    regressions = []
+    for config, config_cmds in configs.items():
+        total = {"retired": 0, "cycles": 0, "seconds": 0.0}
+        for i in args.inputs:
+            r = best_run(i, config_cmds, args.repeat)
+            key = config + ":" + i
+            if r is None:
+                print(red + "ERROR -- no host times from " + sim + " for " + i + normal)
+                regressions.append(key)
+                continue
+            results[key] = r
+            for k in total:
+                total[k] += r[k]
+
+            note = ""
+            base = baseline.get(key)
+            if base and r["cycles"] != base["cycles"]:
+                note = "simulated cycles changed (%d -> %d)" % (base["cycles"], r["cycles"])
+            elif base and r["seconds"] >= min_seconds:
+                ratio = r["cycles_per_sec"] / base["cycles_per_sec"]
+                note = "%.2fx" % ratio
+                if ratio < 1 - args.threshold:
+                    note = red + note + " REGRESSION" + normal
+                    regressions.append(key)
+
+            print(i.ljust(32) + config.ljust(9) + ("%.2f" % (r["inst_per_sec"] / 1e6)).rjust(9) +
+                  ("%.2f" % (r["cycles_per_sec"] / 1e6)).rjust(9) +
+                  ("%.3f" % r["seconds"]).rjust(9) + ("%.1f" % (r["rss_kb"] / 1024)).rjust(8) +
+                  "".join(("%.1f" % s).rjust(7) for s in r["shares"]) + "  " + note)
+
+        secs = max(total["seconds"], 1e-9)
+        print(bold + ("Total " + config).ljust(41) +
+              ("%.2f" % (total["retired"] / secs / 1e6)).rjust(9) +
+              ("%.2f" % (total["cycles"] / secs / 1e6)).rjust(9) +
+              ("%.3f" % total["seconds"]).rjust(9) + normal)
+        print()
+
+    if args.save:
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+        print("Saved baseline " + args.baseline)
+    elif not baseline:
+        print("No baseline, save one with: make perfbench SAVE=1")
+    elif regressions:
+        print(red + "%d run(s) slower than the baseline by more than %d%%" %
+              (len(regressions), 100 * args.threshold) + normal)
+        sys.exit(1)
+    else:
+        print(green + "No regressions against " + args.baseline + normal)
+
+
+if __name__ == "__main__":
+    main()
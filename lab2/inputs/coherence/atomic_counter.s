@@ -0,0 +1,28 @@
+# Each core adds 1 to one shared counter 1000 times with LL/SC, retrying when
+# another core's store broke its reservation: true sharing. Each core then
+# counts itself done and waits for the others, so every core reads the total
+# 1000 * cores. Run with ./sim -t <cores>.
+    .text
+    lui $s0, 0x1000 # counter at 0x10000000
+    ori $t1, $0, 1000
+loop:
+    ll $t2, 0($s0)
+    addiu $t2, $t2, 1
+    sc $t2, 0($s0)
+    beq $t2, $0, loop # SC failed, try again
+    addiu $t1, $t1, -1
+    bne $t1, $0, loop
+
+done:
+    ll $t2, 32($s0) # cores done, at 0x10000020 in the next block
+    addiu $t2, $t2, 1
+    sc $t2, 32($s0)
+    beq $t2, $0, done
+wait:
+    lw $t2, 32($s0)
+    slt $t3, $t2, $a1 # until all $a1 cores are done ($a1 is 0 without -t)
+    bne $t3, $0, wait
+
+    lw $s1, 0($s0) # the total, 1000 * cores
+    addiu $v0, $0, 10
+    syscall
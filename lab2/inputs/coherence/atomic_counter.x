@@ -0,0 +1,18 @@
+3c101000
+340903e8
+c20a0000
+254a0001
+e20a0000
+1140fffc
+2529ffff
+1520fffa
+c20a0020
+254a0001
+e20a0020
+1140fffc
+8e0a0020
+0145582a
+1560fffd
+8e110000
+2402000a
+0000000c
@@ -0,0 +1,18 @@
+# Each core adds 1 to its own counter 10000 times. The counters of all cores
+# are adjacent words of one block, so every store invalidates the block in the
+# other cores' D-caches: false sharing. Run with ./sim -t <cores>.
+    .text
+    lui $s0, 0x1000 # counters at 0x10000000
+    sll $t0, $a0, 2 # counter of core $a0
+    addu $s1, $s0, $t0
+    ori $t1, $0, 10000
+loop:
+    lw $t2, 0($s1)
+    addiu $t2, $t2, 1
+    sw $t2, 0($s1)
+    addiu $t1, $t1, -1
+    bne $t1, $0, loop
+
+    lw $s2, 0($s1) # 10000
+    addiu $v0, $0, 10
+    syscall
@@ -0,0 +1,18 @@
+# false_sharing.s with each counter in a block of its own (32 bytes apart),
+# so the cores never share blocks: no coherence misses. Run with
+# ./sim -t <cores>.
+    .text
+    lui $s0, 0x1000 # counters at 0x10000000
+    sll $t0, $a0, 5 # counter of core $a0, one block each
+    addu $s1, $s0, $t0
+    ori $t1, $0, 10000
+loop:
+    lw $t2, 0($s1)
+    addiu $t2, $t2, 1
+    sw $t2, 0($s1)
+    addiu $t1, $t1, -1
+    bne $t1, $0, loop
+
+    lw $s2, 0($s1) # 10000
+    addiu $v0, $0, 10
+    syscall
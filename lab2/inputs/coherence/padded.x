@@ -0,0 +1,12 @@
+3c101000
+00044140
+02088821
+34092710
+8e2a0000
+254a0001
+ae2a0000
+2529ffff
+1520fffb
+8e320000
+2402000a
+0000000c
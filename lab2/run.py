@@ -5,89 +5,251 @@
 # Juan Gomez Luna, 2017
 # Minesh Patel, 2020
 
-import sys, os, subprocess, re, glob, argparse
+# Regression runner: runs the inputs on ./sim across a process pool and
+# compares the final register, PC and stat dumps with ./basesim field by
+# field. The results of basesim are cached, keyed by a hash of the basesim
+# binary and the input's .x and .cmd files, so only ./sim runs once they are
+# known. At the first input whose registers or PC differ the runner stops and
+# reruns ./sim checked against its functional model, which finds the first
+# instruction it retires wrongly; if there is none, it runs both simulators in
+# lockstep to find the first cycle they differ in.
+
+import sys, os, subprocess, re, glob, argparse, hashlib, json
+from concurrent.futures import ProcessPoolExecutor, as_completed
 
 ref = "./basesim"
 sim = "./sim"
+cache_dir = ".regress_cache"
 
 bold="\033[1m"
 green="\033[0;32m"
 red="\033[0;31m"
 normal="\033[0m"
 
+# fields of an rdump that are compared; the others are stats, shown but not
+# checked, as the timing of sim may differ from basesim
+dump_regex = re.compile(r"^(Core \d+|PC:|R\d+:|HI:|LO:|Cycles:|Fetched\w+:|Retired\w+:|IPC:|Flushes:)")
+checked = re.compile(r"^(core\d+\.)?(PC|R\d+|HI|LO)$")
+
+# cycles per step of the lockstep search before it steps cycle by cycle
+lockstep_chunk = 1000
+
 
 def main():
-    all_inputs = glob.glob("inputs/*/*.x")
+    all_inputs = sorted(glob.glob("inputs/*/*.x"))
 
     parser = argparse.ArgumentParser()
     parser.add_argument("inputs", nargs="*", default=all_inputs)
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(),
+                        help="simulator processes run at once")
+    parser.add_argument("--no-cache", action="store_true", help="always rerun basesim")
+    parser.add_argument("--keep-going", action="store_true",
+                        help="run every input instead of stopping at the first divergence")
+    parser.add_argument("--no-lockstep", action="store_true",
+                        help="don't search for the first differing cycle")
     parser = parser.parse_args()
 
+    inputs = []
     for i in parser.inputs:
         if not os.path.exists(i):
             print(red + "ERROR -- input file (*.x) not found: " + i + normal)
-            continue
-
-        print(bold + "Testing: " + normal + i)
-        ref_out, sim_out = run(i)
-
-        print("  " + "Stats".ljust(14) + "BaselineSim".center(14) + "YourSim".center(14))
-
-        ref_out = ref_out.split("\n")
-        sim_out = sim_out.split("\n")
-        
-        nocheck = 0
-        error = 0
-        for r, s in zip(ref_out, sim_out):
-
-            r0 = r.split()[0]
-            r1 = r.split()[1]
-            s1 = s.split()[1]
-
-            print("  " + r0.ljust(14) + r1.center(14) + s1.center(14),)
-
-            if (r0 == "Cycles:"):
-                nocheck = 1
-            if (r1 != s1 and nocheck == 0):
-                print("  " + red + "ERROR" + normal)
-                error = 1
         else:
-            print()
-
-        if error == 0:
-            print("  " + green + "REGISTER CONTENTS OK" + normal)
-        print()
-
-
-def run(i):
-    global ref, sim
-
-    refproc = subprocess.Popen([ref, i], executable=ref, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-    simproc = subprocess.Popen([sim, i], executable=sim, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-
+            inputs.append(i)
+
+    ref_hash = file_hash(ref)
+    failed = []
+    ref_dumps = {}
+    with ProcessPoolExecutor(max_workers=parser.jobs) as pool:
+        futures = {pool.submit(test, i, ref_hash, parser.no_cache): i for i in inputs}
+        for f in as_completed(futures):
+            i = futures[f]
+            ref_dump, sim_dump = f.result()
+            if not report(i, ref_dump, sim_dump):
+                failed.append(i)
+                ref_dumps[i] = ref_dump
+                if not parser.keep_going:
+                    for other in futures:
+                        other.cancel()
+                    break
+
+    if failed and not parser.no_lockstep:
+        lockstep(failed[0], ref_dumps[failed[0]])
+
+    print()
+    if failed:
+        print(red + "%d input(s) diverged: %s" % (len(failed), " ".join(sorted(failed))) + normal)
+        sys.exit(1)
+    print(green + "All %d inputs OK" % len(inputs) + normal)
+
+
+def file_hash(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for chunk in iter(lambda: f.read(1 << 20), b""):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def commands(i):
     cmds = b""
     cmdfile = os.path.splitext(i)[0] + ".cmd"
     if os.path.exists(cmdfile):
-      cmds += open(cmdfile).read().encode('utf-8')
-
-    cmds += b"\ngo\nrdump\nquit\n"
-    (r, r_err) = refproc.communicate(input=cmds)
-    (s, s_err) = simproc.communicate(input=cmds)
+        cmds += open(cmdfile, "rb").read()
+    return cmds
 
-    return filter_stats(r.decode('utf-8')), filter_stats(s.decode('utf-8'))
 
+def run(binary, i):
+    proc = subprocess.run([binary, i], input=commands(i) + b"\ngo\nrdump\nquit\n",
+                          stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    return parse_dump(proc.stdout.decode("utf-8", "replace"))
 
-def filter_stats(out):
-    lines = out.split("\n")
-    regex = re.compile("^(HI:)|(LO:)|(R\d+:)|(PC:)|(Cycles:)|(Fetched\w+:)|(Retired\w+:)|(IPC:)|(Flushes:).*$")
-    out = []
-    for l in lines:
-        if regex.match(l):
-          out.append(l)
 
-    return "\n".join(out)
+# Fields of the last rdump in out, in order, named core<n>.<field> on several
+# cores
+def parse_dump(out):
+    dump = {}
+    core = ""
+    for l in out.split("\n"):
+        if not dump_regex.match(l):
+            continue
+        if l.startswith("Core "):
+            core = "core" + l.split()[1] + "."
+            continue
+        name, value = l.split(":", 1)
+        dump[(core if checked.match(name) else "") + name] = value.strip()
+    return dump
+
+
+# Result of basesim from the cache, or from running it
+def reference(i, ref_hash, no_cache):
+    key = hashlib.sha256((ref_hash + file_hash(i)).encode() + commands(i)).hexdigest()
+    path = os.path.join(cache_dir, key + ".json")
+    if not no_cache and os.path.exists(path):
+        return json.load(open(path))
+
+    dump = run(ref, i)
+    os.makedirs(cache_dir, exist_ok=True)
+    tmp = path + ".%d" % os.getpid()
+    with open(tmp, "w") as f:
+        json.dump(dump, f)
+    os.replace(tmp, path)
+    return dump
+
+
+def test(i, ref_hash, no_cache):
+    return reference(i, ref_hash, no_cache), run(sim, i)
+
+
+# Print the differences of an input, returns 0 if a checked field differs
+def report(i, ref_dump, sim_dump):
+    errors = [k for k in ref_dump if checked.match(k) and ref_dump[k] != sim_dump.get(k)]
+    stats = [k for k in ref_dump if not checked.match(k) and ref_dump[k] != sim_dump.get(k)]
+    if not errors:
+        note = ""
+        if stats:
+            note = " (" + ", ".join("%s %s vs %s" % (k, ref_dump[k], sim_dump.get(k))
+                                    for k in stats) + ")"
+        print(bold + "Testing: " + normal + i + " " + green + "REGISTER CONTENTS OK" + normal +
+              note)
+        return 1
+
+    print(bold + "Testing: " + normal + i + " " + red + "ERROR" + normal)
+    print("  " + "Field".ljust(14) + "BaselineSim".center(14) + "YourSim".center(14))
+    for k in errors + stats:
+        print("  " + k.ljust(14) + ref_dump[k].center(14) + str(sim_dump.get(k)).center(14))
+    return 0
+
+
+# Simulator driven through the shell, a step at a time
+class Stepper:
+    def __init__(self, binary, i):
+        self.proc = subprocess.Popen([binary, i], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                     stderr=subprocess.DEVNULL)
+        self.proc.stdin.write(commands(i) + b"\n")
+
+    # Run n cycles, returns the architectural state after them
+    def step(self, n):
+        self.proc.stdin.write(b"run %d\nrdump\n" % n)
+        self.proc.stdin.flush()
+        lines = []
+        while True:
+            l = self.proc.stdout.readline().decode("utf-8", "replace")
+            if l == "":
+                break
+            lines.append(l.rstrip("\n"))
+            if l.startswith("Flushes:"):
+                break
+        dump = parse_dump("\n".join(lines))
+        return {k: v for k, v in dump.items() if checked.match(k)}
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.kill()
+        self.proc.wait()
+
+
+def start_pair(i, cycles):
+    pair = [Stepper(ref, i), Stepper(sim, i)]
+    if cycles:
+        for s in pair:
+            s.step(cycles)
+    return pair
+
+
+# Rerun sim with every retired instruction checked against its functional
+# model, returns the report of the first one that differs
+def check_retire(i):
+    proc = subprocess.run([sim, i], input=b"lockstep on\n" + commands(i) + b"\ngo\nquit\n",
+                          stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    out = proc.stdout.decode("utf-8", "replace").split("\n")
+    for n, l in enumerate(out):
+        if l.startswith("Lockstep:"):
+            return out[n:n + 3]
+    return []
+
+
+# Run basesim and sim side by side, compare their registers and PC every
+# lockstep_chunk cycles, then from the last matching point every cycle. This
+# finds the first cycle at which the architectural state differs; if the
+# timing of sim differs from basesim, that may be where the timing first does.
+# ref_dump is basesim's final state, which bounds the search.
+def lockstep(i, ref_dump):
+    print()
+    print(bold + "Lockstep: " + normal + i)
+    wrong = check_retire(i)
+    if wrong:
+        for l in wrong:
+            print("  " + l)
+        return
+
+    cycle = 0
+    pair = start_pair(i, 0)
+    limit = int(ref_dump.get("Cycles", "0")) + lockstep_chunk
+    try:
+        while cycle < limit:
+            a, b = (s.step(lockstep_chunk) for s in pair)
+            if a != b:
+                break
+            cycle += lockstep_chunk
+        else:
+            print("  no difference within %d cycles" % limit)
+            return
+
+        for s in pair:
+            s.close()
+        pair = start_pair(i, cycle)
+        for n in range(lockstep_chunk):
+            a, b = (s.step(1) for s in pair)
+            if a != b:
+                diff = [k for k in a if a[k] != b.get(k)]
+                print("  first difference after cycle %d:" % (cycle + n + 1))
+                for k in diff:
+                    print("  " + k.ljust(14) + a[k].center(14) + str(b.get(k)).center(14))
+                return
+    finally:
+        for s in pair:
+            s.close()
 
 
 if __name__ == "__main__":
     main()
-
@@ -0,0 +1,149 @@
+#include "address_map.h"
+#include "cache.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *const field_names[MAP_FIELDS] = {"Ch", "Ra", "Bg", "Ba", "Co", "Ro"};
+
+// keys of the counts in a DRAM config file, the row count is derived
+static const char *const count_keys[MAP_FIELDS] = {"channels", "ranks", "bank_groups",
+                                                   "banks",    "columns", NULL};
+
+// Field named by the two letters at s, -1 if none
+static int find_field(const char *s) {
+    for (int f = 0; f < MAP_FIELDS; f++) {
+        if (strncmp(s, field_names[f], 2) == 0) {
+            return f;
+        }
+    }
+    return -1;
+}
+
+static int is_pow2(uint32_t x) { return x && !(x & (x - 1)); }
+
+static uint32_t log2_of(uint32_t x) {
+    uint32_t n = 0;
+    while (x >>= 1) {
+        n++;
+    }
+    return n;
+}
+
+void init_address_map(AddressMap *map) {
+    memset(map, 0, sizeof(AddressMap));
+    for (int f = 0; f < MAP_FIELDS; f++) {
+        map->count[f] = 1;
+    }
+    map->count[MAP_BANK] = NUM_BANKS;
+    map->count[MAP_COLUMN] = ROW_SIZE / BLOCK_SIZE;
+    strcpy(map->scheme, "RoCoBaBgRaCh");
+    finish_address_map(map);
+}
+
+int set_address_map_param(AddressMap *map, const char *key, const char *value) {
+    if (strcmp(key, "mapping") == 0) {
+        if (strlen(value) >= sizeof(map->scheme)) {
+            return -1;
+        }
+        strcpy(map->scheme, value);
+        return 0;
+    }
+    if (strcmp(key, "xor_banks") == 0) {
+        map->xor_banks = strcmp(value, "1") == 0;
+        return 0;
+    }
+    for (int f = 0; f < MAP_FIELDS; f++) {
+        if (count_keys[f] && strcmp(key, count_keys[f]) == 0) {
+            return sscanf(value, "%u", &map->count[f]) == 1 ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+int finish_address_map(AddressMap *map) {
+    uint32_t used = log2_of(BLOCK_SIZE);
+    for (int f = 0; f < MAP_FIELDS; f++) {
+        if (f != MAP_ROW && !is_pow2(map->count[f])) {
+            printf("DRAM %s must be a power of two\n", count_keys[f]);
+            return -1;
+        }
+        map->width[f] = f == MAP_ROW ? 0 : log2_of(map->count[f]);
+        used += map->width[f];
+    }
+    if (map->count[MAP_CHANNEL] > MAX_CHANNELS) {
+        printf("At most %d DRAM channels\n", MAX_CHANNELS);
+        return -1;
+    }
+    if (used >= 32) {
+        printf("DRAM organization leaves no address bits for the row\n");
+        return -1;
+    }
+    map->width[MAP_ROW] = 32 - used;
+
+    // which fields the scheme lists, most significant first
+    int order[MAP_FIELDS], n = 0;
+    uint8_t listed[MAP_FIELDS] = {0};
+    size_t len = strlen(map->scheme);
+    if (len % 2 != 0 || len / 2 > MAP_FIELDS) {
+        printf("Bad DRAM address mapping %s\n", map->scheme);
+        return -1;
+    }
+    for (size_t i = 0; i < len; i += 2) {
+        int f = find_field(&map->scheme[i]);
+        if (f < 0 || listed[f]) {
+            printf("Bad DRAM address mapping %s\n", map->scheme);
+            return -1;
+        }
+        listed[f] = 1;
+        order[n++] = f;
+    }
+
+    // fields of one element may be left out, the others must be listed
+    for (int f = 0; f < MAP_FIELDS; f++) {
+        if (!listed[f] && (map->width[f] || f == MAP_ROW)) {
+            printf("DRAM address mapping %s lacks %s\n", map->scheme, field_names[f]);
+            return -1;
+        }
+        map->shift[f] = 0;
+    }
+
+    // assign bits from the block offset up
+    uint32_t shift = log2_of(BLOCK_SIZE);
+    for (int j = n; j-- > 0;) {
+        map->shift[order[j]] = shift;
+        shift += map->width[order[j]];
+    }
+    return 0;
+}
+
+static uint32_t bits_of(uint32_t address, uint32_t shift, uint32_t width) {
+    return width == 0 ? 0 : (address >> shift) & (0xffffffffu >> (32 - width));
+}
+
+void map_address(const AddressMap *map, uint32_t address, DramAddress *out) {
+    for (int f = 0; f < MAP_FIELDS; f++) {
+        out->field[f] = bits_of(address, map->shift[f], map->width[f]);
+    }
+
+    if (map->xor_banks) {
+        uint32_t row = out->field[MAP_ROW];
+        out->field[MAP_BANK] ^= bits_of(row, 0, map->width[MAP_BANK]);
+        out->field[MAP_BANK_GROUP] ^=
+            bits_of(row, map->width[MAP_BANK], map->width[MAP_BANK_GROUP]);
+    }
+}
+
+void print_address_map(const AddressMap *map) {
+    printf("DRAM %u channel(s), %u rank(s), %u bank group(s) of %u banks, %u blocks per row\n",
+           map->count[MAP_CHANNEL], map->count[MAP_RANK], map->count[MAP_BANK_GROUP],
+           map->count[MAP_BANK], map->count[MAP_COLUMN]);
+    printf("  mapping %s%s:", map->scheme, map->xor_banks ? " with XOR bank hashing" : "");
+    for (const char *s = map->scheme; *s; s += 2) {
+        int f = find_field(s);
+        if (map->width[f]) {
+            printf(" %s[%u:%u]", field_names[f], map->shift[f] + map->width[f] - 1,
+                   map->shift[f]);
+        }
+    }
+    printf("\n");
+}
@@ -0,0 +1,66 @@
+#ifndef _ADDRESS_MAP_H_
+#define _ADDRESS_MAP_H_
+
+#include <stdint.h>
+
+// upper bound on the number of DRAM channels, one memory controller each
+#define MAX_CHANNELS 8
+
+// Fields of a physical address above the block offset
+typedef enum {
+    MAP_CHANNEL,
+    MAP_RANK,
+    MAP_BANK_GROUP,
+    MAP_BANK,
+    MAP_COLUMN,
+    MAP_ROW,
+    MAP_FIELDS
+} MapField;
+
+/**
+ * DRAM organization and the mapping of physical addresses onto it. The scheme
+ * lists the fields from the most significant bits down, two letters each:
+ * Ro(w), Ba(nk), Bg (bank group), Ra(nk), Co(lumn), Ch(annel). RoBaRaCoCh
+ * interleaves consecutive blocks across channels, RoCoBa (the lab default)
+ * across banks. Fields of a single element may be left out, the row takes
+ * whatever bits the others leave.
+ *
+ * With xor_banks the bank and bank group bits are XORed with the low row bits
+ * (permutation-based interleaving), so strides that map to one bank in
+ * successive rows spread across the banks instead of conflicting.
+ */
+typedef struct AddressMap {
+    uint32_t count[MAP_FIELDS]; // channels, ranks, bank groups, banks per group,
+                                // blocks per row; the row count is derived
+    char scheme[16];
+    uint8_t xor_banks;
+
+    // derived from the above by finish_address_map
+    uint8_t shift[MAP_FIELDS];
+    uint8_t width[MAP_FIELDS];
+} AddressMap;
+
+// Location of a block in the DRAM system
+typedef struct DramAddress {
+    uint32_t field[MAP_FIELDS]; // indexed by MapField
+} DramAddress;
+
+/* The lab organization: one channel and rank, 8 banks, rows of ROW_SIZE */
+void init_address_map(AddressMap *map);
+
+/* Set an organization parameter from a key = value pair of a DRAM config
+ * file (channels, ranks, bank_groups, banks, columns, mapping, xor_banks).
+ * Returns 0 on success, -1 for an unknown key or bad value. */
+int set_address_map_param(AddressMap *map, const char *key, const char *value);
+
+/* Check the parameters and derive the bit positions of the fields, prints
+ * the problem and returns -1 if they don't describe a valid mapping */
+int finish_address_map(AddressMap *map);
+
+/* Split a physical address into its DRAM fields */
+void map_address(const AddressMap *map, uint32_t address, DramAddress *out);
+
+/* Print the organization and the bits of each field */
+void print_address_map(const AddressMap *map);
+
+#endif
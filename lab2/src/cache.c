@@ -1,10 +1,23 @@
 #include "cache.h"
+#include "coherence.h"
+#include "hierarchy.h"
+#include "repl_policy.h"
 #include "shell.h"
 #include "stdio.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
-void alloc_cache(Cache *c, uint32_t capacity, uint8_t num_ways, uint8_t block_size) {
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define CACHE_LINE_BYTES 64
+
+void alloc_cache(Cache *c, uint32_t capacity, uint8_t num_ways, uint8_t block_size,
+                 const ReplPolicy *policy) {
     c->block_size = block_size;
     c->num_sets = capacity / (block_size * num_ways);
     c->num_ways = num_ways;
@@ -25,216 +38,559 @@ void alloc_cache(Cache *c, uint32_t capacity, uint8_t num_ways, uint8_t block_si
         c->set_bits++;
     }
 
-    // dynamically allocate zeroed memory for cache
-    c->sets = (Set *)calloc(c->num_sets, sizeof(Set));
+    assert(c->num_ways <= CACHE_MAX_WAYS);
+    c->way_stride = (c->num_ways + CACHE_WAY_ALIGN - 1) & ~(CACHE_WAY_ALIGN - 1);
+
+    // one zeroed, cache line aligned allocation holds the whole tag store:
+    // tags | set_meta | valid | remote_writes | state
+    size_t ways = (size_t)c->num_sets * c->way_stride;
+    size_t tags_bytes = ways * sizeof(uint32_t);
+    size_t meta_bytes = (size_t)c->num_sets * sizeof(uint64_t);
+    size_t valid_bytes = (size_t)c->num_sets * sizeof(uint32_t);
+    size_t remote_bytes = ways * sizeof(uint32_t);
+    size_t total = tags_bytes + meta_bytes + valid_bytes + remote_bytes + ways;
+    total = (total + CACHE_LINE_BYTES - 1) & ~(size_t)(CACHE_LINE_BYTES - 1);
+
+    uint8_t *store = (uint8_t *)aligned_alloc(CACHE_LINE_BYTES, total);
+    assert(store);
+    memset(store, 0, total);
+
+    c->tags = (uint32_t *)store;
+    c->set_meta = (uint64_t *)(store + tags_bytes);
+    c->valid = (uint32_t *)(store + tags_bytes + meta_bytes);
+    c->remote_writes = (uint32_t *)(store + tags_bytes + meta_bytes + valid_bytes);
+    c->state = store + tags_bytes + meta_bytes + valid_bytes + remote_bytes;
+
+    c->victim = NULL;
+    c->hits = 0;
+    c->misses = 0;
+    c->replay_pending = 0;
+    c->coherence_misses = 0;
+    c->false_sharing = 0;
+    c->upgrades = 0;
+    c->transfers = 0;
+    c->invalidations = 0;
+    c->writebacks = 0;
+
+    set_cache_policy(c, policy);
+}
+
+void free_cache(Cache *c) {
+    // all arrays share the allocation starting at the tags
+    free(c->tags);
+}
+
+void set_cache_policy(Cache *c, const ReplPolicy *policy) {
+    c->policy = policy;
+    c->policy->init(c);
+}
 
-    for (size_t s = 0; s < c->num_sets; s++) {
-        c->sets[s].blocks = (Block *)calloc(c->num_ways, sizeof(Block));
+int cache_find_way(Cache *c, uint32_t set, uint32_t tag) {
+    const uint32_t *tags = set_tags(c, set);
+    uint32_t match = 0; // bit w set if tags[w] == tag
+
+    // compare a full vector of tags per instruction, the padding ways past
+    // num_ways are never valid and get masked off below
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32(tag);
+    for (uint32_t w = 0; w < c->num_ways; w += 8) {
+        __m256i t = _mm256_load_si256((const __m256i *)&tags[w]);
+        __m256i eq = _mm256_cmpeq_epi32(t, key);
+        match |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(eq)) << w;
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32(tag);
+    for (uint32_t w = 0; w < c->num_ways; w += 4) {
+        __m128i t = _mm_load_si128((const __m128i *)&tags[w]);
+        __m128i eq = _mm_cmpeq_epi32(t, key);
+        match |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << w;
+    }
+#elif defined(__aarch64__)
+    static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+    uint32x4_t key = vdupq_n_u32(tag);
+    uint32x4_t bits = vld1q_u32(lane_bits);
+    for (uint32_t w = 0; w < c->num_ways; w += 4) {
+        uint32x4_t eq = vceqq_u32(vld1q_u32(&tags[w]), key);
+        match |= vaddvq_u32(vandq_u32(eq, bits)) << w;
     }
+#else
+    for (uint32_t w = 0; w < c->num_ways; w++) {
+        match |= (uint32_t)(tags[w] == tag) << w;
+    }
+#endif
+
+    match &= c->valid[set];
+    return match ? __builtin_ctz(match) : -1;
 }
 
-void free_cache(Cache *c) {
-    // free the blocks in each set
-    for (size_t s = 0; s < c->num_sets; s++) {
-        // free the blocks
-        free(c->sets[s].blocks);
+// Choose the way to fill: invalid blocks first, otherwise ask the policy
+static uint32_t find_victim(Cache *c, uint32_t set) {
+    uint64_t all_ways = (1ull << c->num_ways) - 1;
+    uint32_t invalid = ~c->valid[set] & (uint32_t)all_ways;
+    if (invalid) {
+        return __builtin_ctz(invalid);
     }
+    return c->policy->pick_victim(c, set);
+}
+
+static InclusionPolicy inclusion = CACHE_INCLUSION;
+static uint32_t back_invalidations = 0; // blocks invalidated above a level by its evictions
 
-    // free the sets
-    free(c->sets);
+// Address of the block held in (set, way)
+static uint32_t block_address(Cache *c, uint32_t set, uint32_t way) {
+    return (set_tags(c, set)[way] << (c->block_bits + c->set_bits)) | (set << c->block_bits);
 }
 
-void update_lru(Cache *c, size_t set, size_t block) {
-    uint32_t prev_recency = c->sets[set].blocks[block].recency;
+// Way holding the block of address, or -1
+static int lookup_block(Cache *c, uint32_t address) {
+    uint32_t tag = (address >> (c->block_bits + c->set_bits));
+    uint32_t set = ((address >> c->block_bits) & ((1 << c->set_bits) - 1));
+    return cache_find_way(c, set, tag);
+}
 
-    // increment the recency for valid blocks that were prev. more recent
-    for (size_t b = 0; b < c->num_ways; b++) {
-        if (c->sets[set].blocks[b].valid && c->sets[set].blocks[b].recency < prev_recency) {
-            c->sets[set].blocks[b].recency++;
-        }
+// Drop the block of address from the cache, returns 1 if it was present
+static int invalidate_block(Cache *c, uint32_t address) {
+    int way = lookup_block(c, address);
+    if (way < 0) {
+        return 0;
     }
-
-    // and most recently updated block gets the lru pos 0;
-    c->sets[set].blocks[block].recency = 0;
+    uint32_t set = ((address >> c->block_bits) & ((1 << c->set_bits) - 1));
+    c->valid[set] &= ~(1u << way);
+    return 1;
 }
 
-static MSHR *find_mshr_for_address(uint32_t address) {
-    // Align address to block boundary
-    uint32_t block_addr = address & ~(BLOCK_SIZE - 1);
+// Insert the block holding address into the cache.
+// Returns 1 and the address of the evicted block if a valid block was replaced.
+static int fill_block(Cache *c, uint32_t address, uint32_t *evicted) {
+    uint32_t tag = (address >> (c->block_bits + c->set_bits));
+    uint32_t set = ((address >> c->block_bits) & ((1 << c->set_bits) - 1));
 
-    for (size_t i = 0; i < NUM_MSHR; i++) {
-        if (mshrs[i].valid && (mshrs[i].address & ~(BLOCK_SIZE - 1)) == block_addr) {
-            return &mshrs[i];
-        }
+    uint32_t victim = find_victim(c, set);
+    int replaced = (c->valid[set] >> victim) & 1;
+    if (replaced) {
+        *evicted = block_address(c, set, victim);
     }
-    return NULL;
+
+    // Insert the block at victims place
+    set_tags(c, set)[victim] = tag;
+    c->valid[set] |= 1u << victim;
+    c->policy->on_fill(c, set, victim);
+
+    return replaced;
 }
 
-static MSHR *allocate_mshr(uint32_t address, uint8_t is_icache) {
-    for (size_t i = 0; i < NUM_MSHR; i++) {
-        if (!mshrs[i].valid) {
-            mshrs[i].address = address & ~(BLOCK_SIZE - 1);
-            mshrs[i].valid = 1;
-            mshrs[i].done = 0;
-            mshrs[i].fill_ready_cycle = 0;
-            mshrs[i].is_icache = is_icache;
-            return &mshrs[i];
+void init_victim_cache(VictimCache *vc, uint32_t num_entries) {
+    assert(num_entries == 0 || (num_entries >= VICTIM_CACHE_MIN_ENTRIES &&
+                                num_entries <= VICTIM_CACHE_MAX_ENTRIES));
+    vc->num_entries = num_entries;
+    vc->valid = 0;
+    vc->tick = 0;
+    vc->hits = 0;
+    vc->misses = 0;
+    vc->evictions = 0;
+}
+
+// Remove the block from the victim cache, returns 1 if it was present
+static int victim_cache_take(VictimCache *vc, uint32_t block_addr) {
+    for (uint32_t e = 0; e < vc->num_entries; e++) {
+        if (((vc->valid >> e) & 1) && vc->block_addr[e] == block_addr) {
+            vc->valid &= ~(1u << e);
+            return 1;
         }
     }
-    return NULL;
+    return 0;
 }
 
-CacheAccessResult l1_cache_access(Cache *c, uint32_t address, uint8_t is_icache) {
-    assert((address % 4 == 0) && "Address should be multiple of 4 bytes");
-
-    // calculate the L1 set index and the tag
-    uint32_t tag = (address >> (c->block_bits + c->set_bits));
-    uint32_t set = ((address >> c->block_bits) & ((1 << c->set_bits) - 1));
+// Insert a block evicted from the L1, replacing the LRU entry if full.
+// Returns 1 and the address of the dropped block if an entry was replaced.
+static int victim_cache_insert(VictimCache *vc, uint32_t block_addr, uint32_t *dropped) {
+    int replaced = 0;
+    uint32_t slot = 0;
+    uint64_t all_entries = (1ull << vc->num_entries) - 1;
+    uint32_t free_slots = ~vc->valid & (uint32_t)all_entries;
+
+    if (free_slots) {
+        slot = __builtin_ctz(free_slots);
+    } else {
+        for (uint32_t e = 1; e < vc->num_entries; e++) {
+            if (vc->last_use[e] < vc->last_use[slot]) {
+                slot = e;
+            }
+        }
+        vc->evictions++;
+        *dropped = vc->block_addr[slot];
+        replaced = 1;
+    }
 
-    // check L1 set for any hits in set
-    for (size_t b = 0; b < c->num_ways; b++) {
-        if (c->sets[set].blocks[b].tag == tag && c->sets[set].blocks[b].valid) {
-            // HIT since tag matches and block is valid
-            // -> update LRU positions of set's blocks
-            printf("Hit L1 cache\r\n");
+    vc->block_addr[slot] = block_addr;
+    vc->last_use[slot] = vc->tick++;
+    vc->valid |= 1u << slot;
+    return replaced;
+}
 
-            update_lru(c, set, b);
-            return CACHE_HIT;
+// 1 if misses in upper are eventually looked up in lower
+static int cache_reaches(Cache *upper, Cache *lower) {
+    for (Cache *c = upper->next; c; c = c->next) {
+        if (c == lower) {
+            return 1;
         }
     }
+    return 0;
+}
 
-    printf("MISSED L1 cache\r\n");
+// Drop a block evicted from an inclusive level from every cache above it
+static void back_invalidate(Cache *lower, uint32_t address) {
+    for (uint32_t i = 0; i < num_caches; i++) {
+        Cache *upper = &caches[i];
+        if (!cache_reaches(upper, lower)) {
+            continue;
+        }
+        back_invalidations += invalidate_block(upper, address);
+        if (upper->victim && upper->victim->num_entries) {
+            back_invalidations += victim_cache_take(upper->victim, address);
+        }
+    }
+}
 
-    // MISS -> check if request already pending
-    MSHR *existing_mshr = find_mshr_for_address(address);
-    if (existing_mshr) {
-        // Already have a pending request for this block
-        return CACHE_MISS_WAIT;
+void cache_insert_block(Cache *c, uint32_t address) {
+    if (lookup_block(c, address) >= 0) {
+        return;
     }
 
-    // MISS -> probe L2 cache in same cycle
-    return l2_cache_access(address, is_icache);
-}
+    uint32_t evicted;
+    if (!fill_block(c, address, &evicted)) {
+        return;
+    }
 
-int check_l1_fill_ready(Cache *c, uint32_t address) {
-    MSHR *mshr = find_mshr_for_address(address);
-    if (mshr && mshr->done) {
-        return 1;
+    if (inclusion == INCLUSION_INCLUSIVE) {
+        back_invalidate(c, evicted);
+    } else if (inclusion == INCLUSION_EXCLUSIVE && c->next) {
+        cache_insert_block(c->next, evicted);
     }
-    return 0;
 }
 
-void complete_l1_fill(Cache *c, uint32_t address) {
-    uint32_t tag = (address >> (c->block_bits + c->set_bits));
+// Write back the block a fill of address replaced in c if it was dirty. The
+// way keeps the coherence state of the replaced block until the fill's own is
+// set.
+static void write_back_replaced(Cache *c, uint32_t address, uint32_t evicted) {
     uint32_t set = ((address >> c->block_bits) & ((1 << c->set_bits) - 1));
+    uint8_t state = c->state[set * c->way_stride + lookup_block(c, address)];
+    if (state != BLOCK_MODIFIED && state != BLOCK_OWNED) {
+        return;
+    }
+    // the caller freed the MSHR of the miss, there is one for the writeback
+    int queued = cache_write_back(c, evicted);
+    assert(queued == 0);
+}
 
-    // Find victim block using LRU
-    size_t victim = 0;
-    int found = 0;
+// Fill an L1 block. The block it replaces moves into the victim cache if
+// there is one, and a block leaving the L1 moves one level down if the
+// hierarchy is exclusive.
+static void fill_l1_block(Cache *c, uint32_t address) {
+    // an upgrade completes on a block still in the L1
+    if (lookup_block(c, address) >= 0) {
+        return;
+    }
 
-    // 1. Look for invalid blocks first
-    for (size_t b = 0; b < c->num_ways; b++) {
-        if (!c->sets[set].blocks[b].valid) {
-            victim = b;
-            found = 1;
-            break;
+    // inclusive lower levels must also hold the block, it may have been
+    // evicted from them while the fill was in flight
+    if (inclusion == INCLUSION_INCLUSIVE) {
+        for (Cache *lower = c->next; lower; lower = lower->next) {
+            cache_insert_block(lower, address);
         }
     }
 
-    // 2. If all blocks valid, use LRU
-    if (!found) {
-        for (size_t b = 0; b < c->num_ways; b++) {
-            // find the least recently used block, set as victim
-            if (c->sets[set].blocks[b].recency == (c->num_ways - 1)) {
-                victim = b;
-                break;
-            }
+    uint32_t evicted;
+    if (!fill_block(c, address, &evicted)) {
+        return;
+    }
+    write_back_replaced(c, address, evicted);
+
+    if (c->victim && c->victim->num_entries) {
+        uint32_t dropped;
+        if (!victim_cache_insert(c->victim, evicted, &dropped)) {
+            return;
         }
+        evicted = dropped;
     }
 
-    // Insert the block at victims place
-    c->sets[set].blocks[victim].tag = tag;
-    c->sets[set].blocks[victim].valid = 1;
-    update_lru(c, set, victim);
+    if (inclusion == INCLUSION_EXCLUSIVE && c->next) {
+        cache_insert_block(c->next, evicted);
+    }
+}
 
-    // Free the MSHR (done by caller or memory controller)
+void print_cache_stats(Cache *c) {
+    uint32_t accesses = c->hits + c->misses;
+    printf("%s: %u accesses, %u hits, %u misses (%0.2f%% miss rate)\n", c->label, accesses,
+           c->hits, c->misses, accesses ? 100.0 * c->misses / accesses : 0.0);
+
+    if (c->victim && c->victim->num_entries) {
+        VictimCache *vc = c->victim;
+        printf("%s victim cache (%u entries): %u hits, %u misses, %u evictions\n", c->label,
+               vc->num_entries, vc->hits, vc->misses, vc->evictions);
+        if (c->next) {
+            printf("%s victim cache: %u %s probes avoided (%u cycles of %s latency)\n", c->label,
+                   vc->hits, c->next->name, vc->hits * c->next->latency, c->next->name);
+        }
+    }
 }
 
-CacheAccessResult l2_cache_access(uint32_t address, uint8_t is_icache) {
-    printf("ACCESS L2 cache\r\n");
+// All caches of the hierarchy share the block size of the L1s
+static uint32_t block_of(uint32_t address) { return address & ~(caches[0].block_size - 1); }
 
-    // L2 cache can only be probed if there are free MSHRs
-    MSHR *mshr = allocate_mshr(address, is_icache);
+// Probe the levels below the L1 c, in the same cycle as the L1 miss
+static CacheAccessResult lower_level_access(Cache *c, uint32_t address, uint8_t is_icache) {
+    // lower levels can only be probed if there are free MSHRs
+    MSHR *mshr = allocate_mshr(block_of(address), c->core, is_icache);
     if (mshr == NULL) {
         return CACHE_NO_MSHR;
     }
+    mshr->lower = c->next;
 
-    // calculate the L2 set index and the tag
-    uint32_t tag = (address >> (l2cache.block_bits + l2cache.set_bits));
-    uint32_t set = ((address >> l2cache.block_bits) & ((1 << l2cache.set_bits) - 1));
+    // levels are looked up one after the other, a hit is sent to the L1
+    // after the latencies of all levels probed so far
+    uint32_t latency = 0;
+    for (Cache *lvl = c->next; lvl; lvl = lvl->next) {
+        printf("ACCESS %s cache\r\n", lvl->name);
+        latency += lvl->latency;
 
-    // check L2 set for any hits in set
-    for (size_t b = 0; b < l2cache.num_ways; b++) {
-        if (l2cache.sets[set].blocks[b].tag == tag && l2cache.sets[set].blocks[b].valid) {
-            // L2 HIT - will send fill notification after 15 cycles
-            update_lru(&l2cache, set, b);
+        uint32_t tag = (address >> (lvl->block_bits + lvl->set_bits));
+        uint32_t set = ((address >> lvl->block_bits) & ((1 << lvl->set_bits) - 1));
 
-            printf("L2 HIT\r\n");
+        int way = cache_find_way(lvl, set, tag);
+        if (way >= 0) {
+            lvl->policy->on_hit(lvl, set, way);
+
+            // an exclusive level hands the block over to the L1
+            if (inclusion == INCLUSION_EXCLUSIVE) {
+                lvl->valid[set] &= ~(1u << way);
+            }
+
+            printf("%s HIT\r\n", lvl->name);
+            lvl->hits++;
+            mshr->source = lvl;
 
             // Mark when fill will be ready (current cycle is in shell.c
             // stat_cycles)
             extern uint32_t stat_cycles;
-            mshr->fill_ready_cycle = stat_cycles + L2_HIT_LATENCY;
+            schedule_mshr_fill(mshr, stat_cycles + latency);
 
             return CACHE_MISS_WAIT; // Not truly a miss, but L1 still waits for fill
         }
-    }
 
-    printf("L2 MISS\r\n");
+        printf("%s MISS\r\n", lvl->name);
+        lvl->misses++;
+    }
 
-    // L2 MISS - need to go to memory
+    // MISS in every level - need to go to memory
     // Add request to memory controller queue (will be done in memory_controller_cycle) The memory
-    // controller will set mshr->done when data is ready
+    // controller will set mshr->done when data is ready. The lookups after the first lower level
+    // delay the request's arrival at the memory controller.
+    add_mem_miss(mshr);
+    mshr->mem_delay = c->next ? latency - c->next->latency : 0;
     return CACHE_MISS_WAIT;
 }
 
-void insert_l2_block(uint32_t address) {
-    uint32_t tag = (address >> (l2cache.block_bits + l2cache.set_bits));
-    uint32_t set = ((address >> l2cache.block_bits) & ((1 << l2cache.set_bits) - 1));
+CacheAccessResult cache_lookup_l1(Cache *c, uint32_t address) {
+    assert((address % 4 == 0) && "Address should be multiple of 4 bytes");
 
-    // Find victim using LRU
-    size_t victim = 0;
-    int found = 0;
+    // calculate the L1 set index and the tag
+    uint32_t tag = (address >> (c->block_bits + c->set_bits));
+    uint32_t set = ((address >> c->block_bits) & ((1 << c->set_bits) - 1));
 
-    // Look for invalid blocks first
-    for (size_t b = 0; b < l2cache.num_ways; b++) {
-        if (!l2cache.sets[set].blocks[b].valid) {
-            victim = b;
-            found = 1;
-            break;
+    // check L1 set for any hits in set
+    int way = cache_find_way(c, set, tag);
+    if (way >= 0) {
+        // HIT since tag matches and block is valid
+        // -> update replacement state of set's blocks
+        printf("Hit L1 cache\r\n");
+
+        c->policy->on_hit(c, set, way);
+
+        // the stalled stage re-accesses a block after its fill, that access
+        // was already counted as a miss
+        if (!(c->replay_pending && c->replay_block == (address & ~(c->block_size - 1)))) {
+            c->hits++;
         }
+        c->replay_pending = 0;
+        return CACHE_HIT;
     }
 
-    // If all blocks valid, use LRU
-    if (!found) {
-        for (size_t b = 0; b < l2cache.num_ways; b++) {
-            // evict least recently used block
-            if (l2cache.sets[set].blocks[b].recency == (l2cache.num_ways - 1)) {
-                victim = b;
-                break;
-            }
+    printf("MISSED L1 cache\r\n");
+    c->misses++;
+    c->replay_pending = 0;
+
+    // MISS -> the victim cache is probed in parallel with the L1, on a hit the
+    // block is swapped back into the L1 without probing the lower levels
+    if (c->victim && c->victim->num_entries) {
+        if (victim_cache_take(c->victim, address & ~(c->block_size - 1))) {
+            c->victim->hits++;
+            fill_l1_block(c, address);
+            return CACHE_HIT;
+        }
+        c->victim->misses++;
+    }
+    return CACHE_MISS_WAIT;
+}
+
+int cache_write_back(Cache *c, uint32_t address) {
+    MSHR *mshr = allocate_mshr(block_of(address), c->core, 0);
+    if (mshr == NULL) {
+        return -1;
+    }
+    mshr->writeback = 1;
+    mshr->lower = c->next;
+    c->writebacks++;
+
+    if (c->next) {
+        extern uint32_t stat_cycles;
+        schedule_mshr_fill(mshr, stat_cycles + c->next->latency);
+    } else {
+        add_mem_miss(mshr);
+    }
+    return 0;
+}
+
+CacheAccessResult cache_access_below(Cache *c, uint32_t address, uint8_t is_icache) {
+    // a block being written back is requested again once it is written
+    if (find_writeback(block_of(address))) {
+        return CACHE_NO_MSHR;
+    }
+
+    // check if request already pending
+    MSHR *existing_mshr = find_mshr(block_of(address), c->core);
+    if (existing_mshr) {
+        // Already have a pending request for this block
+        return CACHE_MISS_WAIT;
+    }
+
+    // probe lower levels in same cycle
+    return lower_level_access(c, address, is_icache);
+}
+
+CacheAccessResult cache_access_peer(Cache *c, uint32_t address) {
+    if (find_writeback(block_of(address))) {
+        return CACHE_NO_MSHR;
+    }
+    if (find_mshr(block_of(address), c->core)) {
+        return CACHE_MISS_WAIT;
+    }
+    MSHR *mshr = allocate_mshr(block_of(address), c->core, 0);
+    if (mshr == NULL) {
+        return CACHE_NO_MSHR;
+    }
+
+    // the levels below neither supply nor receive the block
+    mshr->lower = mshr->source = c->next;
+    extern uint32_t stat_cycles;
+    schedule_mshr_fill(mshr, stat_cycles + (c->next ? c->next->latency : 1));
+    return CACHE_MISS_WAIT;
+}
+
+CacheAccessResult cache_access(Cache *c, uint32_t address, uint8_t is_icache) {
+    if (cache_lookup_l1(c, address) == CACHE_HIT) {
+        return CACHE_HIT;
+    }
+
+    CacheAccessResult result = cache_access_below(c, address, is_icache);
+    if (result == CACHE_NO_MSHR) {
+        // the access is retried, it counts once when it gets an MSHR
+        c->misses--;
+        if (c->victim && c->victim->num_entries) {
+            c->victim->misses--;
+        }
+    }
+    return result;
+}
+
+int check_l1_fill_ready(Cache *c, uint32_t address) {
+    MSHR *mshr = find_mshr(block_of(address), c->core);
+    if (mshr && mshr->done) {
+        return 1;
+    }
+    return 0;
+}
+
+void free_l1_miss(Cache *c, uint32_t address) {
+    MSHR *mshr = find_mshr(block_of(address), c->core);
+    if (mshr) {
+        free_mshr(mshr);
+    }
+}
+
+void complete_l1_fill(Cache *c, uint32_t address) {
+    fill_l1_block(c, address);
+    c->replay_pending = 1;
+    c->replay_block = address & ~(c->block_size - 1);
+
+    // Free the MSHR (done by caller or memory controller)
+}
+
+void fill_lower_levels(MSHR *mshr) {
+    // an exclusive hierarchy only moves blocks down when they are evicted
+    if (inclusion == INCLUSION_EXCLUSIVE) {
+        return;
+    }
+
+    for (Cache *lvl = mshr->lower; lvl != mshr->source; lvl = lvl->next) {
+        cache_insert_block(lvl, mshr->address);
+    }
+}
+
+InclusionPolicy get_inclusion_policy() { return inclusion; }
+
+int set_inclusion_policy(const char *name) {
+    if (strcmp(name, "nine") == 0) {
+        inclusion = INCLUSION_NINE;
+    } else if (strcmp(name, "inclusive") == 0) {
+        inclusion = INCLUSION_INCLUSIVE;
+    } else if (strcmp(name, "exclusive") == 0) {
+        inclusion = INCLUSION_EXCLUSIVE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// 1 if the block is held by caches[first] or any cache after it
+static int held_from(uint32_t first, uint32_t address) {
+    for (uint32_t i = first; i < num_caches; i++) {
+        if (lookup_block(&caches[i], address) >= 0) {
+            return 1;
         }
     }
+    return 0;
+}
 
-    // replace the victim
-    l2cache.sets[set].blocks[victim].tag = tag;
-    l2cache.sets[set].blocks[victim].valid = 1;
-    l2cache.sets[set].blocks[victim].recency = 0;
+void print_hierarchy_stats() {
+    static const char *names[] = {"nine", "inclusive", "exclusive"};
+    printf("Inclusion: %s, %u back-invalidations\n", names[inclusion], back_invalidations);
+
+    // distinct blocks currently held anywhere in the hierarchy, a block is
+    // counted in the last cache holding it
+    uint32_t unique = 0, total = 0;
+    for (uint32_t i = 0; i < num_caches; i++) {
+        Cache *c = &caches[i];
+        for (uint32_t s = 0; s < c->num_sets; s++) {
+            for (uint32_t w = 0; w < c->num_ways; w++) {
+                if ((c->valid[s] >> w) & 1) {
+                    total++;
+                    unique += !held_from(i + 1, block_address(c, s, w));
+                }
+            }
+        }
 
-    // Increment recency of all other valid blocks
-    for (size_t b = 0; b < l2cache.num_ways; b++) {
-        if (b != victim && l2cache.sets[set].blocks[b].valid) {
-            l2cache.sets[set].blocks[b].recency++;
+        if (c->victim && c->victim->num_entries) {
+            for (uint32_t e = 0; e < c->victim->num_entries; e++) {
+                if ((c->victim->valid >> e) & 1) {
+                    total++;
+                    unique += !held_from(0, c->victim->block_addr[e]);
+                }
+            }
         }
     }
-}
\ No newline at end of file
+
+    uint32_t block_size = caches[0].block_size;
+    printf("Effective capacity: %u KB in distinct blocks of %u KB cached (%u of %u blocks)\n",
+           unique * block_size / 1024, total * block_size / 1024, unique, total);
+}
@@ -2,6 +2,7 @@
 #ifndef _CACHE_H_
 #define _CACHE_H_
 
+#include "mshr.h"
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -9,79 +10,177 @@
 
 #define ICACHE_SIZE (8 * 1024)
 #define ICACHE_WAYS 4
+#define ICACHE_POLICY "lru"
 
 #define DCACHE_SIZE (64 * 1024)
 #define DCACHE_WAYS 8
+#define DCACHE_POLICY "lru"
 
 #define L2CACHE_SIZE (256 * 1024)
 #define L2CACHE_WAYS 16
+#define L2CACHE_POLICY "lru"
 #define L2_HIT_LATENCY 15
 
-#define NUM_MSHR 16
+// inclusion of the levels below the L1s
+#define CACHE_INCLUSION INCLUSION_NINE
+
+// fully-associative victim cache behind the L1 D-cache, 0 disables it
+#define VICTIM_CACHE_ENTRIES 0
+#define VICTIM_CACHE_MIN_ENTRIES 4
+#define VICTIM_CACHE_MAX_ENTRIES 32
+
+// cores of a multiprogrammed run, each has its own copy of the caches that
+// are not shared
+#define MAX_CORES 8
 
 #define NUM_BANKS 8
 #define NUM_ROWS (64 * 1024)
 #define ROW_SIZE (8 * 1024)
 
+// Inclusion of each lower level with respect to the levels above it
+typedef enum {
+    INCLUSION_NINE,      // non-inclusive non-exclusive: lower levels filled on the miss path
+    INCLUSION_INCLUSIVE, // a level holds every block above it, evictions back-invalidate
+    INCLUSION_EXCLUSIVE  // victims move one level down, hits move out of the level
+} InclusionPolicy;
+
 typedef enum {
     CACHE_HIT = 0,       // Hit, no stall needed
     CACHE_MISS_WAIT = 1, // Miss, request issued, waiting for fill
-    CACHE_NO_MSHR = 2    // Cannot probe L2 (no free MSHRs), should never occur
-                         // according to task desc
+    CACHE_NO_MSHR = 2    // Cannot probe L2 (no free MSHRs), the stage retries. Only
+                         // happens when several cores share the MSHRs.
 } CacheAccessResult;
 
-typedef struct Block {
-    uint32_t tag;
-    uint8_t valid;    // valid bit (0 = invalid, 1 = valid)
-    uint32_t recency; // recency = 0 -> most recently used
-} Block;
-
-typedef struct Set {
-    Block *blocks; // array of blocks
-} Set;
-
-// model the cache as a tree, with blocks as leafs
+// ways of a set are padded to a multiple of this, so a set's tags can be
+// compared with full width vector loads
+#define CACHE_WAY_ALIGN 8
+#define CACHE_MAX_WAYS 32 // valid bits of a set must fit in one word
+#define CACHE_NAME_LEN 16
+#define CACHE_LABEL_LEN 24
+
+struct ReplPolicy;
+
+// Small fully-associative cache holding blocks recently evicted from an L1.
+// It is probed in parallel with the L1, a hit swaps the block back into the L1.
+typedef struct VictimCache {
+    uint32_t num_entries;                          // 0 = disabled
+    uint32_t block_addr[VICTIM_CACHE_MAX_ENTRIES]; // block aligned address per entry
+    uint32_t last_use[VICTIM_CACHE_MAX_ENTRIES];   // for LRU replacement of entries
+    uint32_t valid;                                // bitmask of valid entries
+    uint32_t tick;                                 // use counter
+
+    // statistics
+    uint32_t hits;      // L1 misses served by the victim cache (L2 probes avoided)
+    uint32_t misses;    // L1 misses that also missed in the victim cache
+    uint32_t evictions; // blocks dropped from the victim cache
+} VictimCache;
+
+// Tag store in structure-of-arrays layout. The tags of a set are packed next to
+// each other (set s, way w at s * way_stride + w), the valid bits and the
+// replacement metadata of a set are packed into one word each. All arrays live
+// in one contiguous allocation.
 typedef struct Cache {
+    char name[CACHE_NAME_LEN];   // config section, the same for all copies
+    char label[CACHE_LABEL_LEN]; // name in stats, with the core of private copies
+    struct Cache *next;          // level probed on a miss, NULL = memory
+    uint32_t latency;            // cycles until a hit in this level fills the L1
+    uint8_t shared;              // shared by all cores
+    uint8_t core;                // core owning a private copy, 0 if shared
+
     uint32_t num_sets;
     uint32_t num_ways;
     uint32_t block_size;
-    Set *sets; // array of sets
+    uint32_t way_stride; // num_ways rounded up to CACHE_WAY_ALIGN
+
+    uint32_t *tags;  // per way tag
+    uint32_t *valid; // per set bitmask of valid ways
 
     // for indexing:
     uint8_t set_bits;
     uint8_t block_bits;
-} Cache;
 
-// L2 miss status holding registers
-typedef struct MSHR {
-    uint32_t address;
-    uint8_t valid;             // 1 = entry in use, 0 = free
-    uint8_t done;              // 1 = memory fill ready, 0 = still waiting
-    uint32_t fill_ready_cycle; // cycle when fill will be ready
-    uint8_t is_icache;         // 1 if for icache, 0 if for dcache
-} MSHR;
+    // replacement policy and its per-cache state
+    const struct ReplPolicy *policy;
+    uint64_t *set_meta; // per set packed metadata (recency nibbles, RRPVs, PLRU bits)
+    uint32_t psel;      // DRRIP set dueling policy selector
+    uint32_t tick;      // fill counter (BRRIP throttle)
+
+    VictimCache *victim; // receives evicted blocks, NULL if none
+
+    // coherence of a private D-cache when the cores share memory (coherence.h)
+    uint8_t *state;          // per way BlockState
+    uint32_t *remote_writes; // per way, words other cores wrote since the block was invalidated
+
+    // statistics
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t replay_block; // block just filled, its re-access is not counted again
+    uint8_t replay_pending;
+
+    // coherence statistics
+    uint32_t coherence_misses; // misses on blocks invalidated by another core's write
+    uint32_t false_sharing;    // of those, misses on a word no other core wrote
+    uint32_t upgrades;         // writes to shared blocks, invalidating the other copies
+    uint32_t transfers;        // misses served by another core's L1
+    uint32_t invalidations;    // blocks lost to other cores' writes
+    uint32_t writebacks;       // dirty blocks written back: evicted, or modified ones another
+                               // core read (MESI)
+} Cache;
 
 /**
  * @param uint16_t capacity in bytes
  * @param uint8_t block_size in bytes
+ * @param policy replacement policy used by this cache
  */
-void alloc_cache(Cache *c, uint32_t capacity, uint8_t num_ways, uint8_t block_size);
+void alloc_cache(Cache *c, uint32_t capacity, uint8_t num_ways, uint8_t block_size,
+                 const struct ReplPolicy *policy);
 
 /* Release memory dynamically allocated for a cache */
 void free_cache(Cache *c);
 
-/* Mark a block withing a set as least recently used */
-void update_lru(Cache *c, size_t set, size_t block);
+/* Switch the replacement policy of a cache, keeps the cached blocks */
+void set_cache_policy(Cache *c, const struct ReplPolicy *policy);
+
+/* Configure a victim cache with 0 (disabled) or 4 to 32 entries, drops its contents */
+void init_victim_cache(VictimCache *vc, uint32_t num_entries);
+
+/* Print hit/miss statistics of a cache and its victim cache */
+void print_cache_stats(Cache *c);
+
+/* Tags of a set, way_stride entries starting at a vector aligned address */
+static inline uint32_t *set_tags(Cache *c, uint32_t set) {
+    return &c->tags[(size_t)set * c->way_stride];
+}
 
 /**
- * L1 cache access (instruction or data).
+ * Look up a tag in a set.
+ * @return the way holding a valid block with this tag, or -1 on a miss
  */
-CacheAccessResult l1_cache_access(Cache *c, uint32_t address, uint8_t is_icache);
+int cache_find_way(Cache *c, uint32_t set, uint32_t tag);
 
 /**
- * L2 cache probe (called immediately on L1 miss in same cycle).
+ * L1 cache access (instruction or data). On a miss the lower levels are
+ * probed in the same cycle, the fill is ready after the latencies of the
+ * levels down to the one that hits, or after the memory access.
  */
-CacheAccessResult l2_cache_access(uint32_t address, uint8_t is_icache);
+CacheAccessResult cache_access(Cache *c, uint32_t address, uint8_t is_icache);
+
+/**
+ * The two halves of cache_access. cache_lookup_l1 probes the L1 and its
+ * victim cache only: CACHE_HIT, or CACHE_MISS_WAIT if the levels below have
+ * to be probed with cache_access_below, which merges the miss into a pending
+ * one or allocates an MSHR for it.
+ */
+CacheAccessResult cache_lookup_l1(Cache *c, uint32_t address);
+CacheAccessResult cache_access_below(Cache *c, uint32_t address, uint8_t is_icache);
+
+/**
+ * Get a block, or the right to write it, from another core's L1 D-cache: an
+ * upgrade of a shared block or a cache-to-cache transfer. The request goes
+ * through the next level without probing it, the fill is ready after its
+ * latency. Returns CACHE_MISS_WAIT, or CACHE_NO_MSHR.
+ */
+CacheAccessResult cache_access_peer(Cache *c, uint32_t address);
 
 /**
  * Check if a pending L1 cache miss has been filled.
@@ -92,15 +191,41 @@ int check_l1_fill_ready(Cache *c, uint32_t address);
 
 /**
  * Complete the L1 cache fill (insert block into cache).
- * Call this when fill is ready and pipeline is still stalled on it.
+ * Call this when fill is ready and pipeline is still stalled on it. An upgraded
+ * block is still in the cache, if no other core's write invalidated it. A
+ * dirty block it evicts is written back, on the MSHR of the miss if that was
+ * freed before.
  */
 void complete_l1_fill(Cache *c, uint32_t address);
 
-// Insert block into L2 cache when fill completes from memory
-void insert_l2_block(uint32_t address);
+/**
+ * Write the dirty block of address back from the L1 D-cache c. The writeback
+ * holds an MSHR until the next level has taken the block, after its latency,
+ * or until the DRAM write is done if c is the last level; misses and upgrades
+ * of any core on the block wait for it. Returns -1 if no MSHR is free.
+ */
+int cache_write_back(Cache *c, uint32_t address);
+
+/* Free the MSHR of a completed or cancelled L1 miss */
+void free_l1_miss(Cache *c, uint32_t address);
+
+// Install the block of a completed MSHR in the lower levels that missed on it
+void fill_lower_levels(MSHR *mshr);
+
+// Insert a block into one level, applying the inclusion policy to the block
+// it replaces
+void cache_insert_block(Cache *c, uint32_t address);
+
+InclusionPolicy get_inclusion_policy();
+
+/* Select the inclusion policy by name (nine, inclusive, exclusive),
+ * returns 0 on success and -1 for an unknown policy */
+int set_inclusion_policy(const char *name);
+
+/* Print inclusion policy, back-invalidations and effective capacity */
+void print_hierarchy_stats();
 
-// Decl. of global instances used by mem_controller.c and cache.c
-extern Cache l2cache;
-extern MSHR mshrs[NUM_MSHR];
+// Decl. of global instances used by pipe.c and cache.c
+extern Cache *icache[MAX_CORES], *dcache[MAX_CORES]; // the L1s of each core
 
 #endif
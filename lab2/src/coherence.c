@@ -0,0 +1,225 @@
+#include "coherence.h"
+#include "pipe.h"
+#include <stdio.h>
+#include <string.h>
+
+static int enabled;
+static CoherenceProtocol protocol = COHERENCE_MESI;
+
+static const char *const protocol_names[NUM_COHERENCE_PROTOCOLS] = {"mesi", "moesi"};
+
+void enable_coherence() { enabled = 1; }
+
+int coherence_enabled() { return enabled; }
+
+int set_coherence_protocol(const char *name) {
+    for (int i = 0; i < NUM_COHERENCE_PROTOCOLS; i++) {
+        if (strcmp(protocol_names[i], name) == 0) {
+            protocol = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static uint32_t set_of(Cache *c, uint32_t address) {
+    return (address >> c->block_bits) & ((1 << c->set_bits) - 1);
+}
+
+static uint32_t tag_of(Cache *c, uint32_t address) {
+    return address >> (c->block_bits + c->set_bits);
+}
+
+// Bit of the word of address in a block's remote_writes
+static uint32_t word_bit(Cache *c, uint32_t address) {
+    return 1u << (((address & (c->block_size - 1)) >> 2) & 31);
+}
+
+// Index of the valid way holding address in the per way arrays, -1 if none
+static int find_block(Cache *c, uint32_t address) {
+    uint32_t set = set_of(c, address);
+    int way = cache_find_way(c, set, tag_of(c, address));
+    return way < 0 ? -1 : (int)(set * c->way_stride + way);
+}
+
+static void drop_block(Cache *c, int i) {
+    c->valid[i / c->way_stride] &= ~(1u << (i % c->way_stride));
+}
+
+// Index of the invalidated way still holding the tag of address, -1 if none
+static int find_invalidated(Cache *c, uint32_t address) {
+    uint32_t set = set_of(c, address), tag = tag_of(c, address);
+    const uint32_t *tags = set_tags(c, set);
+    for (uint32_t w = 0; w < c->num_ways; w++) {
+        uint32_t i = set * c->way_stride + w;
+        if (!((c->valid[set] >> w) & 1) && c->state[i] == BLOCK_INVALIDATED && tags[w] == tag) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 1 if another core's D-cache holds the block dirty or exclusive and
+// supplies it on a miss
+static int supplied_by_peer(Cache *c, uint32_t address) {
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Cache *d = dcache[core];
+        if (d == c) {
+            continue;
+        }
+        int i = find_block(d, address);
+        if (i >= 0 && d->state[i] != BLOCK_SHARED) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static CacheAccessResult coherent_miss(Cache *c, uint32_t address) {
+    cache_lookup_l1(c, address);
+
+    int peer = supplied_by_peer(c, address);
+    CacheAccessResult result =
+        peer ? cache_access_peer(c, address) : cache_access_below(c, address, 0);
+    if (result == CACHE_NO_MSHR) {
+        // the access is retried, it counts once when it gets an MSHR
+        c->misses--;
+        return result;
+    }
+    c->transfers += peer;
+
+    // a miss on a block lost to another core's write is a coherence miss,
+    // false sharing if the word it accesses wasn't written since
+    int lost = find_invalidated(c, address);
+    if (lost >= 0) {
+        c->coherence_misses++;
+        c->false_sharing += !(c->remote_writes[lost] & word_bit(c, address));
+        c->state[lost] = BLOCK_INVALID;
+    }
+    return result;
+}
+
+CacheAccessResult coherent_access(Cache *c, uint32_t address, int is_write) {
+    int i = find_block(c, address);
+    if (i < 0) {
+        return coherent_miss(c, address);
+    }
+
+    cache_lookup_l1(c, address);
+    if (!is_write || c->state[i] == BLOCK_MODIFIED) {
+        return CACHE_HIT;
+    }
+    if (c->state[i] == BLOCK_EXCLUSIVE) {
+        c->state[i] = BLOCK_MODIFIED;
+        return CACHE_HIT;
+    }
+
+    // shared or owned: the other copies are invalidated before the write
+    CacheAccessResult result = cache_access_peer(c, address);
+    if (result == CACHE_NO_MSHR) {
+        c->hits--;
+        return result;
+    }
+    c->upgrades++;
+    return result;
+}
+
+int coherent_fill_ready(Cache *c, uint32_t address, int is_write) {
+    if (is_write || protocol != COHERENCE_MESI) {
+        return 1;
+    }
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Cache *d = dcache[core];
+        int i = d == c ? -1 : find_block(d, address);
+        if (i >= 0 && d->state[i] == BLOCK_MODIFIED) {
+            // the fill's own MSHR goes to the block it may evict
+            return mshrs_in_use() < NUM_MSHR;
+        }
+    }
+    return 1;
+}
+
+void coherent_fill(Cache *c, uint32_t address, int is_write) {
+    int shared = 0;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Cache *d = dcache[core];
+        int i = d == c ? -1 : find_block(d, address);
+        if (i < 0) {
+            continue;
+        }
+
+        if (is_write) {
+            drop_block(d, i);
+            d->state[i] = BLOCK_INVALIDATED;
+            d->remote_writes[i] = word_bit(d, address);
+            d->invalidations++;
+
+            // private levels below the L1 lose their copies as well
+            for (Cache *lvl = d->next; lvl && !lvl->shared; lvl = lvl->next) {
+                int j = find_block(lvl, address);
+                if (j >= 0) {
+                    drop_block(lvl, j);
+                }
+            }
+            continue;
+        }
+
+        // a read leaves every copy shared, the dirty one owned with MOESI
+        shared = 1;
+        if (d->state[i] == BLOCK_EXCLUSIVE) {
+            d->state[i] = BLOCK_SHARED;
+        } else if (d->state[i] == BLOCK_MODIFIED && protocol == COHERENCE_MOESI) {
+            d->state[i] = BLOCK_OWNED;
+        } else if (d->state[i] == BLOCK_MODIFIED) {
+            d->state[i] = BLOCK_SHARED;
+            cache_write_back(d, address);
+        }
+    }
+
+    int i = find_block(c, address);
+    if (i >= 0) {
+        c->state[i] = is_write ? BLOCK_MODIFIED : shared ? BLOCK_SHARED : BLOCK_EXCLUSIVE;
+    }
+}
+
+void coherent_store(uint32_t core, uint32_t address) {
+    for (uint32_t other = 0; other < num_cores; other++) {
+        Cache *d = dcache[other];
+        if (d == dcache[core]) {
+            continue;
+        }
+        int i = find_invalidated(d, address);
+        if (i >= 0) {
+            d->remote_writes[i] |= word_bit(d, address);
+        }
+    }
+}
+
+void print_coherence_stats() {
+    uint32_t invalidations = 0, upgrades = 0, transfers = 0, writebacks = 0;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Cache *d = dcache[core];
+        if (core > 0 && d == dcache[0]) {
+            break; // one D-cache shared by all cores
+        }
+        invalidations += d->invalidations;
+        upgrades += d->upgrades;
+        transfers += d->transfers;
+        writebacks += d->writebacks;
+    }
+    printf("Coherence: %s, %u invalidations, %u upgrades, %u cache-to-cache transfers, %u "
+           "writebacks\n",
+           protocol == COHERENCE_MOESI ? "MOESI" : "MESI", invalidations, upgrades, transfers,
+           writebacks);
+
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Cache *d = dcache[core];
+        if (core > 0 && d == dcache[0]) {
+            break;
+        }
+        printf("%s coherence: %u coherence misses (%u false sharing), %u upgrades, %u "
+               "transfers in, %u invalidations, %u writebacks\n",
+               d->label, d->coherence_misses, d->false_sharing, d->upgrades, d->transfers,
+               d->invalidations, d->writebacks);
+    }
+}
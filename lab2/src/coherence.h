@@ -0,0 +1,66 @@
+#ifndef _COHERENCE_H_
+#define _COHERENCE_H_
+
+#include "cache.h"
+#include <stdint.h>
+
+// Snooping protocol between the private L1 D-caches of cores sharing memory
+typedef enum {
+    COHERENCE_MESI,  // a modified block read by another core is written back
+    COHERENCE_MOESI, // ... or stays dirty in the owner, which supplies it
+    NUM_COHERENCE_PROTOCOLS
+} CoherenceProtocol;
+
+// State of a way of a private D-cache, meaningful for valid ways and for
+// BLOCK_INVALIDATED, which keeps the tag of a block lost to another core's
+// write to tell coherence misses from other misses
+typedef enum {
+    BLOCK_INVALID,
+    BLOCK_INVALIDATED,
+    BLOCK_SHARED,    // clean, other L1s may hold it
+    BLOCK_EXCLUSIVE, // clean, no other L1 holds it
+    BLOCK_OWNED,     // dirty, other L1s may hold it shared (MOESI only)
+    BLOCK_MODIFIED   // dirty, no other L1 holds it
+} BlockState;
+
+/**
+ * The caches only model timing, the data always comes from the functional
+ * memory. A miss or upgrade snoops the other D-caches when its fill is
+ * installed, so requests in flight at the same time are ordered by their
+ * fills. Misses on blocks another L1 holds modified, owned or exclusive are
+ * served by that L1 at the latency of the next level, without probing it.
+ * Dirty blocks (modified, owned) are written back when they are evicted and,
+ * with MESI, when another core reads a modified one (cache_write_back).
+ */
+
+/* Keep the D-caches of the cores coherent, called when the cores share
+ * memory */
+void enable_coherence();
+
+int coherence_enabled();
+
+/* Select the protocol by name (mesi, moesi), returns -1 for an unknown one */
+int set_coherence_protocol(const char *name);
+
+/* Access of a core's D-cache with coherence. A write to a block held shared
+ * or owned waits for an upgrade, like a miss. */
+CacheAccessResult coherent_access(Cache *c, uint32_t address, int is_write);
+
+/* 1 if a free MSHR is left for the writeback of the modified copy another
+ * core holds, which the fill downgrades with MESI, besides the MSHR of the
+ * fill itself */
+int coherent_fill_ready(Cache *c, uint32_t address, int is_write);
+
+/* Install the state of a block the D-cache c was filled with or got the
+ * right to write, invalidating or downgrading the copies of the other cores;
+ * a modified copy downgraded with MESI is written back */
+void coherent_fill(Cache *c, uint32_t address, int is_write);
+
+/* Note a store of a core to a word, for telling false sharing misses of the
+ * other cores apart */
+void coherent_store(uint32_t core, uint32_t address);
+
+/* Print the protocol and the coherence traffic of each D-cache */
+void print_coherence_stats();
+
+#endif
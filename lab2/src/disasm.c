@@ -0,0 +1,205 @@
+#include "disasm.h"
+#include "mips.h"
+#include <stdio.h>
+
+static const char *const reg_names[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3", "t0", "t1", "t2",
+    "t3",   "t4", "t5", "t6", "t7", "s0", "s1", "s2", "s3", "s4", "s5",
+    "s6",   "s7", "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"};
+
+// Mnemonic of a SPECIAL (opcode 0) instruction by function, NULL if unknown
+static const char *special_name(uint32_t funct) {
+    switch (funct) {
+    case SUBOP_SLL:
+        return "sll";
+    case SUBOP_SRL:
+        return "srl";
+    case SUBOP_SRA:
+        return "sra";
+    case SUBOP_SLLV:
+        return "sllv";
+    case SUBOP_SRLV:
+        return "srlv";
+    case SUBOP_SRAV:
+        return "srav";
+    case SUBOP_JR:
+        return "jr";
+    case SUBOP_JALR:
+        return "jalr";
+    case SUBOP_SYSCALL:
+        return "syscall";
+    case SUBOP_MFHI:
+        return "mfhi";
+    case SUBOP_MTHI:
+        return "mthi";
+    case SUBOP_MFLO:
+        return "mflo";
+    case SUBOP_MTLO:
+        return "mtlo";
+    case SUBOP_MULT:
+        return "mult";
+    case SUBOP_MULTU:
+        return "multu";
+    case SUBOP_DIV:
+        return "div";
+    case SUBOP_DIVU:
+        return "divu";
+    case SUBOP_ADD:
+        return "add";
+    case SUBOP_ADDU:
+        return "addu";
+    case SUBOP_SUB:
+        return "sub";
+    case SUBOP_SUBU:
+        return "subu";
+    case SUBOP_AND:
+        return "and";
+    case SUBOP_OR:
+        return "or";
+    case SUBOP_XOR:
+        return "xor";
+    case SUBOP_NOR:
+        return "nor";
+    case SUBOP_SLT:
+        return "slt";
+    case SUBOP_SLTU:
+        return "sltu";
+    }
+    return NULL;
+}
+
+static void disassemble_special(uint32_t inst, char *buf, size_t size) {
+    uint32_t rs = (inst >> 21) & 0x1F, rt = (inst >> 16) & 0x1F, rd = (inst >> 11) & 0x1F;
+    uint32_t shamt = (inst >> 6) & 0x1F, funct = inst & 0x3F;
+    const char *name = special_name(funct);
+
+    if (inst == 0) {
+        snprintf(buf, size, "nop");
+    } else if (name == NULL) {
+        snprintf(buf, size, ".word 0x%08x", inst);
+    } else if (funct == SUBOP_SLL || funct == SUBOP_SRL || funct == SUBOP_SRA) {
+        snprintf(buf, size, "%s $%s, $%s, %u", name, reg_names[rd], reg_names[rt], shamt);
+    } else if (funct == SUBOP_SLLV || funct == SUBOP_SRLV || funct == SUBOP_SRAV) {
+        snprintf(buf, size, "%s $%s, $%s, $%s", name, reg_names[rd], reg_names[rt],
+                 reg_names[rs]);
+    } else if (funct == SUBOP_JR || funct == SUBOP_MTHI || funct == SUBOP_MTLO) {
+        snprintf(buf, size, "%s $%s", name, reg_names[rs]);
+    } else if (funct == SUBOP_JALR) {
+        snprintf(buf, size, "%s $%s, $%s", name, reg_names[rd], reg_names[rs]);
+    } else if (funct == SUBOP_SYSCALL) {
+        snprintf(buf, size, "%s", name);
+    } else if (funct == SUBOP_MFHI || funct == SUBOP_MFLO) {
+        snprintf(buf, size, "%s $%s", name, reg_names[rd]);
+    } else if (funct == SUBOP_MULT || funct == SUBOP_MULTU || funct == SUBOP_DIV ||
+               funct == SUBOP_DIVU) {
+        snprintf(buf, size, "%s $%s, $%s", name, reg_names[rs], reg_names[rt]);
+    } else {
+        snprintf(buf, size, "%s $%s, $%s, $%s", name, reg_names[rd], reg_names[rs],
+                 reg_names[rt]);
+    }
+}
+
+void disassemble(uint32_t inst, uint32_t pc, char *buf, size_t size) {
+    uint32_t opcode = inst >> 26;
+    uint32_t rs = (inst >> 21) & 0x1F, rt = (inst >> 16) & 0x1F;
+    uint32_t imm16 = inst & 0xFFFF;
+    int32_t se_imm16 = (int16_t)imm16;
+    uint32_t branch_dest = pc + 4 + (se_imm16 << 2);
+    const char *name = NULL;
+
+    switch (opcode) {
+    case OP_SPECIAL:
+        disassemble_special(inst, buf, size);
+        return;
+
+    case OP_BRSPEC:
+        name = rt == BROP_BLTZ     ? "bltz"
+               : rt == BROP_BGEZ   ? "bgez"
+               : rt == BROP_BLTZAL ? "bltzal"
+               : rt == BROP_BGEZAL ? "bgezal"
+                                   : NULL;
+        if (name) {
+            snprintf(buf, size, "%s $%s, 0x%08x", name, reg_names[rs], branch_dest);
+            return;
+        }
+        break;
+
+    case OP_J:
+    case OP_JAL:
+        snprintf(buf, size, "%s 0x%08x", opcode == OP_J ? "j" : "jal",
+                 (pc & 0xF0000000) | ((inst & 0x03FFFFFF) << 2));
+        return;
+
+    case OP_BEQ:
+    case OP_BNE:
+        snprintf(buf, size, "%s $%s, $%s, 0x%08x", opcode == OP_BEQ ? "beq" : "bne",
+                 reg_names[rs], reg_names[rt], branch_dest);
+        return;
+
+    case OP_BLEZ:
+    case OP_BGTZ:
+        snprintf(buf, size, "%s $%s, 0x%08x", opcode == OP_BLEZ ? "blez" : "bgtz",
+                 reg_names[rs], branch_dest);
+        return;
+
+    case OP_ADDI:
+    case OP_ADDIU:
+    case OP_SLTI:
+    case OP_SLTIU:
+        name = opcode == OP_ADDI    ? "addi"
+               : opcode == OP_ADDIU ? "addiu"
+               : opcode == OP_SLTI  ? "slti"
+                                    : "sltiu";
+        snprintf(buf, size, "%s $%s, $%s, %d", name, reg_names[rt], reg_names[rs], se_imm16);
+        return;
+
+    case OP_ANDI:
+    case OP_ORI:
+    case OP_XORI:
+        name = opcode == OP_ANDI ? "andi" : opcode == OP_ORI ? "ori" : "xori";
+        snprintf(buf, size, "%s $%s, $%s, 0x%x", name, reg_names[rt], reg_names[rs], imm16);
+        return;
+
+    case OP_LUI:
+        snprintf(buf, size, "lui $%s, 0x%x", reg_names[rt], imm16);
+        return;
+
+    case OP_LB:
+        name = "lb";
+        break;
+    case OP_LH:
+        name = "lh";
+        break;
+    case OP_LW:
+        name = "lw";
+        break;
+    case OP_LBU:
+        name = "lbu";
+        break;
+    case OP_LHU:
+        name = "lhu";
+        break;
+    case OP_SB:
+        name = "sb";
+        break;
+    case OP_SH:
+        name = "sh";
+        break;
+    case OP_SW:
+        name = "sw";
+        break;
+    case OP_LL:
+        name = "ll";
+        break;
+    case OP_SC:
+        name = "sc";
+        break;
+    }
+
+    // loads and stores
+    if (name && opcode != OP_BRSPEC) {
+        snprintf(buf, size, "%s $%s, %d($%s)", name, reg_names[rt], se_imm16, reg_names[rs]);
+    } else {
+        snprintf(buf, size, ".word 0x%08x", inst);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef _DISASM_H_
+#define _DISASM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// longest line disassemble() writes, with the terminating NUL
+#define DISASM_LEN 48
+
+/* Write the assembly of the instruction inst at pc into buf (size bytes),
+ * in the syntax of the inputs: "addiu $t2, $t2, 1", "lw $t2, 0($s1)", with
+ * branch and jump targets as addresses. Unknown encodings print as .word. */
+void disassemble(uint32_t inst, uint32_t pc, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,242 @@
+#include "dram_timing.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// The original model in core cycles: every command keeps the bank busy for
+// 100 cycles, a transfer takes 50, a command 4 cycles of the command bus.
+// Refresh (off unless selected) is that of an 8 Gb part at 4 GHz.
+static const DramTiming dram_lab = {
+    .name = "lab",
+    .tck_ps = CPU_CLOCK_PS,
+    .tCMD = 4,
+    .tRCD = 100,
+    .tRP = 100,
+    .tCL = 100,
+    .tREFI = 31200,
+    .tRFC = 1400,
+    .tRFCpb = 600,
+    .burst_length = 100,
+    .serialize_banks = 1,
+};
+
+// Speed bins below use approximate datasheet values (x8 devices, 2 KB pages,
+// 8 Gb refresh); DDR3 and DDR4 have no per-bank refresh
+
+// DDR3-1600 11-11-11
+static const DramTiming dram_ddr3 = {
+    .name = "ddr3",
+    .tck_ps = 1250,
+    .tCMD = 1,
+    .tRCD = 11,
+    .tRP = 11,
+    .tCL = 11,
+    .tRAS = 28,
+    .tRC = 39,
+    .tWR = 12,
+    .tWTR = 6,
+    .tRRD = 6,
+    .tRRD_S = 6,
+    .tFAW = 32,
+    .tCCD = 4,
+    .tCCD_S = 4,
+    .tRTP = 6,
+    .tREFI = 6240,
+    .tRFC = 208,
+    .burst_length = 8,
+};
+
+// DDR4-2400 17-17-17, same bank group value for tWTR
+static const DramTiming dram_ddr4 = {
+    .name = "ddr4",
+    .tck_ps = 833,
+    .tCMD = 1,
+    .tRCD = 17,
+    .tRP = 17,
+    .tCL = 17,
+    .tRAS = 39,
+    .tRC = 56,
+    .tWR = 18,
+    .tWTR = 9,
+    .tRRD = 6,
+    .tRRD_S = 4,
+    .tFAW = 26,
+    .tCCD = 6,
+    .tCCD_S = 4,
+    .tRTP = 9,
+    .tREFI = 9360,
+    .tRFC = 420,
+    .burst_length = 8,
+};
+
+// LPDDR4-3200, all-bank precharge
+static const DramTiming dram_lpddr4 = {
+    .name = "lpddr4",
+    .tck_ps = 625,
+    .tCMD = 1,
+    .tRCD = 29,
+    .tRP = 34,
+    .tCL = 28,
+    .tRAS = 68,
+    .tRC = 102,
+    .tWR = 29,
+    .tWTR = 16,
+    .tRRD = 16,
+    .tRRD_S = 16,
+    .tFAW = 64,
+    .tCCD = 8,
+    .tCCD_S = 8,
+    .tRTP = 12,
+    .tREFI = 6240,
+    .tRFC = 448,
+    .tRFCpb = 224,
+    .burst_length = 16,
+};
+
+// HBM2 at 1 GHz, pseudo channel mode
+static const DramTiming dram_hbm = {
+    .name = "hbm",
+    .tck_ps = 1000,
+    .tCMD = 1,
+    .tRCD = 14,
+    .tRP = 14,
+    .tCL = 14,
+    .tRAS = 34,
+    .tRC = 48,
+    .tWR = 16,
+    .tWTR = 8,
+    .tRRD = 6,
+    .tRRD_S = 4,
+    .tFAW = 16,
+    .tCCD = 4,
+    .tCCD_S = 2,
+    .tRTP = 5,
+    .tREFI = 3900,
+    .tRFC = 350,
+    .tRFCpb = 160,
+    .burst_length = 4,
+};
+
+const DramTiming *const dram_presets[] = {&dram_lab, &dram_ddr3, &dram_ddr4, &dram_lpddr4,
+                                          &dram_hbm, NULL};
+
+const DramTiming *find_dram_preset(const char *name) {
+    for (const DramTiming *const *p = dram_presets; *p; p++) {
+        if (strcmp((*p)->name, name) == 0) {
+            return *p;
+        }
+    }
+    return NULL;
+}
+
+// parameters that can be set from a file
+static const struct {
+    const char *key;
+    size_t offset;
+} dram_params[] = {
+    {"tck_ps", offsetof(DramTiming, tck_ps)},
+    {"tCMD", offsetof(DramTiming, tCMD)},
+    {"tRCD", offsetof(DramTiming, tRCD)},
+    {"tRP", offsetof(DramTiming, tRP)},
+    {"tCL", offsetof(DramTiming, tCL)},
+    {"tRAS", offsetof(DramTiming, tRAS)},
+    {"tRC", offsetof(DramTiming, tRC)},
+    {"tWR", offsetof(DramTiming, tWR)},
+    {"tWTR", offsetof(DramTiming, tWTR)},
+    {"tRRD", offsetof(DramTiming, tRRD)},
+    {"tRRD_S", offsetof(DramTiming, tRRD_S)},
+    {"tFAW", offsetof(DramTiming, tFAW)},
+    {"tCCD", offsetof(DramTiming, tCCD)},
+    {"tCCD_S", offsetof(DramTiming, tCCD_S)},
+    {"tRTP", offsetof(DramTiming, tRTP)},
+    {"tREFI", offsetof(DramTiming, tREFI)},
+    {"tRFC", offsetof(DramTiming, tRFC)},
+    {"tRFCpb", offsetof(DramTiming, tRFCpb)},
+    {"burst_length", offsetof(DramTiming, burst_length)},
+};
+
+int load_dram_config(const char *path, DramTiming *t, AddressMap *map) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("No DRAM preset or timing file %s\n", path);
+        return -1;
+    }
+
+    *t = *find_dram_preset(DRAM_TIMING_DEFAULT);
+    t->name = "custom";
+
+    char line[256], key[32], value[32];
+    int line_no = 0, err = 0;
+    while (!err && fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        if (sscanf(line, " %31[^= \t] = %31s", key, value) != 2) {
+            err = sscanf(line, " %31s", key) == 1; // only blank lines may be skipped
+            continue;
+        }
+
+        if (strcmp(key, "preset") == 0) {
+            const DramTiming *preset = find_dram_preset(value);
+            err = preset == NULL;
+            if (preset) {
+                *t = *preset;
+                t->name = "custom";
+            }
+        } else if (strcmp(key, "serialize_banks") == 0) {
+            t->serialize_banks = strcmp(value, "1") == 0;
+        } else if (set_address_map_param(map, key, value) != 0) {
+            err = 1;
+            for (size_t i = 0; i < sizeof(dram_params) / sizeof(dram_params[0]); i++) {
+                if (strcmp(key, dram_params[i].key) == 0) {
+                    uint32_t *param = (uint32_t *)((char *)t + dram_params[i].offset);
+                    err = sscanf(value, "%u", param) != 1;
+                    break;
+                }
+            }
+        }
+    }
+    fclose(f);
+
+    if (err) {
+        printf("%s:%d: unknown parameter or value\n", path, line_no);
+        return -1;
+    }
+    if (t->tck_ps == 0 || t->tCMD == 0 || t->burst_length == 0) {
+        printf("%s: tck_ps, tCMD and burst_length must not be 0\n", path);
+        return -1;
+    }
+    return finish_address_map(map);
+}
+
+// DRAM clocks to core cycles, rounded up
+static uint32_t to_cycles(uint32_t clocks, uint32_t tck_ps) {
+    return (uint32_t)(((uint64_t)clocks * tck_ps + CPU_CLOCK_PS - 1) / CPU_CLOCK_PS);
+}
+
+void dram_timing_to_cycles(const DramTiming *clocks, DramTiming *cycles) {
+    *cycles = *clocks;
+    cycles->tck_ps = CPU_CLOCK_PS;
+    for (size_t i = 0; i < sizeof(dram_params) / sizeof(dram_params[0]); i++) {
+        if (strcmp(dram_params[i].key, "tck_ps") == 0 ||
+            strcmp(dram_params[i].key, "burst_length") == 0) {
+            continue;
+        }
+        uint32_t *param = (uint32_t *)((char *)cycles + dram_params[i].offset);
+        *param = to_cycles(*param, clocks->tck_ps);
+    }
+
+    // two transfers per DRAM clock
+    cycles->tBURST = to_cycles((clocks->burst_length + 1) / 2, clocks->tck_ps);
+}
+
+void print_dram_timing(const DramTiming *c) {
+    printf("DRAM timing %s (core cycles): tCMD %u tRCD %u tRP %u tCL %u tRAS %u tRC %u tWR %u "
+           "tWTR %u\n",
+           c->name, c->tCMD, c->tRCD, c->tRP, c->tCL, c->tRAS, c->tRC, c->tWR, c->tWTR);
+    printf("  tRRD %u/%u tFAW %u tCCD %u/%u tRTP %u tREFI %u tRFC %u/%u burst %u%s\n", c->tRRD,
+           c->tRRD_S, c->tFAW, c->tCCD, c->tCCD_S, c->tRTP, c->tREFI, c->tRFC, c->tRFCpb,
+           c->tBURST, c->serialize_banks ? ", one request per bank at a time" : "");
+}
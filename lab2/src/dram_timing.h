@@ -0,0 +1,69 @@
+#ifndef _DRAM_TIMING_H_
+#define _DRAM_TIMING_H_
+
+#include "address_map.h"
+#include <stdint.h>
+
+// core clock period, DRAM timings given in DRAM clocks are converted to core
+// cycles with it (4 GHz)
+#define CPU_CLOCK_PS 250
+
+// preset used until another one is selected with the dram command
+#define DRAM_TIMING_DEFAULT "lab"
+
+/**
+ * DRAM timing parameters. Presets and files give them in DRAM clocks of
+ * tck_ps, the memory controller works with a copy converted to core cycles.
+ *
+ * The controller only issues reads (fills), so tWR and tWTR are carried for
+ * completeness but never constrain a schedule.
+ */
+typedef struct DramTiming {
+    const char *name;
+    uint32_t tck_ps;       // DRAM clock period
+    uint32_t tCMD;         // command bus occupancy of one command
+    uint32_t tRCD;         // ACTIVATE to READ
+    uint32_t tRP;          // PRECHARGE to ACTIVATE
+    uint32_t tCL;          // READ to first data
+    uint32_t tRAS;         // ACTIVATE to PRECHARGE
+    uint32_t tRC;          // ACTIVATE to ACTIVATE, same bank
+    uint32_t tWR;          // end of write data to PRECHARGE
+    uint32_t tWTR;         // end of write data to READ
+    uint32_t tRRD;         // ACTIVATE to ACTIVATE, different banks of one bank group
+    uint32_t tRRD_S;       // ACTIVATE to ACTIVATE, different bank groups
+    uint32_t tFAW;         // window holding at most four ACTIVATEs of a rank
+    uint32_t tCCD;         // READ to READ, same bank group
+    uint32_t tCCD_S;       // READ to READ, different bank groups
+    uint32_t tRTP;         // READ to PRECHARGE
+    uint32_t tREFI;        // average interval between refreshes of a rank
+    uint32_t tRFC;         // all-bank REFRESH to any command
+    uint32_t tRFCpb;       // per-bank REFRESH to a command to that bank, 0 = unsupported
+    uint32_t burst_length; // transfers per burst, two per clock
+    uint32_t tBURST;       // data bus occupancy of one burst, set on conversion to cycles
+    // 1 = a bank starts its next request only once the data transfer of the
+    // previous one starts (the original coarse lab model)
+    uint8_t serialize_banks;
+} DramTiming;
+
+// NULL-terminated table of presets: lab, ddr3, ddr4, lpddr4, hbm
+extern const DramTiming *const dram_presets[];
+
+/* Look up a preset by name, returns NULL if unknown */
+const DramTiming *find_dram_preset(const char *name);
+
+/**
+ * Load a DRAM config from a file of key = value lines. Timing parameters are
+ * in DRAM clocks: a "preset = name" line first copies all parameters of a
+ * preset, the others override single parameters. The remaining keys set the
+ * organization and address mapping (see address_map.h), starting from map.
+ * Returns 0 on success, -1 on error.
+ */
+int load_dram_config(const char *path, DramTiming *t, AddressMap *map);
+
+/* Convert a parameter set from DRAM clocks to core cycles */
+void dram_timing_to_cycles(const DramTiming *clocks, DramTiming *cycles);
+
+/* Print a parameter set in core cycles */
+void print_dram_timing(const DramTiming *cycles);
+
+#endif
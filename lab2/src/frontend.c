@@ -0,0 +1,137 @@
+#include "frontend.h"
+#include "pipe.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+static RecordRing rings[MAX_CORES];
+static FuncCore cores[MAX_CORES];
+static uint8_t *regions[FUNC_REGIONS];
+static int requested;
+
+// yields of the host core while one end of a ring waits for the other, before
+// it sleeps instead: a front end that filled its rings ahead of a simulation
+// stopped at the shell's prompt doesn't keep a host core busy
+#define SPIN_WAITS 64
+#define SLEEP_NS 100000
+
+static void back_off(uint32_t *waits) {
+    if (++*waits < SPIN_WAITS) {
+        sched_yield();
+    } else {
+        struct timespec pause = {0, SLEEP_NS};
+        nanosleep(&pause, NULL);
+    }
+}
+
+int ring_wait(RecordRing *r, uint32_t seq) {
+    uint32_t waits = 0;
+    for (;;) {
+        // done is set after the last records are published
+        int done = atomic_load_explicit(&r->done, memory_order_acquire);
+        r->seen_publish = atomic_load_explicit(&r->published, memory_order_acquire);
+        if ((int32_t)(seq - r->seen_publish) < 0) {
+            return 1;
+        }
+        if (done) {
+            return 0;
+        }
+        back_off(&waits);
+    }
+}
+
+// Run up to a batch of instructions of c into its ring, as far as there is
+// room, and publish them. Returns the records produced.
+static uint32_t produce(FuncCore *c, RecordRing *r) {
+    uint32_t room = RING_RECORDS - (r->produced - r->seen_release);
+    if (room < RING_BATCH) {
+        r->seen_release = atomic_load_explicit(&r->released, memory_order_acquire);
+        room = RING_RECORDS - (r->produced - r->seen_release);
+    }
+
+    uint32_t n = 0;
+    while (n < room && n < RING_BATCH && !c->halted) {
+        func_step(c, &r->records[r->produced & RING_MASK]);
+        r->produced++;
+        n++;
+    }
+    atomic_store_explicit(&r->published, r->produced, memory_order_release);
+    if (c->halted) {
+        atomic_store_explicit(&r->done, 1, memory_order_release);
+    }
+    return n;
+}
+
+// The front end: batches of each core in turn until all of them exited
+static void *front_end(void *arg) {
+    uint32_t waits = 0;
+    for (;;) {
+        int running = 0;
+        uint32_t produced = 0;
+        for (uint32_t core = 0; core < num_cores; core++) {
+            FuncCore *c = &cores[core];
+            if (c->halted) {
+                continue;
+            }
+            produced += produce(c, &rings[core]);
+            // an LL reservation doesn't last past a batch, as another core
+            // may store to the word in its own
+            if (shared_memory) {
+                c->ll_valid = 0;
+            }
+            running |= !c->halted;
+        }
+        if (!running) {
+            return NULL;
+        }
+        if (produced > 0) {
+            waits = 0;
+        } else {
+            back_off(&waits);
+        }
+    }
+}
+
+int frontend_start() {
+    if (stat_cycles > 0) {
+        return -1;
+    }
+    requested = 1;
+    return 0;
+}
+
+void frontend_begin() {
+    if (!requested) {
+        return;
+    }
+    requested = 0;
+
+    // the front end runs on the simulator's memory, which the pipelines no
+    // longer read or write
+    func_map_regions(regions, 0);
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Pipe_State *p = &pipes[core];
+        FuncCore *c = &cores[core];
+        memcpy(c->REGS, p->REGS, sizeof(c->REGS));
+        c->HI = p->HI;
+        c->LO = p->LO;
+        c->PC = p->PC;
+        c->space = core_address(core, 0);
+        c->regions = regions;
+        c->ll_valid = 0;
+        c->halted = p->halted;
+
+        RecordRing *r = &rings[core];
+        atomic_store(&r->published, 0);
+        atomic_store(&r->released, 0);
+        atomic_store(&r->done, c->halted);
+        r->produced = r->seen_release = r->seen_publish = 0;
+        p->feed = r;
+        p->feed_next = 0;
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, front_end, NULL);
+    pthread_detach(thread);
+}
@@ -0,0 +1,75 @@
+#ifndef _FRONTEND_H_
+#define _FRONTEND_H_
+
+#include "functional.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+// records of a ring, a power of two; far more than the pipeline holds in flight
+#define RING_RECORDS 4096
+#define RING_MASK (RING_RECORDS - 1)
+
+// records the front end produces for a core before it publishes them and
+// moves on to the next core
+#define RING_BATCH 64
+
+// host cache line, the two ends of a ring keep their indices on separate ones
+#define RING_LINE_BYTES 64
+
+// Lock-free ring of retired-instruction records from one producer (the front
+// end thread) to one consumer (the thread running the core's pipeline).
+// Records are numbered from 0; record seq lives in records[seq & RING_MASK].
+typedef struct RecordRing {
+    // producer's line: records published, and its own view of the other end
+    _Alignas(RING_LINE_BYTES) _Atomic uint32_t published;
+    _Atomic int done;      // the core exited, no record follows the published ones
+    uint32_t produced;     // records written, published every RING_BATCH
+    uint32_t seen_release; // last value of released the producer read
+
+    // consumer's line: records the pipeline retired, which the producer may
+    // overwrite, and its own view of the other end
+    _Alignas(RING_LINE_BYTES) _Atomic uint32_t released;
+    uint32_t seen_publish; // last value of published the consumer read
+
+    _Alignas(RING_LINE_BYTES) FuncRecord records[RING_RECORDS];
+} RecordRing;
+
+/**
+ * Functional-first simulation: a front end thread runs the functional model
+ * (functional.h) of every core ahead of the pipelines and hands each retired
+ * instruction to the core's pipeline through its ring. The pipeline remains
+ * the timing model: fetch takes the next record when the PC it fetches from
+ * is the record's (a fetch down the wrong path after a branch finds none and
+ * is flushed before it executes), a flush hands the records of the flushed
+ * ops back, and MEM takes the value of a load and the outcome of an SC from
+ * the record instead of memory, which belongs to the front end. Cycle counts
+ * are those of execution-driven simulation, except that cores sharing memory
+ * see the values of the front end's interleaving.
+ */
+
+/* Feed the pipelines from the front end from the start of the next run.
+ * Returns -1 once the simulation has started. */
+int frontend_start();
+
+/* Start the front end thread on the machine state, if requested; called by
+ * the shell's run and go before the first cycle */
+void frontend_begin();
+
+/* Wait for the front end to publish record seq of r or to finish. Returns 0
+ * if the core exited before it. */
+int ring_wait(RecordRing *r, uint32_t seq);
+
+/* Record seq of r, NULL if the core exited before it */
+static inline const FuncRecord *ring_peek(RecordRing *r, uint32_t seq) {
+    if ((int32_t)(seq - r->seen_publish) >= 0 && !ring_wait(r, seq)) {
+        return NULL;
+    }
+    return &r->records[seq & RING_MASK];
+}
+
+/* Hand the records before seq back to the front end */
+static inline void ring_release(RecordRing *r, uint32_t seq) {
+    atomic_store_explicit(&r->released, seq, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,317 @@
+#include "functional.h"
+#include "mips.h"
+#include "shell.h"
+#include <stdlib.h>
+#include <string.h>
+
+int func_map_regions(uint8_t **regions, int copy) {
+    memset(regions, 0, FUNC_REGIONS * sizeof(uint8_t *));
+    for (int i = 0; i < MEM_NREGIONS; i++) {
+        const mem_region_t *r = &MEM_REGIONS[i];
+        uint8_t *mem = r->mem;
+        if (copy) {
+            mem = malloc(r->size);
+            if (mem == NULL) {
+                func_free_regions(regions);
+                return -1;
+            }
+            memcpy(mem, r->mem, r->size);
+        }
+        for (uint32_t offset = 0; offset < r->size; offset += 1u << FUNC_REGION_SHIFT) {
+            regions[(r->start + offset) >> FUNC_REGION_SHIFT] = mem + offset;
+        }
+    }
+    return 0;
+}
+
+void func_free_regions(uint8_t **regions) {
+    for (int i = 0; i < MEM_NREGIONS; i++) {
+        // the first entry of a region holds the start of its copy
+        uint32_t first = MEM_REGIONS[i].start >> FUNC_REGION_SHIFT;
+        free(regions[first]);
+    }
+    memset(regions, 0, FUNC_REGIONS * sizeof(uint8_t *));
+}
+
+void func_step(FuncCore *c, FuncRecord *r) {
+    uint32_t pc = c->PC;
+    uint32_t inst = func_read_word(c, pc);
+
+    uint32_t opcode = (inst >> 26) & 0x3F;
+    uint32_t rs = (inst >> 21) & 0x1F;
+    uint32_t rt = (inst >> 16) & 0x1F;
+    uint32_t rd = (inst >> 11) & 0x1F;
+    uint32_t shamt = (inst >> 6) & 0x1F;
+    uint32_t funct = inst & 0x3F;
+    uint32_t imm16 = inst & 0xFFFF;
+    uint32_t se_imm16 = imm16 | ((imm16 & 0x8000) ? 0xFFFF8000 : 0);
+    uint32_t a = c->REGS[rs], b = c->REGS[rt];
+
+    memset(r, 0, sizeof(FuncRecord));
+    r->pc = pc;
+    r->instruction = inst;
+    r->reg_dst = -1;
+
+    uint32_t next_pc = pc + 4;
+    int dst = -1;
+    uint32_t value = 0;
+
+    switch (opcode) {
+    case OP_SPECIAL:
+        dst = rd;
+        switch (funct) {
+        case SUBOP_SLL:
+            value = b << shamt;
+            break;
+        case SUBOP_SLLV:
+            value = b << (a & 0x1F);
+            break;
+        case SUBOP_SRL:
+            value = b >> shamt;
+            break;
+        case SUBOP_SRLV:
+            value = b >> (a & 0x1F);
+            break;
+        case SUBOP_SRA:
+            value = (int32_t)b >> shamt;
+            break;
+        case SUBOP_SRAV:
+            value = (int32_t)b >> (a & 0x1F);
+            break;
+        case SUBOP_JR:
+        case SUBOP_JALR:
+            // the pipeline links into rd for both, rd is 0 for a plain jr
+            value = pc + 4;
+            next_pc = a;
+            r->is_branch = r->branch_taken = 1;
+            break;
+        case SUBOP_SYSCALL:
+            dst = -1;
+            if (c->REGS[2] == 0xA) {
+                c->halted = 1;
+            }
+            break;
+        case SUBOP_MULT: {
+            uint64_t product = (uint64_t)((int64_t)(int32_t)a * (int64_t)(int32_t)b);
+            c->HI = product >> 32;
+            c->LO = product;
+            dst = -1;
+        } break;
+        case SUBOP_MULTU: {
+            uint64_t product = (uint64_t)a * b;
+            c->HI = product >> 32;
+            c->LO = product;
+            dst = -1;
+        } break;
+        case SUBOP_DIV:
+            if (b == 0) {
+                c->HI = c->LO = 0;
+            } else if ((int32_t)a == INT32_MIN && (int32_t)b == -1) {
+                c->HI = 0;
+                c->LO = a;
+            } else {
+                c->LO = (int32_t)a / (int32_t)b;
+                c->HI = (int32_t)a % (int32_t)b;
+            }
+            dst = -1;
+            break;
+        case SUBOP_DIVU:
+            if (b == 0) {
+                c->HI = c->LO = 0;
+            } else {
+                c->LO = a / b;
+                c->HI = a % b;
+            }
+            dst = -1;
+            break;
+        case SUBOP_MFHI:
+            value = c->HI;
+            break;
+        case SUBOP_MFLO:
+            value = c->LO;
+            break;
+        case SUBOP_MTHI:
+            c->HI = a;
+            dst = -1;
+            break;
+        case SUBOP_MTLO:
+            c->LO = a;
+            dst = -1;
+            break;
+        case SUBOP_ADD:
+        case SUBOP_ADDU:
+            value = a + b;
+            break;
+        case SUBOP_SUB:
+        case SUBOP_SUBU:
+            value = a - b;
+            break;
+        case SUBOP_AND:
+            value = a & b;
+            break;
+        case SUBOP_OR:
+            value = a | b;
+            break;
+        case SUBOP_NOR:
+            value = ~(a | b);
+            break;
+        case SUBOP_XOR:
+            value = a ^ b;
+            break;
+        case SUBOP_SLT:
+            value = (int32_t)a < (int32_t)b;
+            break;
+        case SUBOP_SLTU:
+            value = a < b;
+            break;
+        default:
+            dst = -1;
+            break;
+        }
+        break;
+
+    case OP_BRSPEC:
+        r->is_branch = 1;
+        if (rt == BROP_BLTZ || rt == BROP_BLTZAL) {
+            r->branch_taken = (int32_t)a < 0;
+        } else if (rt == BROP_BGEZ || rt == BROP_BGEZAL) {
+            r->branch_taken = (int32_t)a >= 0;
+        }
+        if (rt == BROP_BLTZAL || rt == BROP_BGEZAL) {
+            dst = 31;
+            value = pc + 4;
+        }
+        if (r->branch_taken) {
+            next_pc = pc + 4 + (se_imm16 << 2);
+        }
+        break;
+
+    case OP_JAL:
+        dst = 31;
+        value = pc + 4;
+        /* fallthrough */
+    case OP_J:
+        r->is_branch = r->branch_taken = 1;
+        next_pc = (pc & 0xF0000000) | ((inst & 0x03FFFFFF) << 2);
+        break;
+
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLEZ:
+    case OP_BGTZ:
+        r->is_branch = 1;
+        if (opcode == OP_BEQ) {
+            r->branch_taken = a == b;
+        } else if (opcode == OP_BNE) {
+            r->branch_taken = a != b;
+        } else if (opcode == OP_BLEZ) {
+            r->branch_taken = (int32_t)a <= 0;
+        } else {
+            r->branch_taken = (int32_t)a > 0;
+        }
+        if (r->branch_taken) {
+            next_pc = pc + 4 + (se_imm16 << 2);
+        }
+        break;
+
+    case OP_ADDI:
+    case OP_ADDIU:
+        dst = rt;
+        value = a + se_imm16;
+        break;
+    case OP_SLTI:
+        dst = rt;
+        value = (int32_t)a < (int32_t)se_imm16;
+        break;
+    case OP_SLTIU:
+        dst = rt;
+        value = a < se_imm16;
+        break;
+    case OP_ANDI:
+        dst = rt;
+        value = a & imm16;
+        break;
+    case OP_ORI:
+        dst = rt;
+        value = a | imm16;
+        break;
+    case OP_XORI:
+        dst = rt;
+        value = a ^ imm16;
+        break;
+    case OP_LUI:
+        dst = rt;
+        value = imm16 << 16;
+        break;
+
+    case OP_LW:
+    case OP_LL:
+    case OP_LH:
+    case OP_LHU:
+    case OP_LB:
+    case OP_LBU: {
+        uint32_t address = a + se_imm16;
+        uint32_t word = func_read_word(c, address);
+        r->is_mem = 1;
+        r->mem_addr = address;
+        dst = rt;
+        if (opcode == OP_LW || opcode == OP_LL) {
+            value = word;
+        } else if (opcode == OP_LH || opcode == OP_LHU) {
+            value = (word >> (8 * (address & 2))) & 0xFFFF;
+            if (opcode == OP_LH && (value & 0x8000)) {
+                value |= 0xFFFF0000;
+            }
+        } else {
+            value = (word >> (8 * (address & 3))) & 0xFF;
+            if (opcode == OP_LB && (value & 0x80)) {
+                value |= 0xFFFFFF00;
+            }
+        }
+        if (opcode == OP_LL) {
+            c->ll_valid = 1;
+            c->ll_addr = address & ~3u;
+        }
+    } break;
+
+    case OP_SB:
+    case OP_SH:
+    case OP_SW:
+    case OP_SC: {
+        uint32_t address = a + se_imm16;
+        r->is_mem = 1;
+        r->mem_addr = address;
+        if (opcode == OP_SC) {
+            // rt = 1 if the store was done
+            dst = rt;
+            value = c->ll_valid && c->ll_addr == (address & ~3u);
+            c->ll_valid = 0;
+            if (!value) {
+                break;
+            }
+        }
+
+        uint32_t word = b;
+        if (opcode == OP_SB) {
+            uint32_t shift = 8 * (address & 3);
+            r->mem_value = b & 0xFF;
+            word = (func_read_word(c, address) & ~(0xFFu << shift)) | (r->mem_value << shift);
+        } else if (opcode == OP_SH) {
+            uint32_t shift = 8 * (address & 2);
+            r->mem_value = b & 0xFFFF;
+            word = (func_read_word(c, address) & ~(0xFFFFu << shift)) | (r->mem_value << shift);
+        } else {
+            r->mem_value = b;
+        }
+        r->mem_write = 1;
+        func_write_word(c, address, word);
+    } break;
+    }
+
+    if (dst > 0) {
+        c->REGS[dst] = value;
+        r->reg_dst = dst;
+        r->reg_value = value;
+    }
+    c->PC = r->next_pc = next_pc;
+}
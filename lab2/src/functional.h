@@ -0,0 +1,92 @@
+#ifndef _FUNCTIONAL_H_
+#define _FUNCTIONAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// a functional core finds its memory by address >> FUNC_REGION_SHIFT, the
+// regions of shell.c are 1 MB and 1 MB aligned
+#define FUNC_REGION_SHIFT 20
+#define FUNC_REGIONS (1u << (32 - FUNC_REGION_SHIFT))
+#define FUNC_REGION_MASK ((1u << FUNC_REGION_SHIFT) - 1)
+
+/* Architectural state of a core run by the functional model: no pipeline,
+ * caches or timing, one instruction completes per step */
+typedef struct FuncCore {
+    uint32_t REGS[32];
+    uint32_t HI, LO;
+    uint32_t PC;
+
+    uint32_t space;    // XORed into addresses, core_address(core, 0) in pipe.h
+    uint8_t **regions; // memory by physical address >> FUNC_REGION_SHIFT, NULL = unmapped
+
+    // reservation of the last LL, on its word
+    uint32_t ll_addr;
+    uint8_t ll_valid;
+
+    int halted; // executed the exit syscall
+} FuncCore;
+
+/* What an instruction did, as it retires */
+typedef struct FuncRecord {
+    uint32_t pc, instruction;
+    uint32_t next_pc;
+
+    int reg_dst;        // register written, -1 if none ($zero is never written)
+    uint32_t reg_value; // value written to it
+
+    uint32_t mem_addr;  // address of a load or store
+    uint32_t mem_value; // value a store wrote, in the low bits for SB and SH
+    uint8_t is_mem, mem_write;
+
+    uint8_t is_branch, branch_taken;
+} FuncRecord;
+
+/**
+ * Functional MIPS model: executes the ISA as the pipeline implements it (no
+ * branch delay slots, unknown encodings are no-ops, syscall 0xA in $v0 exits)
+ * on a FuncCore, and reports each instruction in a FuncRecord. Its memory is
+ * a table of region pointers, either those of shell.c or private copies.
+ */
+
+/* Fill a region table (FUNC_REGIONS entries) with the memory regions of all
+ * cores, copies of them if copy is set. Returns -1 if a copy can't be
+ * allocated. */
+int func_map_regions(uint8_t **regions, int copy);
+
+/* Free the copies made by func_map_regions */
+void func_free_regions(uint8_t **regions);
+
+/* Physical address of the word holding a program address of c */
+static inline uint32_t func_physical(const FuncCore *c, uint32_t address) {
+    return (address & ~3u) ^ c->space;
+}
+
+/* Word at a program address of c, 0 if unmapped like mem_read_32 */
+static inline uint32_t func_read_word(const FuncCore *c, uint32_t address) {
+    uint32_t physical = func_physical(c, address);
+    const uint8_t *mem = c->regions[physical >> FUNC_REGION_SHIFT];
+    if (mem == NULL) {
+        return 0;
+    }
+    mem += physical & FUNC_REGION_MASK;
+    return mem[0] | (mem[1] << 8) | (mem[2] << 16) | ((uint32_t)mem[3] << 24);
+}
+
+static inline void func_write_word(const FuncCore *c, uint32_t address, uint32_t value) {
+    uint32_t physical = func_physical(c, address);
+    uint8_t *mem = c->regions[physical >> FUNC_REGION_SHIFT];
+    if (mem == NULL) {
+        return;
+    }
+    mem += physical & FUNC_REGION_MASK;
+    mem[0] = value;
+    mem[1] = value >> 8;
+    mem[2] = value >> 16;
+    mem[3] = value >> 24;
+}
+
+/* Execute the instruction at c->PC and describe it in r */
+void func_step(FuncCore *c, FuncRecord *r);
+
+#endif
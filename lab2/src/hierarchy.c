@@ -0,0 +1,329 @@
+#include "hierarchy.h"
+#include "repl_policy.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Cache caches[MAX_CACHE_COPIES];
+uint32_t num_caches = 0;
+Cache *icache[MAX_CORES], *dcache[MAX_CORES];
+
+static VictimCache victims[MAX_CACHE_COPIES];
+
+// cores the private caches are copied for
+static uint32_t hierarchy_cores = 1;
+
+// 1 if the cores share memory and the private D-caches are kept coherent
+static int hierarchy_coherent;
+
+static int is_pow2(uint32_t x) { return x && !(x & (x - 1)); }
+
+static int find_config(CacheConfig *cfg, uint32_t n, const char *name) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (strcmp(cfg[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Check a parsed hierarchy before replacing the current one.
+// Returns 0 if it can be built, prints the first problem otherwise.
+static int validate_config(CacheConfig *cfg, uint32_t n) {
+    if (find_config(cfg, n, "icache") < 0 || find_config(cfg, n, "dcache") < 0) {
+        printf("Config needs an [icache] and a [dcache] section\n");
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        CacheConfig *c = &cfg[i];
+        if (!is_pow2(c->block_size) || c->block_size < 4 || c->block_size != cfg[0].block_size) {
+            printf("[%s]: block_size must be the same power of two >= 4 in all caches\n",
+                   c->name);
+            return -1;
+        }
+        if (c->ways == 0 || c->ways > CACHE_MAX_WAYS) {
+            printf("[%s]: ways must be 1 to %d\n", c->name, CACHE_MAX_WAYS);
+            return -1;
+        }
+        if (c->size % (c->ways * c->block_size) || !is_pow2(c->size / (c->ways * c->block_size))) {
+            printf("[%s]: size must be a power of two number of sets of ways * block_size\n",
+                   c->name);
+            return -1;
+        }
+        const ReplPolicy *policy = find_repl_policy(c->policy);
+        if (policy == NULL) {
+            printf("[%s]: unknown policy %s\n", c->name, c->policy);
+            return -1;
+        }
+        if (c->ways > policy->max_ways) {
+            printf("[%s]: policy %s holds up to %u ways\n", c->name, c->policy, policy->max_ways);
+            return -1;
+        }
+        if (c->victim != 0 &&
+            (c->victim < VICTIM_CACHE_MIN_ENTRIES || c->victim > VICTIM_CACHE_MAX_ENTRIES)) {
+            printf("[%s]: victim must be 0 or %d to %d entries\n", c->name,
+                   VICTIM_CACHE_MIN_ENTRIES, VICTIM_CACHE_MAX_ENTRIES);
+            return -1;
+        }
+        if (c->victim != 0 && hierarchy_coherent) {
+            printf("[%s]: victim caches hold no coherence state, the cores share memory\n",
+                   c->name);
+            return -1;
+        }
+
+        // levels are listed top-down, so the hierarchy cannot have cycles
+        int next = c->next[0] ? find_config(cfg, n, c->next) : -1;
+        if (c->next[0] && next <= (int)i) {
+            printf("[%s]: next level %s must be defined after it\n", c->name, c->next);
+            return -1;
+        }
+        if (c->shared && next >= 0 && !cfg[next].shared) {
+            printf("[%s]: a shared cache can't miss to the private %s\n", c->name, c->next);
+            return -1;
+        }
+        if (find_config(cfg, n, c->name) != (int)i) {
+            printf("[%s]: defined twice\n", c->name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Copy of config i used by a core, first[i] is the first copy of config i
+static Cache *copy_for_core(CacheConfig *cfg, const uint32_t *first, int i, uint32_t core) {
+    return &caches[first[i] + (cfg[i].shared ? 0 : core)];
+}
+
+// Replace the current hierarchy with a validated config
+static void build_hierarchy(CacheConfig *cfg, uint32_t n) {
+    free_hierarchy();
+
+    uint32_t first[MAX_CACHES];
+    for (uint32_t i = 0; i < n; i++) {
+        first[i] = num_caches;
+        num_caches += cfg[i].shared ? 1 : hierarchy_cores;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t copies = cfg[i].shared ? 1 : hierarchy_cores;
+        for (uint32_t core = 0; core < copies; core++) {
+            Cache *c = &caches[first[i] + core];
+            alloc_cache(c, cfg[i].size, cfg[i].ways, cfg[i].block_size,
+                        find_repl_policy(cfg[i].policy));
+            strcpy(c->name, cfg[i].name);
+            if (copies > 1) {
+                snprintf(c->label, CACHE_LABEL_LEN, "core%u.%s", core, cfg[i].name);
+            } else {
+                strcpy(c->label, cfg[i].name);
+            }
+            c->latency = cfg[i].latency;
+            c->shared = cfg[i].shared;
+            c->core = core;
+            c->next = cfg[i].next[0]
+                          ? copy_for_core(cfg, first, find_config(cfg, n, cfg[i].next), core)
+                          : NULL;
+
+            init_victim_cache(&victims[first[i] + core], cfg[i].victim);
+            c->victim = &victims[first[i] + core];
+        }
+    }
+
+    for (uint32_t core = 0; core < hierarchy_cores; core++) {
+        icache[core] = copy_for_core(cfg, first, find_config(cfg, n, "icache"), core);
+        dcache[core] = copy_for_core(cfg, first, find_config(cfg, n, "dcache"), core);
+    }
+}
+
+void set_hierarchy_cores(uint32_t cores) { hierarchy_cores = cores; }
+
+void set_hierarchy_coherent(int coherent) { hierarchy_coherent = coherent; }
+
+static void set_config(CacheConfig *c, const char *name, uint32_t size, uint32_t ways,
+                       const char *policy, const char *next) {
+    memset(c, 0, sizeof(CacheConfig));
+    strcpy(c->name, name);
+    c->size = size;
+    c->ways = ways;
+    c->block_size = BLOCK_SIZE;
+    strcpy(c->policy, policy);
+    strcpy(c->next, next);
+}
+
+void init_default_hierarchy() {
+    CacheConfig cfg[3];
+    set_config(&cfg[0], "icache", ICACHE_SIZE, ICACHE_WAYS, ICACHE_POLICY, "l2");
+    set_config(&cfg[1], "dcache", DCACHE_SIZE, DCACHE_WAYS, DCACHE_POLICY, "l2");
+    cfg[1].victim = VICTIM_CACHE_ENTRIES;
+    set_config(&cfg[2], "l2", L2CACHE_SIZE, L2CACHE_WAYS, L2CACHE_POLICY, "");
+    cfg[2].latency = L2_HIT_LATENCY;
+    cfg[2].shared = 1;
+
+    build_hierarchy(cfg, 3);
+}
+
+// Strip leading and trailing whitespace in place
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+// Parse a number with an optional K or M suffix, returns -1 if malformed
+static int parse_size(const char *value, uint32_t *out) {
+    char *end;
+    unsigned long n = strtoul(value, &end, 0);
+    if (end == value) {
+        return -1;
+    }
+    if (*end == 'K' || *end == 'k') {
+        n *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        n *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *out = (uint32_t)n;
+    return 0;
+}
+
+// Apply one key = value line to a cache section, returns -1 if invalid
+static int parse_cache_key(CacheConfig *c, const char *key, const char *value) {
+    if (strcmp(key, "size") == 0) {
+        return parse_size(value, &c->size);
+    } else if (strcmp(key, "ways") == 0) {
+        return parse_size(value, &c->ways);
+    } else if (strcmp(key, "block_size") == 0) {
+        return parse_size(value, &c->block_size);
+    } else if (strcmp(key, "latency") == 0) {
+        return parse_size(value, &c->latency);
+    } else if (strcmp(key, "victim") == 0) {
+        return parse_size(value, &c->victim);
+    } else if (strcmp(key, "shared") == 0) {
+        uint32_t shared;
+        if (parse_size(value, &shared) != 0 || shared > 1) {
+            return -1;
+        }
+        c->shared = shared;
+        return 0;
+    } else if (strcmp(key, "policy") == 0 && strlen(value) < CACHE_NAME_LEN) {
+        strcpy(c->policy, value);
+        return 0;
+    } else if (strcmp(key, "next") == 0 && strlen(value) < CACHE_NAME_LEN) {
+        strcpy(c->next, value);
+        return 0;
+    }
+    return -1;
+}
+
+int load_hierarchy_config(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("Can't open cache config %s\n", path);
+        return -1;
+    }
+
+    CacheConfig cfg[MAX_CACHES];
+    char inclusion_name[CACHE_NAME_LEN] = "";
+    int n = 0, line_no = 0, err = 0;
+    char line[256];
+
+    while (!err && fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *comment = strpbrk(line, "#;");
+        if (comment) {
+            *comment = '\0';
+        }
+        char *s = trim(line);
+        if (*s == '\0') {
+            continue;
+        }
+
+        // [name] starts a new cache, defaults are those of the L1s
+        if (*s == '[') {
+            char *close = strchr(s, ']');
+            if (close == NULL || close[1] != '\0' || close - s - 1 >= CACHE_NAME_LEN ||
+                n == MAX_CACHES) {
+                err = 1;
+                break;
+            }
+            *close = '\0';
+            set_config(&cfg[n++], trim(s + 1), 0, 0, "lru", "");
+            continue;
+        }
+
+        char *eq = strchr(s, '=');
+        if (eq == NULL) {
+            err = 1;
+            break;
+        }
+        *eq = '\0';
+        char *key = trim(s);
+        char *value = trim(eq + 1);
+
+        // keys before the first section describe the whole hierarchy
+        if (n == 0) {
+            if (strcmp(key, "inclusion") != 0 || strlen(value) >= CACHE_NAME_LEN) {
+                err = 1;
+            } else {
+                strcpy(inclusion_name, value);
+            }
+        } else if (parse_cache_key(&cfg[n - 1], key, value) != 0) {
+            err = 1;
+        }
+    }
+    fclose(f);
+
+    if (err) {
+        printf("%s:%d: syntax error\n", path, line_no);
+        return -1;
+    }
+    if (validate_config(cfg, n) != 0) {
+        return -1;
+    }
+    if (inclusion_name[0] && set_inclusion_policy(inclusion_name) != 0) {
+        printf("Unknown inclusion policy: %s\n", inclusion_name);
+        return -1;
+    }
+
+    build_hierarchy(cfg, n);
+    return 0;
+}
+
+void free_hierarchy() {
+    for (uint32_t i = 0; i < num_caches; i++) {
+        free_cache(&caches[i]);
+    }
+    num_caches = 0;
+}
+
+Cache *find_cache(const char *name) {
+    for (uint32_t i = 0; i < num_caches; i++) {
+        if (strcmp(caches[i].name, name) == 0) {
+            return &caches[i];
+        }
+    }
+    return NULL;
+}
+
+void print_hierarchy() {
+    for (uint32_t i = 0; i < num_caches; i++) {
+        Cache *c = &caches[i];
+        printf("%s: %u KB, %u-way, %u B blocks, %s, latency %u, %s -> %s\n", c->label,
+               c->num_sets * c->num_ways * c->block_size / 1024, c->num_ways, c->block_size,
+               c->policy->name, c->latency, c->shared ? "shared" : "private",
+               c->next ? c->next->label : "memory");
+        if (c->victim && c->victim->num_entries) {
+            printf("%s: %u entry victim cache\n", c->label, c->victim->num_entries);
+        }
+    }
+}
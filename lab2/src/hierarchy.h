@@ -0,0 +1,75 @@
+#ifndef _HIERARCHY_H_
+#define _HIERARCHY_H_
+
+#include "cache.h"
+#include <stdint.h>
+
+// upper bound on the number of caches in a hierarchy, private caches are
+// copied for each core on top of that
+#define MAX_CACHES 8
+#define MAX_CACHE_COPIES (MAX_CACHES * MAX_CORES)
+
+/**
+ * Description of one cache of the hierarchy, one [section] of a config file:
+ *
+ *   inclusion = nine          # lower levels: nine, inclusive or exclusive
+ *
+ *   [icache]                  # the L1 the fetch stage accesses
+ *   size = 8K
+ *   ways = 4
+ *   next = l2                 # level probed on a miss, omitted = memory
+ *
+ *   [l2]
+ *   size = 256K
+ *   ways = 16
+ *   latency = 15              # cycles until a hit in this level fills the L1
+ *   shared = 1                # level is shared by the L1s of all cores
+ *
+ * Sections must be listed top-down: a cache's next level is defined after
+ * it. [icache] and [dcache] are required, all caches share one block size.
+ * Each core gets its own copy of the private caches; a shared cache can only
+ * miss to shared levels.
+ */
+typedef struct CacheConfig {
+    char name[CACHE_NAME_LEN];
+    uint32_t size;       // capacity in bytes
+    uint32_t ways;
+    uint32_t block_size; // in bytes
+    uint32_t latency;    // hit latency, ignored for the L1s
+    uint32_t victim;     // victim cache entries, 0 = none
+    uint8_t shared;      // 1 = shared by all cores, 0 = private
+    char policy[CACHE_NAME_LEN];
+    char next[CACHE_NAME_LEN]; // empty = backed by memory
+} CacheConfig;
+
+/* Set the number of cores the private caches are copied for, takes effect
+ * when the hierarchy is built next */
+void set_hierarchy_cores(uint32_t cores);
+
+/* Refuse victim caches in configs loaded later, they hold no coherence state */
+void set_hierarchy_coherent(int coherent);
+
+/* Build the default hierarchy (L1I, L1D, shared L2) from the cache.h macros */
+void init_default_hierarchy();
+
+/* Replace the hierarchy with the one described by a config file.
+ * Returns 0 on success, prints the problem and keeps the current
+ * hierarchy on failure. */
+int load_hierarchy_config(const char *path);
+
+/* Release the tag stores of all caches */
+void free_hierarchy();
+
+/* Look up a cache by its section name, returns NULL if unknown. For a
+ * private cache this is the copy of core 0. */
+Cache *find_cache(const char *name);
+
+/* Print the geometry of each cache and how the levels are connected */
+void print_hierarchy();
+
+// caches in config order, each one before the next level it misses to; the
+// copies of a private cache follow each other in core order
+extern Cache caches[MAX_CACHE_COPIES];
+extern uint32_t num_caches;
+
+#endif
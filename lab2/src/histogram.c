@@ -0,0 +1,39 @@
+#include "histogram.h"
+#include <stdio.h>
+
+// Largest value counted in a bucket
+static uint32_t bucket_upper_bound(uint32_t b) {
+    if (b < HISTOGRAM_SUB_BUCKETS) {
+        return b;
+    }
+    uint32_t shift = b / HISTOGRAM_SUB_BUCKETS - 1;
+    uint32_t mantissa = HISTOGRAM_SUB_BUCKETS + b % HISTOGRAM_SUB_BUCKETS;
+    return (uint32_t)(((uint64_t)(mantissa + 1) << shift) - 1);
+}
+
+void histogram_merge(Histogram *dst, const Histogram *src) {
+    dst->count += src->count;
+    dst->sum += src->sum;
+    dst->max = src->max > dst->max ? src->max : dst->max;
+    for (uint32_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        dst->bucket[b] += src->bucket[b];
+    }
+}
+
+uint32_t histogram_percentile(const Histogram *h, double p) {
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += h->bucket[b];
+        if (seen > 0 && seen >= p * h->count) {
+            uint32_t bound = bucket_upper_bound(b);
+            return bound < h->max ? bound : h->max;
+        }
+    }
+    return h->max;
+}
+
+void print_histogram(const char *name, const char *what, const Histogram *h) {
+    printf("%s: %u %s, mean %.1f, p50 %u, p95 %u, p99 %u, max %u\n", name, h->count, what,
+           h->count ? (double)h->sum / h->count : 0, histogram_percentile(h, 0.5),
+           histogram_percentile(h, 0.95), histogram_percentile(h, 0.99), h->max);
+}
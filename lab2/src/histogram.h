@@ -0,0 +1,51 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+
+// sub-buckets per power of two: values are kept to 1/16 of their magnitude,
+// values below 16 exactly
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Log-bucketed latency histogram in the style of HdrHistogram: each power of
+ * two is split into HISTOGRAM_SUB_BUCKETS linear buckets, so a percentile is
+ * exact below 16 cycles and within 6.25% above, over the whole uint32_t
+ * range, at the cost of a count leading zeros per recorded value.
+ */
+typedef struct Histogram {
+    uint32_t count;
+    uint64_t sum;
+    uint32_t max;
+    uint32_t bucket[HISTOGRAM_BUCKETS];
+} Histogram;
+
+static inline uint32_t histogram_bucket(uint32_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+    // the leading one and the HISTOGRAM_SUB_BITS bits after it
+    uint32_t shift = 31 - __builtin_clz(value) - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static inline void histogram_record(Histogram *h, uint32_t value) {
+    h->bucket[histogram_bucket(value)]++;
+    h->count++;
+    h->sum += value;
+    h->max = value > h->max ? value : h->max;
+}
+
+/* Add the values recorded in src to dst */
+void histogram_merge(Histogram *dst, const Histogram *src);
+
+/* Smallest value at or below which a fraction p of the values fall, to the
+ * upper bound of its bucket and at most the largest value recorded */
+uint32_t histogram_percentile(const Histogram *h, double p);
+
+/* Print "<name>: <count> <what>, mean, p50, p95, p99, max" on one line */
+void print_histogram(const char *name, const char *what, const Histogram *h);
+
+#endif
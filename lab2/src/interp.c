@@ -0,0 +1,587 @@
+#include "interp.h"
+#include "mips.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Handlers, indices of the label table in interp_run
+enum {
+    H_NOP,
+    H_STEP, // through func_step
+    H_SYSCALL,
+    H_SLL,
+    H_SRL,
+    H_SRA,
+    H_SLLV,
+    H_SRLV,
+    H_SRAV,
+    H_ADDU,
+    H_SUBU,
+    H_AND,
+    H_OR,
+    H_XOR,
+    H_NOR,
+    H_SLT,
+    H_SLTU,
+    H_MULT,
+    H_MULTU,
+    H_DIV,
+    H_DIVU,
+    H_MFHI,
+    H_MFLO,
+    H_MTHI,
+    H_MTLO,
+    H_ADDIU,
+    H_SLTI,
+    H_SLTIU,
+    H_ANDI,
+    H_ORI,
+    H_XORI,
+    H_LUI,
+    H_LW,
+    H_LH,
+    H_LHU,
+    H_LB,
+    H_LBU,
+    H_SW,
+    H_SH,
+    H_SB,
+    // the handlers that end a block
+    H_END, // falls through to the next block
+    H_J,
+    H_JAL,
+    H_JR,
+    H_JALR,
+    H_BEQ,
+    H_BNE,
+    H_BLEZ,
+    H_BGTZ,
+    H_BLTZ,
+    H_BGEZ,
+    H_BLTZAL,
+    H_BGEZAL,
+    NUM_HANDLERS
+};
+
+// An instruction translated for its handler
+typedef struct TInst {
+    const void *handler;
+    uint8_t rs, rt, rd, shamt; // rd is the destination of every handler
+    uint32_t imm;              // extended immediate, or the branch or jump target
+} TInst;
+
+typedef struct Block {
+    uint32_t pc;           // program address of the first instruction
+    uint32_t physical;     // its physical address, the key of the block
+    uint32_t length;       // instructions, with the branch or jump ending it
+    uint32_t end;          // address after the last one: fall through and link
+    struct Block *next[2]; // successor last taken: [0] falling through, [1] jumping
+    struct Block *chain;   // next block of the hash bucket
+    TInst insts[];         // and H_END if no branch or jump ends it
+} Block;
+
+// blocks are hashed by their word address, so the buckets of neighboring code
+// are neighbors
+#define HASH_BITS 12
+static Block *buckets[1 << HASH_BITS];
+static uint32_t num_blocks;
+
+// pages of physical memory holding translated code
+#define CODE_PAGE_SHIFT 12
+static uint8_t code_pages[1u << (32 - CODE_PAGE_SHIFT)];
+
+static inline uint32_t block_hash(uint32_t physical) {
+    return (physical >> 2) & ((1 << HASH_BITS) - 1);
+}
+
+void interp_flush() {
+    if (num_blocks == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < (1 << HASH_BITS); i++) {
+        while (buckets[i]) {
+            Block *b = buckets[i];
+            buckets[i] = b->chain;
+            free(b);
+        }
+    }
+    memset(code_pages, 0, sizeof(code_pages));
+    num_blocks = 0;
+}
+
+// Handler of an instruction at pc, with its operands in t. Instructions
+// writing $zero without other effects become H_NOP.
+static int decode(TInst *t, uint32_t inst, uint32_t pc) {
+    uint32_t opcode = (inst >> 26) & 0x3F;
+    uint32_t rs = (inst >> 21) & 0x1F;
+    uint32_t rt = (inst >> 16) & 0x1F;
+    uint32_t rd = (inst >> 11) & 0x1F;
+    uint32_t imm16 = inst & 0xFFFF;
+    uint32_t se_imm16 = imm16 | ((imm16 & 0x8000) ? 0xFFFF8000 : 0);
+
+    t->rs = rs;
+    t->rt = rt;
+    t->rd = rt;
+    t->shamt = (inst >> 6) & 0x1F;
+    t->imm = se_imm16;
+
+    switch (opcode) {
+    case OP_SPECIAL: {
+        static const uint8_t special[64] = {
+            [SUBOP_SLL] = H_SLL,     [SUBOP_SRL] = H_SRL,     [SUBOP_SRA] = H_SRA,
+            [SUBOP_SLLV] = H_SLLV,   [SUBOP_SRLV] = H_SRLV,   [SUBOP_SRAV] = H_SRAV,
+            [SUBOP_MFHI] = H_MFHI,   [SUBOP_MFLO] = H_MFLO,   [SUBOP_ADD] = H_ADDU,
+            [SUBOP_ADDU] = H_ADDU,   [SUBOP_SUB] = H_SUBU,    [SUBOP_SUBU] = H_SUBU,
+            [SUBOP_AND] = H_AND,     [SUBOP_OR] = H_OR,       [SUBOP_XOR] = H_XOR,
+            [SUBOP_NOR] = H_NOR,     [SUBOP_SLT] = H_SLT,     [SUBOP_SLTU] = H_SLTU,
+        };
+        uint32_t funct = inst & 0x3F;
+        t->rd = rd;
+        switch (funct) {
+        case SUBOP_JR:
+            return H_JR;
+        case SUBOP_JALR:
+            return rd ? H_JALR : H_JR;
+        case SUBOP_SYSCALL:
+            return H_SYSCALL;
+        case SUBOP_MULT:
+            return H_MULT;
+        case SUBOP_MULTU:
+            return H_MULTU;
+        case SUBOP_DIV:
+            return H_DIV;
+        case SUBOP_DIVU:
+            return H_DIVU;
+        case SUBOP_MTHI:
+            return H_MTHI;
+        case SUBOP_MTLO:
+            return H_MTLO;
+        }
+        if (special[funct] == 0) {
+            return H_STEP;
+        }
+        return rd ? special[funct] : H_NOP;
+    }
+
+    case OP_BRSPEC:
+        t->imm = pc + 4 + (se_imm16 << 2);
+        switch (rt) {
+        case BROP_BLTZ:
+            return H_BLTZ;
+        case BROP_BGEZ:
+            return H_BGEZ;
+        case BROP_BLTZAL:
+            return H_BLTZAL;
+        case BROP_BGEZAL:
+            return H_BGEZAL;
+        }
+        return H_NOP;
+
+    case OP_J:
+    case OP_JAL:
+        t->imm = (pc & 0xF0000000) | ((inst & 0x03FFFFFF) << 2);
+        return opcode == OP_J ? H_J : H_JAL;
+
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLEZ:
+    case OP_BGTZ:
+        t->imm = pc + 4 + (se_imm16 << 2);
+        return opcode == OP_BEQ ? H_BEQ : opcode == OP_BNE ? H_BNE : opcode == OP_BLEZ ? H_BLEZ
+                                                                                       : H_BGTZ;
+
+    case OP_ADDI:
+    case OP_ADDIU:
+        return rt ? H_ADDIU : H_NOP;
+    case OP_SLTI:
+        return rt ? H_SLTI : H_NOP;
+    case OP_SLTIU:
+        return rt ? H_SLTIU : H_NOP;
+    case OP_ANDI:
+        t->imm = imm16;
+        return rt ? H_ANDI : H_NOP;
+    case OP_ORI:
+        t->imm = imm16;
+        return rt ? H_ORI : H_NOP;
+    case OP_XORI:
+        t->imm = imm16;
+        return rt ? H_XORI : H_NOP;
+    case OP_LUI:
+        t->imm = imm16 << 16;
+        return rt ? H_LUI : H_NOP;
+
+    case OP_LW:
+        return rt ? H_LW : H_NOP;
+    case OP_LH:
+        return rt ? H_LH : H_NOP;
+    case OP_LHU:
+        return rt ? H_LHU : H_NOP;
+    case OP_LB:
+        return rt ? H_LB : H_NOP;
+    case OP_LBU:
+        return rt ? H_LBU : H_NOP;
+    case OP_SW:
+        return H_SW;
+    case OP_SH:
+        return H_SH;
+    case OP_SB:
+        return H_SB;
+    case OP_LL:
+    case OP_SC:
+        return H_STEP;
+    }
+    return H_NOP;
+}
+
+// Translate the block starting at pc
+static Block *translate(const FuncCore *c, uint32_t pc, const void *const *handlers) {
+    TInst insts[INTERP_BLOCK_LEN + 1];
+    uint32_t n = 0;
+    int h = H_NOP;
+    while (n < INTERP_BLOCK_LEN && h < H_END) {
+        uint32_t address = pc + 4 * n;
+        h = decode(&insts[n], func_read_word(c, address), address);
+        insts[n].handler = handlers[h];
+        code_pages[func_physical(c, address) >> CODE_PAGE_SHIFT] = 1;
+        n++;
+    }
+    uint32_t size = n;
+    if (h < H_END) {
+        insts[size++].handler = handlers[H_END];
+    }
+
+    Block *b = malloc(sizeof(Block) + size * sizeof(TInst));
+    memcpy(b->insts, insts, size * sizeof(TInst));
+    b->pc = pc;
+    b->physical = func_physical(c, pc);
+    b->next[0] = b->next[1] = NULL;
+    b->length = n;
+    b->end = pc + 4 * n;
+
+    uint32_t i = block_hash(b->physical);
+    b->chain = buckets[i];
+    buckets[i] = b;
+    num_blocks++;
+    return b;
+}
+
+static Block *find_block(const FuncCore *c, uint32_t pc, const void *const *handlers) {
+    uint32_t physical = func_physical(c, pc);
+    for (Block *b = buckets[block_hash(physical)]; b; b = b->chain) {
+        if (b->physical == physical && b->pc == pc) {
+            return b;
+        }
+    }
+    return translate(c, pc, handlers);
+}
+
+// Whether a store of c to address hit translated code
+static inline int code_written(const FuncCore *c, uint32_t address) {
+    return code_pages[func_physical(c, address) >> CODE_PAGE_SHIFT];
+}
+
+uint64_t interp_run(FuncCore *c, uint64_t n) {
+    static const void *const handlers[NUM_HANDLERS] = {
+        [H_NOP] = &&nop,       [H_STEP] = &&step,     [H_SYSCALL] = &&syscall,
+        [H_SLL] = &&sll,       [H_SRL] = &&srl,       [H_SRA] = &&sra,
+        [H_SLLV] = &&sllv,     [H_SRLV] = &&srlv,     [H_SRAV] = &&srav,
+        [H_ADDU] = &&addu,     [H_SUBU] = &&subu,     [H_AND] = &&and,
+        [H_OR] = &&or,         [H_XOR] = &&xor,       [H_NOR] = &&nor,
+        [H_SLT] = &&slt,       [H_SLTU] = &&sltu,     [H_MULT] = &&mult,
+        [H_MULTU] = &&multu,   [H_DIV] = &&div,       [H_DIVU] = &&divu,
+        [H_MFHI] = &&mfhi,     [H_MFLO] = &&mflo,     [H_MTHI] = &&mthi,
+        [H_MTLO] = &&mtlo,     [H_ADDIU] = &&addiu,   [H_SLTI] = &&slti,
+        [H_SLTIU] = &&sltiu,   [H_ANDI] = &&andi,     [H_ORI] = &&ori,
+        [H_XORI] = &&xori,     [H_LUI] = &&lui,       [H_LW] = &&lw,
+        [H_LH] = &&lh,         [H_LHU] = &&lhu,       [H_LB] = &&lb,
+        [H_LBU] = &&lbu,       [H_SW] = &&sw,         [H_SH] = &&sh,
+        [H_SB] = &&sb,         [H_END] = &&end,       [H_J] = &&j,
+        [H_JAL] = &&jal,       [H_JR] = &&jr,         [H_JALR] = &&jalr,
+        [H_BEQ] = &&beq,       [H_BNE] = &&bne,       [H_BLEZ] = &&blez,
+        [H_BGTZ] = &&bgtz,     [H_BLTZ] = &&bltz,     [H_BGEZ] = &&bgez,
+        [H_BLTZAL] = &&bltzal, [H_BGEZAL] = &&bgezal,
+    };
+
+    uint32_t *R = c->REGS;
+    uint64_t remaining = n;
+    const TInst *ip;
+    uint32_t target, address, word;
+    int taken;
+    FuncRecord r;
+    Block *b;
+
+#define NEXT goto *(++ip)->handler
+// address after the instruction being executed
+#define NEXT_PC (b->pc + 4 * (uint32_t)(ip - b->insts + 1))
+
+    if (c->halted) {
+        return 0;
+    }
+    b = find_block(c, c->PC, handlers);
+
+enter:
+    if (b->length > remaining) {
+        c->PC = b->pc;
+        goto out;
+    }
+    remaining -= b->length;
+    ip = b->insts;
+    goto *ip->handler;
+
+// leave the block at the instruction being executed, after it
+exit_block:
+    remaining += b->length - (ip - b->insts + 1);
+    c->PC = NEXT_PC;
+    if (c->halted) {
+        goto out;
+    }
+    // a store hit translated code, which may be this block
+    interp_flush();
+    b = find_block(c, c->PC, handlers);
+    goto enter;
+
+// continue with the successor at target, [taken] of the block's
+follow:
+    if (b->next[taken] == NULL || b->next[taken]->pc != target) {
+        b->next[taken] = find_block(c, target, handlers);
+    }
+    b = b->next[taken];
+    goto enter;
+
+nop:
+    NEXT;
+step:
+    c->PC = NEXT_PC - 4;
+    func_step(c, &r);
+    if (r.mem_write && code_written(c, r.mem_addr)) {
+        goto exit_block;
+    }
+    NEXT;
+syscall:
+    if (R[2] == 0xA) {
+        c->halted = 1;
+        goto exit_block;
+    }
+    NEXT;
+
+sll:
+    R[ip->rd] = R[ip->rt] << ip->shamt;
+    NEXT;
+srl:
+    R[ip->rd] = R[ip->rt] >> ip->shamt;
+    NEXT;
+sra:
+    R[ip->rd] = (int32_t)R[ip->rt] >> ip->shamt;
+    NEXT;
+sllv:
+    R[ip->rd] = R[ip->rt] << (R[ip->rs] & 0x1F);
+    NEXT;
+srlv:
+    R[ip->rd] = R[ip->rt] >> (R[ip->rs] & 0x1F);
+    NEXT;
+srav:
+    R[ip->rd] = (int32_t)R[ip->rt] >> (R[ip->rs] & 0x1F);
+    NEXT;
+addu:
+    R[ip->rd] = R[ip->rs] + R[ip->rt];
+    NEXT;
+subu:
+    R[ip->rd] = R[ip->rs] - R[ip->rt];
+    NEXT;
+and:
+    R[ip->rd] = R[ip->rs] & R[ip->rt];
+    NEXT;
+or:
+    R[ip->rd] = R[ip->rs] | R[ip->rt];
+    NEXT;
+xor:
+    R[ip->rd] = R[ip->rs] ^ R[ip->rt];
+    NEXT;
+nor:
+    R[ip->rd] = ~(R[ip->rs] | R[ip->rt]);
+    NEXT;
+slt:
+    R[ip->rd] = (int32_t)R[ip->rs] < (int32_t)R[ip->rt];
+    NEXT;
+sltu:
+    R[ip->rd] = R[ip->rs] < R[ip->rt];
+    NEXT;
+
+mult: {
+    uint64_t product = (uint64_t)((int64_t)(int32_t)R[ip->rs] * (int64_t)(int32_t)R[ip->rt]);
+    c->HI = product >> 32;
+    c->LO = product;
+    NEXT;
+}
+multu: {
+    uint64_t product = (uint64_t)R[ip->rs] * R[ip->rt];
+    c->HI = product >> 32;
+    c->LO = product;
+    NEXT;
+}
+div: {
+    int32_t a = R[ip->rs], d = R[ip->rt];
+    if (d == 0) {
+        c->HI = c->LO = 0;
+    } else if (a == INT32_MIN && d == -1) {
+        c->HI = 0;
+        c->LO = a;
+    } else {
+        c->LO = a / d;
+        c->HI = a % d;
+    }
+    NEXT;
+}
+divu: {
+    uint32_t a = R[ip->rs], d = R[ip->rt];
+    if (d == 0) {
+        c->HI = c->LO = 0;
+    } else {
+        c->LO = a / d;
+        c->HI = a % d;
+    }
+    NEXT;
+}
+mfhi:
+    R[ip->rd] = c->HI;
+    NEXT;
+mflo:
+    R[ip->rd] = c->LO;
+    NEXT;
+mthi:
+    c->HI = R[ip->rs];
+    NEXT;
+mtlo:
+    c->LO = R[ip->rs];
+    NEXT;
+
+addiu:
+    R[ip->rd] = R[ip->rs] + ip->imm;
+    NEXT;
+slti:
+    R[ip->rd] = (int32_t)R[ip->rs] < (int32_t)ip->imm;
+    NEXT;
+sltiu:
+    R[ip->rd] = R[ip->rs] < ip->imm;
+    NEXT;
+andi:
+    R[ip->rd] = R[ip->rs] & ip->imm;
+    NEXT;
+ori:
+    R[ip->rd] = R[ip->rs] | ip->imm;
+    NEXT;
+xori:
+    R[ip->rd] = R[ip->rs] ^ ip->imm;
+    NEXT;
+lui:
+    R[ip->rd] = ip->imm;
+    NEXT;
+
+lw:
+    R[ip->rd] = func_read_word(c, R[ip->rs] + ip->imm);
+    NEXT;
+lh:
+    address = R[ip->rs] + ip->imm;
+    R[ip->rd] = (int16_t)(func_read_word(c, address) >> (8 * (address & 2)));
+    NEXT;
+lhu:
+    address = R[ip->rs] + ip->imm;
+    R[ip->rd] = (uint16_t)(func_read_word(c, address) >> (8 * (address & 2)));
+    NEXT;
+lb:
+    address = R[ip->rs] + ip->imm;
+    R[ip->rd] = (int8_t)(func_read_word(c, address) >> (8 * (address & 3)));
+    NEXT;
+lbu:
+    address = R[ip->rs] + ip->imm;
+    R[ip->rd] = (uint8_t)(func_read_word(c, address) >> (8 * (address & 3)));
+    NEXT;
+sw:
+    address = R[ip->rs] + ip->imm;
+    func_write_word(c, address, R[ip->rt]);
+    if (code_written(c, address)) {
+        goto exit_block;
+    }
+    NEXT;
+sh:
+    address = R[ip->rs] + ip->imm;
+    word = func_read_word(c, address) & ~(0xFFFFu << (8 * (address & 2)));
+    func_write_word(c, address, word | (R[ip->rt] & 0xFFFF) << (8 * (address & 2)));
+    if (code_written(c, address)) {
+        goto exit_block;
+    }
+    NEXT;
+sb:
+    address = R[ip->rs] + ip->imm;
+    word = func_read_word(c, address) & ~(0xFFu << (8 * (address & 3)));
+    func_write_word(c, address, word | (R[ip->rt] & 0xFF) << (8 * (address & 3)));
+    if (code_written(c, address)) {
+        goto exit_block;
+    }
+    NEXT;
+
+end:
+    taken = 0;
+    target = b->end;
+    goto follow;
+j:
+    taken = 1;
+    target = ip->imm;
+    goto follow;
+jal:
+    R[31] = b->end;
+    taken = 1;
+    target = ip->imm;
+    goto follow;
+jr:
+    taken = 1;
+    target = R[ip->rs];
+    goto follow;
+jalr:
+    taken = 1;
+    target = R[ip->rs];
+    R[ip->rd] = b->end;
+    goto follow;
+beq:
+    taken = R[ip->rs] == R[ip->rt];
+    goto branch;
+bne:
+    taken = R[ip->rs] != R[ip->rt];
+    goto branch;
+blez:
+    taken = (int32_t)R[ip->rs] <= 0;
+    goto branch;
+bgtz:
+    taken = (int32_t)R[ip->rs] > 0;
+    goto branch;
+bltz:
+    taken = (int32_t)R[ip->rs] < 0;
+    goto branch;
+bgez:
+    taken = (int32_t)R[ip->rs] >= 0;
+    goto branch;
+bltzal:
+    taken = (int32_t)R[ip->rs] < 0;
+    R[31] = b->end;
+    goto branch;
+bgezal:
+    taken = (int32_t)R[ip->rs] >= 0;
+    R[31] = b->end;
+    goto branch;
+branch:
+    target = taken ? ip->imm : b->end;
+    goto follow;
+
+out:
+    // the rest is shorter than the next block
+    while (remaining > 0 && !c->halted) {
+        func_step(c, &r);
+        remaining--;
+        if (r.mem_write && code_written(c, r.mem_addr)) {
+            interp_flush();
+        }
+    }
+    return n - remaining;
+
+#undef NEXT
+#undef NEXT_PC
+}
@@ -0,0 +1,31 @@
+#ifndef _INTERP_H_
+#define _INTERP_H_
+
+#include "functional.h"
+
+/**
+ * Threaded interpreter of the functional model, for fast-forwarding. Each
+ * basic block of text is translated once, on its first execution, into an
+ * array of handler addresses with their register numbers and immediates
+ * extracted, and runs by computed goto from one handler to the next. A block
+ * ends at a branch, a jump or after INTERP_BLOCK_LEN instructions; its last
+ * handler follows the successor it remembers for each way out, so blocks
+ * chain without a lookup except where a JR jumps somewhere new. Blocks are
+ * found by physical address, so the cores of a parallel program share them.
+ * A store to a 4 KB page holding translated code drops all translations and
+ * continues with the next instruction translated anew. Rare instructions (LL,
+ * SC, unknown encodings) run through func_step.
+ */
+
+// instructions of a block at most, not counting its branch or jump
+#define INTERP_BLOCK_LEN 64
+
+/* Run up to n instructions of c on its regions, stopping at the exit syscall.
+ * Returns the instructions executed. */
+uint64_t interp_run(FuncCore *c, uint64_t n);
+
+/* Drop all translations. Needed after memory holding code was written other
+ * than by interp_run. */
+void interp_flush();
+
+#endif
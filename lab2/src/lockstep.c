@@ -0,0 +1,149 @@
+#include "lockstep.h"
+#include "disasm.h"
+#include "functional.h"
+#include "mips.h"
+#include "shell.h"
+#include <stdio.h>
+#include <string.h>
+
+int lockstep_diverged;
+
+static FuncCore references[MAX_CORES];
+static uint8_t *shadow[FUNC_REGIONS];
+static int requested, running;
+
+int lockstep_start() {
+    if (stat_cycles > 0) {
+        return -1;
+    }
+    requested = 1;
+    return 0;
+}
+
+void lockstep_stop() {
+    requested = 0;
+    if (running) {
+        func_free_regions(shadow);
+        running = 0;
+    }
+    for (uint32_t core = 0; core < MAX_CORES; core++) {
+        pipes[core].reference = NULL;
+    }
+}
+
+void lockstep_begin() {
+    if (!requested) {
+        return;
+    }
+    requested = 0;
+    if (func_map_regions(shadow, 1) != 0) {
+        printf("Lockstep: can't copy the memory\n");
+        return;
+    }
+    running = 1;
+    lockstep_diverged = 0;
+
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Pipe_State *p = &pipes[core];
+        FuncCore *c = &references[core];
+        memcpy(c->REGS, p->REGS, sizeof(c->REGS));
+        c->HI = p->HI;
+        c->LO = p->LO;
+        c->PC = p->PC;
+        c->space = core_address(core, 0);
+        c->regions = shadow;
+        c->ll_valid = 0;
+        c->halted = p->halted;
+        p->reference = c;
+    }
+}
+
+// Bits of a store the pipeline wrote
+static uint32_t stored_value(const Pipe_Op *op) {
+    if (op->opcode == OP_SB) {
+        return op->mem_value & 0xFF;
+    }
+    if (op->opcode == OP_SH) {
+        return op->mem_value & 0xFFFF;
+    }
+    return op->mem_value;
+}
+
+// Print the retiring instruction the first time a check fails
+static void report(const Pipe_State *p, const Pipe_Op *op) {
+    char text[DISASM_LEN];
+    disassemble(op->instruction, op->pc, text, sizeof(text));
+    printf("Lockstep: core %u diverged from the functional model in cycle %u, retiring "
+           "instruction %u\n",
+           p->core, p->cycle, p->inst_retire + 1);
+    printf("  0x%08x  %08x  %s\n", op->pc, op->instruction, text);
+}
+
+// Compare a field of the op with the reference's, returns 1 if they differ
+static int check(const Pipe_State *p, const Pipe_Op *op, const char *what, uint32_t pipeline,
+                 uint32_t model) {
+    if (pipeline == model) {
+        return 0;
+    }
+    report(p, op);
+    printf("  %s: pipeline 0x%08x, model 0x%08x\n", what, pipeline, model);
+    return 1;
+}
+
+// Compare the register write of the op with the reference's
+static int check_write(const Pipe_State *p, const Pipe_Op *op, const FuncRecord *r) {
+    int dst = op->reg_dst > 0 ? op->reg_dst : -1;
+    if (dst == r->reg_dst && (dst < 0 || op->reg_dst_value == r->reg_value)) {
+        return 0;
+    }
+    report(p, op);
+    printf("  register write: pipeline ");
+    if (dst > 0) {
+        printf("$%d = 0x%08x", dst, op->reg_dst_value);
+    } else {
+        printf("none");
+    }
+    printf(", model ");
+    if (r->reg_dst > 0) {
+        printf("$%d = 0x%08x\n", r->reg_dst, r->reg_value);
+    } else {
+        printf("none\n");
+    }
+    return 1;
+}
+
+// Compare the retiring op with one step of the reference, returns 1 if they
+// differ
+static int differs(Pipe_State *p, const Pipe_Op *op) {
+    FuncCore *c = p->reference;
+    if (c->halted) {
+        report(p, op);
+        printf("  retired after the exit syscall at 0x%08x\n", c->PC);
+        return 1;
+    }
+    if (check(p, op, "PC", op->pc, c->PC)) {
+        return 1;
+    }
+
+    // an SC succeeds if the pipeline's did
+    if (op->opcode == OP_SC) {
+        c->ll_valid = op->reg_dst_value;
+        c->ll_addr = op->mem_addr & ~3u;
+    }
+    FuncRecord r;
+    func_step(c, &r);
+
+    int stored = op->mem_write && !(op->opcode == OP_SC && !op->reg_dst_value);
+    return check(p, op, "instruction word", op->instruction, r.instruction) ||
+           check_write(p, op, &r) ||
+           (op->is_mem && check(p, op, "memory address", op->mem_addr, r.mem_addr)) ||
+           check(p, op, "store done", stored, r.mem_write) ||
+           (stored && check(p, op, "store data", stored_value(op), r.mem_value));
+}
+
+void lockstep_retire(Pipe_State *p, const Pipe_Op *op) {
+    if (differs(p, op)) {
+        lockstep_diverged = 1;
+        p->reference = NULL;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef _LOCKSTEP_H_
+#define _LOCKSTEP_H_
+
+#include "pipe.h"
+
+/**
+ * Differential execution: each core has a functional reference (functional.h)
+ * with its own copy of memory, which executes an instruction whenever the
+ * pipeline retires one. WB compares the PC, the instruction word, the
+ * register written and the address and data of loads and stores; the first
+ * difference is reported with the cycle and the disassembly and halts the
+ * simulation. HI and LO are checked through the MFHI and MFLO that read them,
+ * as the pipeline writes them in execute. Whether an SC succeeds depends on
+ * the timing of other cores' stores, so the reference takes the pipeline's
+ * outcome. On cores sharing memory the references execute in retire order,
+ * which is the order the pipelines accessed memory in.
+ */
+
+/* Check the cores from the start of the next run, copying the machine state
+ * then. Returns -1 once the simulation has started. */
+int lockstep_start();
+
+/* Stop checking and drop the references */
+void lockstep_stop();
+
+/* Called by the shell before it runs cycles: starts a requested check */
+void lockstep_begin();
+
+// set once a core diverged from its reference, which halts the simulation
+extern int lockstep_diverged;
+
+/* Compare the op retiring in WB with the reference (p->reference is set) */
+void lockstep_retire(Pipe_State *p, const Pipe_Op *op);
+
+#endif
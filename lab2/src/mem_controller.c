@@ -1,27 +1,224 @@
 #include "mem_controller.h"
 #include "cache.h"
+#include "sched_policy.h"
 #include "stdio.h"
 #include <assert.h>
+#include <string.h>
 
-void init_memory_controller(MemController *mc, uint32_t queue_capacity) {
+// a command that has never been issued
+#define NEVER (-((int64_t)1 << 40))
+
+static const char *const row_policy_names[NUM_ROW_POLICIES] = {"open", "closed", "timeout",
+                                                               "adaptive"};
+static const char *const refresh_mode_names[NUM_REFRESH_MODES] = {"off", "all", "perbank"};
+
+static void init_timeline(Timeline *tl, uint32_t horizon) {
+    free(tl->bits);
+    tl->size = 64;
+    while (tl->size <= horizon) {
+        tl->size <<= 1;
+    }
+    tl->bits = (uint64_t *)calloc(tl->size / 64, sizeof(uint64_t));
+    tl->now = 0;
+}
+
+// Mask of the bits for cycles [start, start + len) that fall into the word
+// of start, *covered is set to the number of cycles in the mask
+static uint64_t range_mask(uint32_t start, uint32_t len, uint32_t *covered) {
+    uint32_t bit = start % 64;
+    uint32_t n = len < 64 - bit ? len : 64 - bit;
+    *covered = n;
+    return (n == 64 ? ~0ull : (1ull << n) - 1) << bit;
+}
+
+static uint64_t *timeline_word(Timeline *tl, uint32_t cycle) {
+    return &tl->bits[(cycle & (tl->size - 1)) / 64];
+}
+
+// 1 if no cycle in [start, start + len) is reserved
+static int timeline_is_free(Timeline *tl, uint32_t start, uint32_t len) {
+    assert(start >= tl->now && start + len - tl->now <= tl->size);
+    while (len) {
+        uint32_t n;
+        if (*timeline_word(tl, start) & range_mask(start, len, &n)) {
+            return 0;
+        }
+        start += n;
+        len -= n;
+    }
+    return 1;
+}
+
+static void timeline_reserve(Timeline *tl, uint32_t start, uint32_t len) {
+    assert(start >= tl->now && start + len - tl->now <= tl->size);
+    while (len) {
+        uint32_t n;
+        *timeline_word(tl, start) |= range_mask(start, len, &n);
+        start += n;
+        len -= n;
+    }
+}
+
+// Move the ring forward to cycle now, releasing the bits of past cycles
+static void timeline_advance(Timeline *tl, uint32_t now) {
+    uint32_t len = now - tl->now;
+    if (len >= tl->size) {
+        memset(tl->bits, 0, tl->size / 8);
+    } else {
+        uint32_t start = tl->now;
+        while (len) {
+            uint32_t n;
+            *timeline_word(tl, start) &= ~range_mask(start, len, &n);
+            start += n;
+            len -= n;
+        }
+    }
+    tl->now = now;
+}
+
+// reservations reach at most this far past the current cycle: the data
+// transfer of a request that needs all three commands
+static uint32_t timeline_horizon(const DramTiming *t) {
+    return t->tRP + t->tRCD + t->tCL + t->tBURST + t->tCMD;
+}
+
+// Reserve the command bus for a command in cycle, counting the busy cycles
+static void reserve_command(MemController *mc, uint32_t cycle) {
+    timeline_reserve(&mc->cmd_bus, cycle, mc->timing.tCMD);
+    mc->cmd_cycles += mc->timing.tCMD;
+}
+
+static void init_memory_controller(MemController *mc, uint32_t queue_capacity,
+                                   const DramTiming *timing, const AddressMap *map,
+                                   const SchedPolicy *sched) {
+    memset(mc, 0, sizeof(MemController));
     mc->queue = (MemRequest *)calloc(queue_capacity, sizeof(MemRequest));
     mc->queue_capacity = queue_capacity;
-    mc->queue_size = 0;
-    mc->cmd_bus_free_cycle = 0;
-    mc->data_bus_free_cycle = 0;
 
-    // Initialize all banks
-    mc->banks = (Bank *)calloc(NUM_BANKS, sizeof(Bank));
+    // all entries start out free
+    mc->free_list = NULL;
+    for (uint32_t i = queue_capacity; i-- > 0;) {
+        mc->queue[i].next = mc->free_list;
+        mc->free_list = &mc->queue[i];
+    }
+
+    // Initialize all banks and ranks, no command issued yet
+    mc->num_banks = map->count[MAP_RANK] * map->count[MAP_BANK_GROUP] * map->count[MAP_BANK];
+    mc->banks = (Bank *)calloc(mc->num_banks, sizeof(Bank));
+    mc->bank_service = (Histogram *)calloc(mc->num_banks, sizeof(Histogram));
+    for (uint32_t b = 0; b < mc->num_banks; b++) {
+        mc->banks[b].last_pre = NEVER;
+        mc->banks[b].last_act = NEVER;
+        mc->banks[b].last_rd = NEVER;
+        mc->banks[b].timeout = ROW_TIMEOUT_CYCLES;
+        mc->banks[b].refresh_from = NEVER;
+        mc->banks[b].refresh_until = NEVER;
+    }
+    mc->num_ranks = map->count[MAP_RANK];
+    mc->banks_per_rank = mc->num_banks / mc->num_ranks;
+    mc->ranks = (Rank *)calloc(mc->num_ranks, sizeof(Rank));
+    for (uint32_t r = 0; r < mc->num_ranks; r++) {
+        for (uint32_t i = 0; i < DRAM_CMD_HISTORY; i++) {
+            mc->ranks[r].acts.cycle[i] = NEVER;
+            mc->ranks[r].reads.cycle[i] = NEVER;
+        }
+    }
+
+    dram_timing_to_cycles(timing, &mc->timing);
+    init_timeline(&mc->cmd_bus, timeline_horizon(&mc->timing));
+    init_timeline(&mc->data_bus, timeline_horizon(&mc->timing));
+
+    mc->sched = sched;
+    sched->init(mc);
+}
+
+static void free_memory_controller(MemController *mc) {
+    free(mc->queue);
+    free(mc->cmd_bus.bits);
+    free(mc->data_bus.bits);
+    free(mc->banks);
+    free(mc->bank_service);
+    free(mc->ranks);
+}
+
+// Cycles between two refreshes of a rank
+static uint32_t refresh_interval(MemController *mc) {
+    if (mc->refresh_mode == REFRESH_PER_BANK) {
+        return mc->timing.tREFI / mc->banks_per_rank;
+    }
+    return mc->timing.tREFI;
+}
+
+// Select the refresh mode of a controller and restart the refresh schedule
+// of every rank from the current cycle
+static void init_refresh(MemController *mc, RefreshMode mode, uint8_t flexible) {
+    mc->refresh_mode = mode;
+    mc->refresh_flexible = flexible;
+    for (uint32_t r = 0; r < mc->num_ranks; r++) {
+        mc->ranks[r].next_refresh = mc->cmd_bus.now + refresh_interval(mc);
+        mc->ranks[r].refresh_credit = 0;
+        mc->ranks[r].next_bank = 0;
+    }
+    for (uint32_t b = 0; b < mc->num_banks; b++) {
+        mc->banks[b].refresh_pending = 0;
+    }
 }
 
-void free_memory_controller(MemController *mc) { free(mc->queue); }
+// 1 if the refresh mode needs parameters the timing lacks
+static int refresh_unsupported(const DramTiming *t, RefreshMode mode) {
+    return (mode != REFRESH_OFF && (t->tREFI == 0 || t->tRFC == 0)) ||
+           (mode == REFRESH_PER_BANK && t->tRFCpb == 0);
+}
+
+// (Re)build the channels for the current organization and timing
+static void build_channels(MemSystem *ms) {
+    ms->num_channels = ms->map.count[MAP_CHANNEL];
+    for (uint32_t c = 0; c < ms->num_channels; c++) {
+        init_memory_controller(&ms->channels[c], ms->queue_capacity, &ms->timing, &ms->map,
+                               ms->sched);
+        ms->channels[c].row_policy = ms->row_policy;
+        init_refresh(&ms->channels[c], ms->refresh_mode, ms->refresh_flexible);
+    }
+}
 
-static uint32_t get_bank_index(uint32_t address) {
-    return (address >> 5) & 0x7; // bits [7:5]
+void init_memory_system(MemSystem *ms, uint32_t queue_capacity) {
+    init_address_map(&ms->map);
+    ms->timing = *find_dram_preset(DRAM_TIMING_DEFAULT);
+    ms->sched = &sched_frfcfs;
+    ms->row_policy = ROW_POLICY_OPEN;
+    ms->refresh_mode = REFRESH_OFF;
+    ms->refresh_flexible = 0;
+    ms->queue_capacity = queue_capacity;
+    build_channels(ms);
+}
+
+void free_memory_system(MemSystem *ms) {
+    for (uint32_t c = 0; c < ms->num_channels; c++) {
+        free_memory_controller(&ms->channels[c]);
+    }
+    ms->num_channels = 0;
 }
 
-static uint32_t get_row_index(uint32_t address) {
-    return address >> 16; // bits [31:16]
+int set_dram_config(MemSystem *ms, const char *name) {
+    DramTiming timing;
+    AddressMap map = ms->map;
+    const DramTiming *preset = find_dram_preset(name);
+    if (preset) {
+        timing = *preset;
+    } else if (load_dram_config(name, &timing, &map) != 0) {
+        return -1;
+    }
+
+    free_memory_system(ms);
+    ms->timing = timing;
+    ms->map = map;
+    if (refresh_unsupported(&timing, ms->refresh_mode)) {
+        printf("DRAM timing %s has no %s refresh, refresh is off\n", timing.name,
+               refresh_mode_names[ms->refresh_mode]);
+        ms->refresh_mode = REFRESH_OFF;
+    }
+    build_channels(ms);
+    return 0;
 }
 
 static RowBufferStatus get_row_buffer_status(Bank *bank, uint32_t row) {
@@ -36,237 +233,564 @@ static RowBufferStatus get_row_buffer_status(Bank *bank, uint32_t row) {
     return ROW_BUFFER_CONFLICT;
 }
 
-// Check if a request can be scheduled in the current cycle
-static int is_request_schedulable(MemController *mc, MemRequest *req, uint32_t curr_cycle) {
-    assert(req->valid); // sanity check
-
-    uint32_t bank = get_bank_index(req->address);
-    uint32_t row = get_row_index(req->address);
-
-    RowBufferStatus rb_status = get_row_buffer_status(&mc->banks[bank], row);
-
-    // Determine timing sequence
-    uint8_t num_commands = 0;
-    switch (rb_status) {
+// Number of commands a request to row needs in the current state of bank
+static uint8_t get_num_commands(Bank *bank, uint32_t row) {
+    switch (get_row_buffer_status(bank, row)) {
     case ROW_BUFFER_HIT:
-        num_commands = 1; // READ/WRITE
-        break;
+        return 1; // READ/WRITE
     case ROW_BUFFER_MISS:
-        num_commands = 2; // ACTIVATE + READ/WRITE
-        break;
+        return 2; // ACTIVATE + READ/WRITE
     case ROW_BUFFER_CONFLICT:
-        num_commands = 3; // PRECHARGE + ACTIVATE + READ/WRITE
-        break;
-    }
-    assert(num_commands && num_commands <= 3);
-
-    // timing constraint example
-    //         ┌────┐            ┌────┐
-    // cmd-bus │CMD1│            │CMD2│
-    //         ├────┴────────────┼────┴────────────┐
-    // bank    │BANK_BUSY_CYCLES │BANK_BUSY_CYCLES │
-    //         └─────────────────┴─────────────────┼──────────────┐
-    // data-bus                                    │DATA_TF_CYCLES│
-    //                   ─────────────────► t      └──────────────┘
-
-    // ======================
-    // 1. is CMD bus available for our commands?
-
-    for (uint8_t our_cmd_nr = 0; our_cmd_nr < num_commands; our_cmd_nr++) {
-        // calculate start and end cycle for all the cmds we execute
-        uint32_t our_cmd_start = curr_cycle + our_cmd_nr * BANK_BUSY_CYCLES; // ~ 0, 100, 200
-        uint32_t our_cmd_end = our_cmd_start + CMD_CYCLES - 1;               // ~ 3, 103, 203
-
-        // check if any bank is scheduled to use the COMMAND bus
-        for (size_t b = 0; b < NUM_BANKS; b++) {
-
-            // skip timining constraint check if bank hasn't been used yet
-            // has_open_row=1 can be used as a proxy for this situation because rows are never
-            // closed due to row refreshes.
-            if (!mc->banks[b].has_open_row)
-                continue;
+        return 3; // PRECHARGE + ACTIVATE + READ/WRITE
+    }
+    assert(0);
+    return 0;
+}
+
+// 1 if no command in history lies closer to t than gap cycles, or gap_s
+// cycles for commands to another bank group
+static int spaced_from(const CommandHistory *h, int64_t t, uint32_t group, uint32_t gap,
+                       uint32_t gap_s) {
+    for (uint32_t i = 0; i < DRAM_CMD_HISTORY; i++) {
+        uint32_t g = h->group[i] == group ? gap : gap_s;
+        if (h->cycle[i] > t - g && h->cycle[i] < t + g) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
-            // check for overlaps with each other bank's scheduled commands' start and end
-            for (uint8_t sched_cmd = 0; sched_cmd < mc->banks[b].num_commands; sched_cmd++) {
-                uint32_t sched_cmd_start = mc->banks[b].req_start + sched_cmd * BANK_BUSY_CYCLES;
-                uint32_t sched_cmd_end = sched_cmd_start + CMD_CYCLES - 1;
+// 1 if an ACTIVATE at t keeps at most four ACTIVATEs in a tFAW window. Commands
+// may be planned out of order, so this conservatively counts all others within
+// tFAW of t.
+static int faw_allows(const CommandHistory *acts, int64_t t, uint32_t tFAW) {
+    uint32_t near = 0;
+    for (uint32_t i = 0; i < DRAM_CMD_HISTORY; i++) {
+        near += acts->cycle[i] > t - tFAW && acts->cycle[i] < t + tFAW;
+    }
+    return near < 4;
+}
 
-                // reject if our access overlaps with an already scheduled request's
-                // commands
-                if (!(our_cmd_end < sched_cmd_start || our_cmd_start > sched_cmd_end))
-                    return 0;
-            }
+// Replace the oldest command in history
+static void remember_command(CommandHistory *h, int64_t t, uint32_t group) {
+    uint32_t oldest = 0;
+    for (uint32_t i = 1; i < DRAM_CMD_HISTORY; i++) {
+        if (h->cycle[i] < h->cycle[oldest]) {
+            oldest = i;
         }
     }
+    h->cycle[oldest] = t;
+    h->group[oldest] = group;
+}
 
-    // ======================
-    // 2. is data bus free?
+// Cycles of the commands serving a request, -1 for commands it doesn't need
+typedef struct CommandPlan {
+    int64_t pre, act, rd;
+    int64_t data; // start of the data transfer
+} CommandPlan;
+
+// timing constraint example (row buffer conflict)
+//         ┌───┐     ┌───┐      ┌──┐
+// cmd-bus │PRE│     │ACT│      │RD│
+//         ├───┴─────┼───┴──────┼──┴──────┐
+// bank    │   tRP   │   tRCD   │   tCL   │
+//         └─────────┴──────────┴─────────┼────────┐
+// data-bus                               │ tBURST │
+//                   ─────────────────► t └────────┘
+//
+// Plan the commands of a request with its first command in cycle now. Returns 1
+// if the bank and rank timing constraints and the bus reservations allow it.
+static int plan_request(MemController *mc, MemRequest *req, uint32_t now, CommandPlan *p) {
+    assert(req->valid); // sanity check
 
-    // Data transfer 100 - 149
-    uint32_t data_tf_start = curr_cycle + num_commands * BANK_BUSY_CYCLES; // ~ 100, 200, 300
-    uint32_t data_tf_end = data_tf_start + DATA_TF_CYCLES - 1;             // ~ 149, 249, 349
+    const DramTiming *t = &mc->timing;
+    Bank *bank = &mc->banks[req->bank];
+    Rank *rank = &mc->ranks[req->rank];
+    RowBufferStatus rb_status = get_row_buffer_status(bank, req->row);
+    int64_t cmd = now;
+    p->pre = p->act = -1;
 
-    // check if any other bank is scheduled to use the DATA bus
-    for (size_t b = 0; b < NUM_BANKS; b++) {
+    // a refresh of the bank runs or waits for the bank's earlier commands
+    if (bank->refresh_pending || now < bank->refresh_until)
+        return 0;
 
-        // skip timining constraint check if bank hasn't been used yet
-        if (!mc->banks[b].has_open_row)
-            continue;
+    // the lab model serves one request per bank at a time
+    if (t->serialize_banks && now < bank->busy_until)
+        return 0;
 
-        // shared data bus will be used when banks are done processing commands:
-        uint32_t sched_tf_start =
-            mc->banks[b].req_start + mc->banks[b].num_commands * BANK_BUSY_CYCLES;
-        uint32_t sched_tf_end = sched_tf_start + DATA_TF_CYCLES - 1;
+    if (rb_status == ROW_BUFFER_CONFLICT) {
+        // PRECHARGE the open row
+        if (cmd < bank->last_act + t->tRAS || cmd < bank->last_rd + t->tRTP)
+            return 0;
+        p->pre = cmd;
+        cmd += t->tRP;
+    }
 
-        // reject if the scheduled transfers would overlap with ours
-        //      |sched_start      sched_end|
-        // end  |                          | start
-        if (!(data_tf_end < sched_tf_start || data_tf_start > sched_tf_end))
+    if (rb_status != ROW_BUFFER_HIT) {
+        // ACTIVATE our row
+        if (cmd < bank->last_pre + t->tRP || cmd < bank->last_act + t->tRC ||
+            !spaced_from(&rank->acts, cmd, req->group, t->tRRD, t->tRRD_S) ||
+            !faw_allows(&rank->acts, cmd, t->tFAW))
             return 0;
+        p->act = cmd;
+        cmd += t->tRCD;
+    } else if (cmd < bank->last_act + t->tRCD) {
+        // the row is still being opened for an earlier request
+        return 0;
     }
 
-    // ======================
-    // 3. is the bank free?
-    uint32_t req_end = curr_cycle + num_commands * BANK_BUSY_CYCLES - 1;
+    // READ
+    if (!spaced_from(&rank->reads, cmd, req->group, t->tCCD, t->tCCD_S))
+        return 0;
+    p->rd = cmd;
+    p->data = cmd + t->tCL;
 
-    // ensure no overlap between bank scheduled start and end
-    uint32_t sched_start = mc->banks[bank].req_start;
-    uint32_t sched_end = sched_start + mc->banks[bank].num_commands * BANK_BUSY_CYCLES - 1;
+    // is CMD bus available for our commands?
+    int64_t cmds[3] = {p->pre, p->act, p->rd};
+    for (int i = 0; i < 3; i++) {
+        if (cmds[i] >= 0 && !timeline_is_free(&mc->cmd_bus, cmds[i], t->tCMD))
+            return 0;
+    }
 
-    // check for overlap
-    if (mc->banks[bank].open_row && !(req_end < sched_start || curr_cycle > sched_end))
-        return 0;
+    // is data bus free?
+    return timeline_is_free(&mc->data_bus, p->data, t->tBURST);
+}
 
-    return 1;
+static void list_append(RequestList *l, MemRequest *req) {
+    req->next = NULL;
+    if (l->tail) {
+        l->tail->next = req;
+    } else {
+        l->head = req;
+    }
+    l->tail = req;
+}
+
+// Insert in service order, requests mostly arrive in order so this appends
+static void list_insert(RequestList *l, MemRequest *req) {
+    if (l->tail == NULL || !request_before(req, l->tail)) {
+        list_append(l, req);
+        return;
+    }
+
+    MemRequest **link = &l->head;
+    while (!request_before(req, *link)) {
+        link = &(*link)->next;
+    }
+    req->next = *link;
+    *link = req;
+}
+
+static void list_remove(RequestList *l, MemRequest *req) {
+    MemRequest **link = &l->head, *prev = NULL;
+    while (*link != req) {
+        prev = *link;
+        link = &prev->next;
+    }
+    *link = req->next;
+    if (l->tail == req) {
+        l->tail = prev;
+    }
+}
+
+static RequestList *bank_list_for(Bank *bank, uint32_t row) {
+    return get_row_buffer_status(bank, row) == ROW_BUFFER_HIT ? &bank->hits : &bank->others;
+}
+
+// Re-split the requests of a bank after its open row changed, merging the
+// two lists keeps them in service order
+static void rebucket_bank(Bank *bank) {
+    MemRequest *a = bank->hits.head, *b = bank->others.head;
+    bank->hits.head = bank->hits.tail = NULL;
+    bank->others.head = bank->others.tail = NULL;
+
+    while (a || b) {
+        MemRequest *req;
+        if (b == NULL || (a && !request_before(b, a))) {
+            req = a;
+            a = a->next;
+        } else {
+            req = b;
+            b = b->next;
+        }
+        list_append(bank_list_for(bank, req->row), req);
+    }
 }
 
-// Select best request to schedule using FR-FCFS policy
+// Select the request the scheduling policy ranks first among those that can
+// issue in the current cycle
 static MemRequest *select_request_to_schedule(MemController *mc, uint32_t current_cycle) {
+    const SchedPolicy *policy = mc->sched;
     MemRequest *best = NULL;
+    int best_is_hit = 0;
 
-    // check all the requests in the queue
-    for (uint32_t i = 0; i < mc->queue_capacity; i++) {
-        // only consider requests that have arrived in DRAM
-        if (!mc->queue[i].valid || current_cycle < mc->queue[i].arrival_cycle)
-            continue;
+    // the requests of a bank list share their row buffer status and so their
+    // timing, only the list head needs a command plan
+    for (uint32_t b = 0; b < mc->num_banks; b++) {
+        MemRequest *heads[2] = {mc->banks[b].hits.head, mc->banks[b].others.head};
 
-        if (!is_request_schedulable(mc, &mc->queue[i], current_cycle))
-            continue;
+        for (int h = 0; h < 2; h++) {
+            MemRequest *req = heads[h];
 
-        if (best == NULL) {
-            best = &mc->queue[i];
-            continue;
+            // only consider requests that have arrived in DRAM
+            if (req == NULL || current_cycle < req->arrival_cycle)
+                continue;
+
+            CommandPlan plan;
+            if (!plan_request(mc, req, current_cycle, &plan))
+                continue;
+
+            // lists are in arrival order, so later entries have arrived only
+            // as long as this one has
+            int is_hit = (h == 0);
+            for (; req && req->arrival_cycle <= current_cycle;
+                 req = policy->scan_all ? req->next : NULL) {
+                if (best == NULL ||
+                    policy->before(mc, req, is_hit, best, best_is_hit, current_cycle)) {
+                    best = req;
+                    best_is_hit = is_hit;
+                }
+            }
         }
+    }
 
-        uint32_t best_bank = get_bank_index(best->address);
-        uint32_t best_row = get_row_index(best->address);
-        uint32_t curr_bank = get_bank_index(mc->queue[i].address);
-        uint32_t curr_row = get_row_index(mc->queue[i].address);
+    return best;
+}
 
-        int best_is_hit =
-            (mc->banks[best_bank].has_open_row && mc->banks[best_bank].open_row == best_row);
-        int curr_is_hit =
-            (mc->banks[curr_bank].has_open_row && mc->banks[curr_bank].open_row == curr_row);
+// Adaptive row policy: a conflict means the row was held open too long, a miss
+// to the row the bank closed last means it was closed too early
+static void adapt_row_timeout(Bank *bank, MemRequest *req, RowBufferStatus status) {
+    if (status == ROW_BUFFER_CONFLICT) {
+        bank->timeout = bank->timeout / 2 < ROW_TIMEOUT_MIN ? 0 : bank->timeout / 2;
+    } else if (status == ROW_BUFFER_MISS && bank->has_closed_row && bank->closed_row == req->row) {
+        uint32_t longer = bank->timeout == 0 ? ROW_TIMEOUT_MIN : 2 * bank->timeout;
+        bank->timeout = longer < ROW_TIMEOUT_MAX ? longer : ROW_TIMEOUT_MAX;
+    }
+}
 
-        // Priority 1: Row buffer hits over misses
-        if (curr_is_hit && !best_is_hit) {
-            best = &mc->queue[i];
-        } else if (best_is_hit && !curr_is_hit) {
+// Close the open row of a bank with a PRECHARGE in cycle pre
+static void close_row(Bank *bank, int64_t pre) {
+    bank->last_pre = pre;
+    bank->has_open_row = 0;
+    bank->closed_row = bank->open_row;
+    bank->has_closed_row = 1;
+}
+
+// Close the row after a read with auto-precharge if the row policy asks for
+// it and no queued request needs the row. The precharge takes no command bus
+// slot, it starts as soon as tRTP and tRAS allow.
+static void auto_precharge(MemController *mc, Bank *bank) {
+    const DramTiming *t = &mc->timing;
+    int close = mc->row_policy == ROW_POLICY_CLOSED ||
+                (mc->row_policy == ROW_POLICY_ADAPTIVE && bank->timeout == 0);
+    if (!close || bank->hits.head != NULL) {
+        return;
+    }
+
+    int64_t pre = bank->last_rd + t->tRTP;
+    if (pre < bank->last_act + t->tRAS) {
+        pre = bank->last_act + t->tRAS;
+    }
+    close_row(bank, pre);
+    mc->auto_precharges++;
+}
+
+// Timeout row policies: PRECHARGE a row that no queued request needs once it
+// has been idle for the timeout. The command bus takes one per cycle.
+static void precharge_idle_rows(MemController *mc, uint32_t now) {
+    const DramTiming *t = &mc->timing;
+    for (uint32_t b = 0; b < mc->num_banks; b++) {
+        Bank *bank = &mc->banks[b];
+        uint32_t timeout =
+            mc->row_policy == ROW_POLICY_TIMEOUT ? ROW_TIMEOUT_CYCLES : bank->timeout;
+        if (!bank->has_open_row || bank->hits.head != NULL || now < bank->last_rd + timeout ||
+            now < bank->last_rd + t->tRTP || now < bank->last_act + t->tRAS ||
+            (t->serialize_banks && now < bank->busy_until))
             continue;
+
+        if (timeline_is_free(&mc->cmd_bus, now, t->tCMD)) {
+            reserve_command(mc, now);
+            close_row(bank, now);
+            mc->timeout_precharges++;
         }
-        // Priority 2: Earlier arrival time
-        else if (mc->queue[i].arrival_cycle < best->arrival_cycle) {
-            best = &mc->queue[i];
-        } else if (mc->queue[i].arrival_cycle == best->arrival_cycle) {
-            // Priority 3: From MEM stage over fetch
-            if (mc->queue[i].from_mem_stage && !best->from_mem_stage) {
-                best = &mc->queue[i];
-            }
+        return;
+    }
+}
+
+// 1 if no request is queued for banks [first, first + n)
+static int banks_idle(MemController *mc, uint32_t first, uint32_t n) {
+    for (uint32_t b = first; b < first + n; b++) {
+        if (mc->banks[b].hits.head || mc->banks[b].others.head) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Issue the pending refresh of banks [first, first + n) once their earlier
+// commands and the command bus allow it: a PRECHARGE of the open rows in
+// cycle now, then the REFRESH when the rows are closed. Returns 1 if issued.
+static int start_refresh(MemController *mc, Rank *rank, uint32_t first, uint32_t n,
+                         uint32_t now) {
+    const DramTiming *t = &mc->timing;
+    int any_open = 0;
+    for (uint32_t b = first; b < first + n; b++) {
+        Bank *bank = &mc->banks[b];
+        if (now < bank->last_rd + t->tRTP || now < bank->last_act + t->tRAS ||
+            (t->serialize_banks && now < bank->busy_until))
+            return 0;
+        any_open |= bank->has_open_row;
+    }
+
+    int64_t ref = now + (any_open ? t->tRP : 0);
+    for (uint32_t b = first; b < first + n; b++) {
+        if (ref < mc->banks[b].last_pre + t->tRP || ref < mc->banks[b].refresh_until)
+            return 0;
+    }
+    if ((any_open && !timeline_is_free(&mc->cmd_bus, now, t->tCMD)) ||
+        !timeline_is_free(&mc->cmd_bus, ref, t->tCMD))
+        return 0;
+
+    if (any_open) {
+        reserve_command(mc, now);
+    }
+    reserve_command(mc, ref);
+
+    uint32_t tRFC = mc->refresh_mode == REFRESH_PER_BANK ? t->tRFCpb : t->tRFC;
+    for (uint32_t b = first; b < first + n; b++) {
+        Bank *bank = &mc->banks[b];
+        if (bank->has_open_row) {
+            bank->last_pre = now;
+            bank->has_open_row = 0;
+            rebucket_bank(bank);
         }
+        bank->refresh_pending = 0;
+        bank->refresh_until = ref + tRFC;
+        mc->refresh_bank_cycles += bank->refresh_until - bank->refresh_from;
     }
 
-    return best;
+    mc->refreshes_pulled_in += rank->refresh_credit >= 0;
+    rank->refresh_credit++;
+    rank->next_bank = (rank->next_bank + 1) % mc->banks_per_rank;
+    mc->refreshes++;
+    return 1;
 }
 
-// Schedule and issue DRAM commands for a request
-static void issue_dram_request(MemController *mc, MemRequest *req, uint32_t current_cycle) {
-    uint32_t bank_idx = get_bank_index(req->address);
-    uint32_t row = get_row_index(req->address);
-    Bank *bank = &mc->banks[bank_idx];
+// Refresh each rank once per interval. A refresh that is due holds its banks
+// from taking new requests until it issues. Flexible refresh postpones it while
+// the banks have queued requests and pulls refreshes in while they have none.
+static void refresh_cycle(MemController *mc, uint32_t now) {
+    uint32_t interval = refresh_interval(mc);
+    for (uint32_t r = 0; r < mc->num_ranks; r++) {
+        Rank *rank = &mc->ranks[r];
+        while (now >= rank->next_refresh) {
+            rank->next_refresh += interval;
+            mc->refreshes_postponed += rank->refresh_credit < 0;
+            rank->refresh_credit--;
+        }
 
-    RowBufferStatus rb_status = get_row_buffer_status(bank, row);
+        // banks the next refresh of the rank covers
+        uint32_t first = r * mc->banks_per_rank, n = mc->banks_per_rank;
+        if (mc->refresh_mode == REFRESH_PER_BANK) {
+            first += rank->next_bank;
+            n = 1;
+        }
 
-    switch (rb_status) {
-    case ROW_BUFFER_HIT:
-        bank->num_commands = 1;
-        break;
-    case ROW_BUFFER_MISS:
-        bank->num_commands = 2;
-        break;
-    case ROW_BUFFER_CONFLICT:
-        bank->num_commands = 3;
-        break;
+        if (!mc->banks[first].refresh_pending) {
+            int due;
+            if (!mc->refresh_flexible) {
+                due = rank->refresh_credit < 0;
+            } else if (banks_idle(mc, first, n)) {
+                due = rank->refresh_credit < REFRESH_MAX_PULL_IN;
+            } else {
+                due = rank->refresh_credit < -REFRESH_MAX_POSTPONE;
+            }
+            if (!due) {
+                continue;
+            }
+            for (uint32_t b = first; b < first + n; b++) {
+                mc->banks[b].refresh_pending = 1;
+                mc->banks[b].refresh_from = now;
+            }
+        }
+        start_refresh(mc, rank, first, n, now);
     }
+}
 
-    assert(bank->num_commands >= 1 && bank->num_commands <= 3);
+// Schedule and issue DRAM commands for a request
+static void issue_dram_request(MemController *mc, MemRequest *req, uint32_t current_cycle) {
+    const DramTiming *t = &mc->timing;
+    Bank *bank = &mc->banks[req->bank];
+
+    CommandPlan plan;
+    int ok = plan_request(mc, req, current_cycle, &plan);
+    assert(ok);
+
+    RowBufferStatus rb_status = get_row_buffer_status(bank, req->row);
+    int is_hit = rb_status == ROW_BUFFER_HIT;
+    list_remove(is_hit ? &bank->hits : &bank->others, req);
+
+    // time the request waited for the last refresh of its bank
+    int64_t refresh_from = bank->refresh_from > req->arrival_cycle ? bank->refresh_from
+                                                                   : req->arrival_cycle;
+    if (bank->refresh_until > refresh_from) {
+        mc->refresh_delayed++;
+        mc->refresh_delay += bank->refresh_until - refresh_from;
+    }
+    mc->row_status[rb_status]++;
+    req->mshr->row_conflict = rb_status == ROW_BUFFER_CONFLICT;
+    if (mc->row_policy == ROW_POLICY_ADAPTIVE) {
+        adapt_row_timeout(bank, req, rb_status);
+    }
 
-    // Update bus and bank states
+    // Reserve the buses for our commands and data transfer, update bank and
+    // rank command history
+    bank->num_commands = get_num_commands(bank, req->row);
+    if (plan.pre >= 0) {
+        reserve_command(mc, plan.pre);
+        bank->last_pre = plan.pre;
+    }
+    if (plan.act >= 0) {
+        reserve_command(mc, plan.act);
+        bank->last_act = plan.act;
+        remember_command(&mc->ranks[req->rank].acts, plan.act, req->group);
+    }
+    reserve_command(mc, plan.rd);
+    bank->last_rd = plan.rd;
+    remember_command(&mc->ranks[req->rank].reads, plan.rd, req->group);
+    timeline_reserve(&mc->data_bus, plan.data, t->tBURST);
+    mc->reads++;
+    mc->data_cycles += t->tBURST;
+
+    // Update bank state
+    int row_changed = !bank->has_open_row || bank->open_row != req->row;
     bank->req_start = current_cycle;
+    bank->busy_until = plan.data;
     bank->has_open_row = 1;
-    bank->open_row = row;
+    bank->open_row = req->row;
+    bank->hit_streak = is_hit ? bank->hit_streak + 1 : 0;
+    if (row_changed) {
+        rebucket_bank(bank);
+    }
+    auto_precharge(mc, bank);
 
     // Calculate when fill will be complete
     // Data arrives at L2 after data transfer + latency back to L2
-    uint32_t fill_complete_cycle = current_cycle + bank->num_commands * BANK_BUSY_CYCLES +
-                                   DATA_TF_CYCLES + MEM_TO_L2_LATENCY + L2_TO_MEM_LATENCY;
+    uint32_t fill_complete_cycle =
+        plan.data + t->tBURST + MEM_TO_L2_LATENCY + L2_TO_MEM_LATENCY;
 
     // Update MSHR
-    req->mshr->fill_ready_cycle = fill_complete_cycle;
+    schedule_mshr_fill(req->mshr, fill_complete_cycle);
+
+    mc->sched->on_issue(mc, req, plan.data + t->tBURST - current_cycle, current_cycle);
+    histogram_record(&mc->latency[req->source], fill_complete_cycle - req->arrival_cycle);
+    histogram_record(&mc->queue_delay, current_cycle - req->arrival_cycle);
+    histogram_record(&mc->bank_service[req->bank], plan.data + t->tBURST - current_cycle);
+
+    // requests are issued in cycle order, so the cycles some bank is busy are
+    // the union of [issue, end of burst) of the requests
+    int64_t end = plan.data + t->tBURST;
+    int64_t from = mc->banks_active_until > current_cycle ? mc->banks_active_until : current_cycle;
+    if (end > from) {
+        mc->banks_active_cycles += end - from;
+        mc->banks_active_until = end;
+    }
 }
 
-void memory_controller_cycle(MemController *mc, uint32_t current_cycle) {
-    // First, check for L2 hits that are ready this cycle
-    for (size_t i = 0; i < NUM_MSHR; i++) {
-        if (mshrs[i].valid && !mshrs[i].done) {
-            if (mshrs[i].fill_ready_cycle > 0 && current_cycle >= mshrs[i].fill_ready_cycle) {
-                printf("Marking fill as done\r\n");
-                // Fill is ready - mark MSHR as done
-                mshrs[i].done = 1;
+int set_row_policy(MemSystem *ms, const char *name) {
+    for (int p = 0; p < NUM_ROW_POLICIES; p++) {
+        if (strcmp(name, row_policy_names[p]) == 0) {
+            ms->row_policy = p;
+            for (uint32_t c = 0; c < ms->num_channels; c++) {
+                ms->channels[c].row_policy = p;
             }
+            return 0;
         }
     }
+    return -1;
+}
 
-    // Add new L2 misses to memory request queue
-    for (size_t i = 0; i < NUM_MSHR; i++) {
-        if (mshrs[i].valid && !mshrs[i].done && mshrs[i].fill_ready_cycle == 0) {
-            // Found unqueued L2 miss -> queue it
-            printf("found L2 miss\r\n");
-
-            // Find free queue slot
-            int queued = 0;
-            for (uint32_t j = 0; j < mc->queue_capacity; j++) {
-                if (!mc->queue[j].valid) {
-                    mc->queue[j].address = mshrs[i].address;
-                    mc->queue[j].arrival_cycle = current_cycle;
-                    mc->queue[j].from_mem_stage = (mshrs[i].is_icache == 1) ? 0 : 1;
-                    mc->queue[j].mshr = &mshrs[i];
-                    mc->queue[j].valid = 1;
-                    mc->queue_size++;
-                    queued = 1;
-
-                    // Mark MSHR with impossible nonzero value so we don't queue it again
-                    mshrs[i].fill_ready_cycle = 1;
-                    break;
-                }
-            }
+int set_refresh_mode(MemSystem *ms, const char *name) {
+    // an optional -flex suffix
+    size_t len = strlen(name);
+    uint8_t flexible = len > 5 && strcmp(name + len - 5, "-flex") == 0;
+    if (flexible) {
+        len -= 5;
+    }
 
-            if (!queued) {
-                // should never happen with infinite queue
-                printf("Couldn't add L2 miss to mem queue\r\n");
-                assert(0);
-            }
+    for (int m = 0; m < NUM_REFRESH_MODES; m++) {
+        if (strlen(refresh_mode_names[m]) != len || strncmp(name, refresh_mode_names[m], len)) {
+            continue;
         }
+        if (refresh_unsupported(&ms->timing, m)) {
+            printf("DRAM timing %s has no %s refresh\n", ms->timing.name, refresh_mode_names[m]);
+            return -1;
+        }
+        ms->refresh_mode = m;
+        ms->refresh_flexible = flexible;
+        for (uint32_t c = 0; c < ms->num_channels; c++) {
+            init_refresh(&ms->channels[c], m, flexible);
+        }
+        return 0;
+    }
+    return -1;
+}
+
+int set_mem_scheduler(MemSystem *ms, const char *name) {
+    const SchedPolicy *policy = find_sched_policy(name);
+    if (policy == NULL) {
+        return -1;
+    }
+    ms->sched = policy;
+    for (uint32_t c = 0; c < ms->num_channels; c++) {
+        ms->channels[c].sched = policy;
+        policy->init(&ms->channels[c]);
+    }
+    return 0;
+}
+
+// Queue a memory miss at the controller of its channel
+static void enqueue_request(MemController *mc, MSHR *mshr, const AddressMap *map,
+                            const DramAddress *addr, uint32_t current_cycle) {
+    // Take a free queue slot
+    MemRequest *req = mc->free_list;
+    if (req == NULL) {
+        // should never happen with infinite queue
+        printf("Couldn't add L2 miss to mem queue\r\n");
+        assert(0);
+    }
+    mc->free_list = req->next;
+
+    req->address = mshr->address;
+    req->rank = addr->field[MAP_RANK];
+    req->group = addr->field[MAP_BANK_GROUP];
+    req->bank = (req->rank * map->count[MAP_BANK_GROUP] + req->group) * map->count[MAP_BANK] +
+                addr->field[MAP_BANK];
+    req->row = addr->field[MAP_ROW];
+    req->arrival_cycle = current_cycle + mshr->mem_delay;
+    req->from_mem_stage = (mshr->is_icache == 1) ? 0 : 1;
+    req->source =
+        MEM_SOURCE(mshr->core, req->from_mem_stage ? MEM_SOURCE_MEM : MEM_SOURCE_FETCH);
+    req->marked = 0;
+    req->mshr = mshr;
+    req->valid = 1;
+    mc->queue_size++;
+
+    Bank *bank = &mc->banks[req->bank];
+    list_insert(bank_list_for(bank, req->row), req);
+}
+
+// Issue the next request of one channel
+static void memory_controller_cycle(MemController *mc, uint32_t current_cycle) {
+    histogram_record(&mc->queue_occupancy, mc->queue_size);
+    mc->queue_full_cycles += mc->queue_size == mc->queue_capacity;
+
+    timeline_advance(&mc->cmd_bus, current_cycle);
+    timeline_advance(&mc->data_bus, current_cycle);
+    if (mc->refresh_mode != REFRESH_OFF) {
+        refresh_cycle(mc, current_cycle);
     }
+    mc->sched->on_cycle(mc, current_cycle);
 
     // Try to schedule a request
     MemRequest *to_schedule = select_request_to_schedule(mc, current_cycle);
@@ -277,14 +801,197 @@ void memory_controller_cycle(MemController *mc, uint32_t current_cycle) {
 
         // Remove from queue
         to_schedule->valid = 0;
+        to_schedule->next = mc->free_list;
+        mc->free_list = to_schedule;
         mc->queue_size--;
     }
 
-    // Process completed fills
-    for (uint32_t i = 0; i < mc->queue_capacity; i++) {
-        if (mc->queue[i].valid && mc->queue[i].mshr->done) {
-            // Fill is complete - insert into L2 cache
-            insert_l2_block(mc->queue[i].address);
+    if (mc->row_policy == ROW_POLICY_TIMEOUT || mc->row_policy == ROW_POLICY_ADAPTIVE) {
+        precharge_idle_rows(mc, current_cycle);
+    }
+}
+
+void memory_system_cycle(MemSystem *ms, uint32_t current_cycle) {
+    // First, check for L2 hits and memory fills that are ready this cycle
+    MSHR *mshr;
+    while ((mshr = next_due_fill(current_cycle)) != NULL) {
+        if (mshr->writeback) {
+            // the next level took the block, or memory wrote it
+            if (mshr->lower) {
+                cache_insert_block(mshr->lower, mshr->address);
+            }
+            free_mshr(mshr);
+            continue;
         }
+
+        printf("Marking fill as done\r\n");
+        // Fill is ready - mark MSHR as done
+        mshr->done = 1;
+
+        // install the block in the lower levels that missed
+        fill_lower_levels(mshr);
     }
-}
\ No newline at end of file
+
+    // Add new L2 misses to the request queue of their channel
+    while ((mshr = next_mem_miss()) != NULL) {
+        printf("found L2 miss\r\n");
+
+        DramAddress addr;
+        map_address(&ms->map, mshr->address, &addr);
+        enqueue_request(&ms->channels[addr.field[MAP_CHANNEL]], mshr, &ms->map, &addr,
+                        current_cycle);
+    }
+
+    for (uint32_t c = 0; c < ms->num_channels; c++) {
+        memory_controller_cycle(&ms->channels[c], current_cycle);
+    }
+}
+
+void print_memory_stats(MemSystem *ms, uint32_t cycles) {
+    static const char *const stage_names[MEM_SOURCES_PER_CORE] = {"fetch", "mem"};
+
+    print_dram_timing(&ms->channels[0].timing);
+    print_address_map(&ms->map);
+    printf("DRAM scheduler: %s, row policy: %s, refresh: %s%s\n", ms->sched->name,
+           row_policy_names[ms->row_policy], refresh_mode_names[ms->refresh_mode],
+           ms->refresh_flexible ? " (flexible)" : "");
+    for (uint32_t c = 0; c < ms->num_channels; c++) {
+        MemController *mc = &ms->channels[c];
+        double busy = cycles ? (double)mc->data_cycles / cycles : 0;
+        // bytes per ns of core time
+        double gbps = cycles ? (double)mc->reads * BLOCK_SIZE * 1000 / cycles / CPU_CLOCK_PS : 0;
+        printf("Channel %u: %u reads, data bus %.1f%% busy, %.2f GB/s\n", c, mc->reads,
+               100 * busy, gbps);
+
+        double reads = mc->reads ? mc->reads : 1;
+        printf("  row hits %.1f%%, misses %.1f%%, conflicts %.1f%%, precharges %u auto, "
+               "%u timeout\n",
+               100 * mc->row_status[ROW_BUFFER_HIT] / reads,
+               100 * mc->row_status[ROW_BUFFER_MISS] / reads,
+               100 * mc->row_status[ROW_BUFFER_CONFLICT] / reads, mc->auto_precharges,
+               mc->timeout_precharges);
+        if (mc->refresh_mode != REFRESH_OFF) {
+            // share of bank time lost to refresh, and the wait of delayed requests
+            double bank_cycles = cycles ? (double)cycles * mc->num_banks : 1;
+            printf("  refreshes %u (%u postponed, %u pulled in), banks blocked %.2f%%, "
+                   "%u requests delayed %.1f cycles on average\n",
+                   mc->refreshes, mc->refreshes_postponed, mc->refreshes_pulled_in,
+                   100 * mc->refresh_bank_cycles / bank_cycles, mc->refresh_delayed,
+                   mc->refresh_delayed ? (double)mc->refresh_delay / mc->refresh_delayed : 0);
+        }
+
+        print_histogram("  queueing delay", "requests", &mc->queue_delay);
+        for (uint32_t b = 0; b < mc->num_banks; b++) {
+            if (mc->bank_service[b].count) {
+                char name[32];
+                snprintf(name, sizeof(name), "  bank %u service", b);
+                print_histogram(name, "requests", &mc->bank_service[b]);
+            }
+        }
+    }
+
+    // sources are named by their core once other cores than core 0 made requests
+    int multicore = 0;
+    for (uint32_t c = 0; c < ms->num_channels; c++) {
+        for (uint32_t s = MEM_SOURCES_PER_CORE; s < MAX_MEM_SOURCES; s++) {
+            multicore |= ms->channels[c].latency[s].count != 0;
+        }
+    }
+
+    // latencies of all channels per source; unfairness is the ratio of the
+    // worst to the best mean latency
+    double worst = 0, best = 0;
+    for (uint32_t s = 0; s < MAX_MEM_SOURCES; s++) {
+        Histogram st = {0};
+        for (uint32_t c = 0; c < ms->num_channels; c++) {
+            histogram_merge(&st, &ms->channels[c].latency[s]);
+        }
+        if (st.count == 0) {
+            continue;
+        }
+
+        char name[16];
+        const char *stage = stage_names[s % MEM_SOURCES_PER_CORE];
+        if (multicore) {
+            snprintf(name, sizeof(name), "core%u %s", s / MEM_SOURCES_PER_CORE, stage);
+        } else {
+            snprintf(name, sizeof(name), "%s", stage);
+        }
+
+        double mean = (double)st.sum / st.count;
+        worst = mean > worst ? mean : worst;
+        best = best == 0 || mean < best ? mean : best;
+        printf("DRAM latency %-5s: %u requests, mean %.1f, p50 %u, p90 %u, p99 %u, max %u\n",
+               name, st.count, mean, histogram_percentile(&st, 0.5),
+               histogram_percentile(&st, 0.9), histogram_percentile(&st, 0.99), st.max);
+    }
+    if (best > 0) {
+        printf("DRAM unfairness (max/min mean latency): %.2f\n", worst / best);
+    }
+}
+
+// Cycles the banks of a channel served requests, summed over the banks
+static uint64_t bank_busy_cycles(const MemController *mc) {
+    uint64_t busy = 0;
+    for (uint32_t b = 0; b < mc->num_banks; b++) {
+        busy += mc->bank_service[b].sum;
+    }
+    return busy;
+}
+
+void print_memory_controller_stats(MemSystem *ms) {
+    for (uint32_t c = 0; c < ms->num_channels; c++) {
+        const MemController *mc = &ms->channels[c];
+        const Histogram *q = &mc->queue_occupancy;
+        double cycles = q->count ? q->count : 1;
+        uint64_t busy = bank_busy_cycles(mc);
+
+        printf("Channel %u: %u cycles, queue of %u, %u banks\n", c, q->count, mc->queue_capacity,
+               mc->num_banks);
+        printf("  queue occupancy: mean %.2f, p50 %u, p95 %u, p99 %u, max %u, full %u cycles\n",
+               q->sum / cycles, histogram_percentile(q, 0.5), histogram_percentile(q, 0.95),
+               histogram_percentile(q, 0.99), q->max, mc->queue_full_cycles);
+        printf("  bank-level parallelism: %.2f banks busy while any is (%.1f%% of cycles), "
+               "%.2f on average\n",
+               mc->banks_active_cycles ? (double)busy / mc->banks_active_cycles : 0,
+               100 * mc->banks_active_cycles / cycles, busy / cycles);
+        printf("  command bus %.1f%% busy, data bus %.1f%% busy\n", 100 * mc->cmd_cycles / cycles,
+               100 * mc->data_cycles / cycles);
+        printf("  row buffer: %u hits, %u misses, %u conflicts\n", mc->row_status[ROW_BUFFER_HIT],
+               mc->row_status[ROW_BUFFER_MISS], mc->row_status[ROW_BUFFER_CONFLICT]);
+    }
+}
+
+void write_memory_controller_json(MemSystem *ms, FILE *out) {
+    fprintf(out, "{\"channels\": [");
+    for (uint32_t c = 0; c < ms->num_channels; c++) {
+        const MemController *mc = &ms->channels[c];
+        const Histogram *q = &mc->queue_occupancy;
+        double cycles = q->count ? q->count : 1;
+        uint64_t busy = bank_busy_cycles(mc);
+
+        fprintf(out, "%s\n  {\"channel\": %u, \"cycles\": %u,\n", c ? "," : "", c, q->count);
+        fprintf(out,
+                "   \"queue\": {\"capacity\": %u, \"mean\": %.4f, \"p50\": %u, \"p95\": %u, "
+                "\"p99\": %u, \"max\": %u, \"full_cycles\": %u},\n",
+                mc->queue_capacity, q->sum / cycles, histogram_percentile(q, 0.5),
+                histogram_percentile(q, 0.95), histogram_percentile(q, 0.99), q->max,
+                mc->queue_full_cycles);
+        fprintf(out,
+                "   \"banks\": {\"count\": %u, \"busy_cycles\": %llu, \"active_cycles\": %llu, "
+                "\"parallelism_active\": %.4f, \"parallelism\": %.4f},\n",
+                mc->num_banks, (unsigned long long)busy,
+                (unsigned long long)mc->banks_active_cycles,
+                mc->banks_active_cycles ? (double)busy / mc->banks_active_cycles : 0,
+                busy / cycles);
+        fprintf(out,
+                "   \"cmd_bus\": {\"busy_cycles\": %u, \"utilization\": %.4f},\n"
+                "   \"data_bus\": {\"busy_cycles\": %u, \"utilization\": %.4f},\n",
+                mc->cmd_cycles, mc->cmd_cycles / cycles, mc->data_cycles,
+                mc->data_cycles / cycles);
+        fprintf(out, "   \"row_buffer\": {\"hits\": %u, \"misses\": %u, \"conflicts\": %u}}",
+                mc->row_status[ROW_BUFFER_HIT], mc->row_status[ROW_BUFFER_MISS],
+                mc->row_status[ROW_BUFFER_CONFLICT]);
+    }
+    fprintf(out, "\n]}\n");
+}
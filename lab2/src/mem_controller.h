@@ -1,57 +1,237 @@
 #ifndef _MEM_CONTROLLER_H_
 #define _MEM_CONTROLLER_H_
 
+#include "dram_timing.h"
+#include "histogram.h"
 #include "pipe.h"
 #include <stdint.h>
+#include <stdio.h>
 
-// DRAM timing constants (in cycles)
-#define CMD_CYCLES 4
-#define BANK_BUSY_CYCLES 100
-#define DATA_TF_CYCLES 50
-
+// controller <-> L2 latencies (in cycles), DRAM timing is set at runtime
 #define L2_TO_MEM_LATENCY 5
 #define MEM_TO_L2_LATENCY 5
 
+// requesters the controller tells apart for scheduling and latency stats:
+// the fetch and MEM stage of each core
+#define MEM_SOURCE_FETCH 0
+#define MEM_SOURCE_MEM 1
+#define MEM_SOURCES_PER_CORE 2
+#define MAX_MEM_SOURCES (MEM_SOURCES_PER_CORE * MAX_CORES)
+#define MEM_SOURCE(core, stage) ((core) * MEM_SOURCES_PER_CORE + (stage))
+
+// cycles an idle row stays open under the timeout policies, and the range the
+// adaptive policy moves its per-bank timeout in (0 = precharge with the read)
+#define ROW_TIMEOUT_CYCLES 200
+#define ROW_TIMEOUT_MIN 50
+#define ROW_TIMEOUT_MAX 3200
+
+// refreshes a rank may fall behind or get ahead of schedule with flexible
+// refresh
+#define REFRESH_MAX_POSTPONE 8
+#define REFRESH_MAX_PULL_IN 8
+
+// recent ACTIVATE and READ commands of a rank remembered for tRRD, tFAW and tCCD
+#define DRAM_CMD_HISTORY 8
+
 typedef enum { ROW_BUFFER_HIT, ROW_BUFFER_MISS, ROW_BUFFER_CONFLICT } RowBufferStatus;
 
+// When a bank closes its open row
+typedef enum {
+    ROW_POLICY_OPEN,     // only when another row is needed
+    ROW_POLICY_CLOSED,   // auto-precharge with the read unless a queued request hits the row
+    ROW_POLICY_TIMEOUT,  // ROW_TIMEOUT_CYCLES after the last read
+    ROW_POLICY_ADAPTIVE, // per-bank timeout: halved on conflicts, doubled when a closed
+                         // row is needed again, 0 = auto-precharge
+    NUM_ROW_POLICIES
+} RowPolicy;
+
+typedef enum {
+    REFRESH_OFF,
+    REFRESH_ALL_BANK, // every tREFI, all banks of a rank for tRFC
+    REFRESH_PER_BANK, // every tREFI / banks, one bank of a rank in turn for tRFCpb
+    NUM_REFRESH_MODES
+} RefreshMode;
+
+// Occupancy of a shared resource over the next cycles, one bit per cycle in
+// a ring buffer. Reservations never reach further ahead than the ring size.
+typedef struct Timeline {
+    uint64_t *bits;
+    uint32_t size; // power of two number of cycles
+    uint32_t now;  // bits of cycles before now are kept clear
+} Timeline;
+
+struct MemRequest;
+
+// List of queued requests, ordered by arrival (MEM stage first among equals)
+typedef struct RequestList {
+    struct MemRequest *head, *tail;
+} RequestList;
+
+// Recent commands of one kind issued to a rank
+typedef struct CommandHistory {
+    int64_t cycle[DRAM_CMD_HISTORY];
+    uint32_t group[DRAM_CMD_HISTORY]; // bank group of each command
+} CommandHistory;
+
+typedef struct Rank {
+    CommandHistory acts;
+    CommandHistory reads;
+
+    int64_t next_refresh;   // end of the current refresh interval
+    int32_t refresh_credit; // refreshes done ahead of schedule, negative = owed
+    uint32_t next_bank;     // bank of the rank the next per-bank refresh covers
+} Rank;
+
 // DRAM bank state
 typedef struct Bank {
     uint32_t req_start;   // cycle when bank started serving the request
+    uint32_t busy_until;  // first cycle the bank can start a new request (serialize_banks)
+    int64_t last_pre;     // cycles of the bank's latest commands, may lie ahead
+    int64_t last_act;
+    int64_t last_rd;
     uint32_t open_row;    // currently open row (-1 if closed)
     uint8_t has_open_row; // 1 if row buffer has valid row
     uint8_t num_commands; // 1, 2, or 3, number of cmds for req
+    uint32_t hit_streak;  // row hits served in a row since the last miss
+    uint32_t timeout;     // idle cycles before the row is closed (adaptive policy)
+    uint32_t closed_row;  // row last closed by the row policy
+    uint8_t has_closed_row;
+    uint8_t refresh_pending; // refresh waits for the bank, which takes no new requests
+    int64_t refresh_from;    // cycle the last refresh became pending
+    int64_t refresh_until;   // cycle the last refresh ends
+
+    // queued requests for this bank, split by row buffer status
+    RequestList hits;   // to the open row
+    RequestList others; // to any other row
 } Bank;
 
 // Memory request in queue
 typedef struct MemRequest {
     uint32_t address;
-    uint32_t arrival_cycle; // cycle when request arrived in DRAM
-    uint8_t from_mem_stage; // 1 if from MEM stage, 0 if from fetch
-    MSHR *mshr;             // pointer to associated MSHR
-    uint8_t valid;          // 1 if entry valid
+    uint32_t rank, group;    // rank and bank group in the channel
+    uint32_t bank, row;      // bank index in the channel, row in the bank
+    uint32_t arrival_cycle;  // cycle when request arrived in DRAM
+    uint8_t from_mem_stage;  // 1 if from MEM stage, 0 if from fetch
+    uint32_t source;         // MEM_SOURCE() of the requesting core and stage
+    uint8_t marked;          // 1 if part of the current PAR-BS batch
+    MSHR *mshr;              // pointer to associated MSHR
+    uint8_t valid;           // 1 if entry valid
+    struct MemRequest *next; // next request in its bank list or the free list
 } MemRequest;
 
-// Memory controller state
+// State of the scheduling policies that track requesters over time
+typedef struct SchedState {
+    uint32_t rank[MAX_MEM_SOURCES];         // PAR-BS and ATLAS priority, 0 = highest
+    uint32_t marked;                        // PAR-BS requests of the batch still queued
+    double attained[MAX_MEM_SOURCES];       // ATLAS service this quantum
+    double total_attained[MAX_MEM_SOURCES]; // ATLAS service of past quanta, decayed
+    uint32_t quantum_end;                   // ATLAS cycle the ranks are recomputed in
+    uint32_t last_source, streak;           // BLISS requests of one source in a row
+    uint8_t blacklisted[MAX_MEM_SOURCES];   // BLISS sources deprioritized
+    uint32_t clear_at;                      // BLISS cycle the blacklist is cleared in
+} SchedState;
+
+// Memory controller of one channel
 typedef struct MemController {
-    MemRequest *queue;            // request queue (dynamically allocated)
-    uint32_t queue_capacity;      // max queue size
-    uint32_t queue_size;          // current number of requests
-    uint32_t cmd_bus_free_cycle;  // cycle when cmd/addr bus becomes free
-    uint32_t data_bus_free_cycle; // cycle when data bus becomes free
-    Bank *banks;
+    MemRequest *queue;       // request queue (dynamically allocated)
+    MemRequest *free_list;   // unused queue entries
+    uint32_t queue_capacity; // max queue size
+    uint32_t queue_size;     // current number of requests
+    Timeline cmd_bus;        // cycles the cmd/addr bus is reserved
+    Timeline data_bus;       // cycles the data bus is reserved
+    Bank *banks;             // ranks * bank groups * banks of the channel
+    uint32_t num_banks;
+    Rank *ranks;
+    uint32_t num_ranks;
+    uint32_t banks_per_rank;
+    DramTiming timing; // in core cycles
+
+    const struct SchedPolicy *sched;
+    SchedState sched_state;
+    RowPolicy row_policy;
+    RefreshMode refresh_mode;
+    uint8_t refresh_flexible; // 1 = postpone refreshes while busy, pull them in while idle
+
+    // statistics
+    uint32_t reads;       // requests served
+    uint32_t data_cycles; // cycles the data bus transferred data
+    uint32_t row_status[3];      // requests served per RowBufferStatus
+    uint32_t auto_precharges;    // rows closed by a read with auto-precharge
+    uint32_t timeout_precharges; // rows closed by a PRECHARGE after a timeout
+    uint32_t refreshes;
+    uint32_t refreshes_postponed; // refresh intervals that ended with a refresh owed
+    uint32_t refreshes_pulled_in; // refreshes done ahead of schedule
+    uint64_t refresh_bank_cycles; // bank cycles blocked by pending or running refreshes
+    uint32_t refresh_delayed;     // requests that waited for a refresh
+    uint64_t refresh_delay;       // cycles they waited for it
+    Histogram latency[MAX_MEM_SOURCES]; // arrival to fill per source
+    Histogram queue_delay;              // arrival to issue
+    Histogram *bank_service;            // per bank, issue to the end of the data burst
+
+    // per cycle accounting (memstats)
+    Histogram queue_occupancy;    // requests queued, one value per cycle
+    uint32_t queue_full_cycles;   // cycles the queue was full
+    uint32_t cmd_cycles;          // cycles the command bus carried a command
+    uint64_t banks_active_cycles; // cycles at least one bank served a request
+    int64_t banks_active_until;   // end of the last request served, for banks_active_cycles
 } MemController;
 
-void init_memory_controller(MemController *mc, uint32_t queue_capacity);
+// DRAM channels and the mapping of addresses onto them
+typedef struct MemSystem {
+    AddressMap map;
+    DramTiming timing; // in DRAM clocks, as selected
+    const struct SchedPolicy *sched;
+    RowPolicy row_policy;
+    RefreshMode refresh_mode;
+    uint8_t refresh_flexible;
+    uint32_t queue_capacity;
+    uint32_t num_channels;
+    MemController channels[MAX_CHANNELS];
+} MemSystem;
+
+/* Set up the lab organization and timing with queues of queue_capacity
+ * requests per channel */
+void init_memory_system(MemSystem *ms, uint32_t queue_capacity);
+
+void free_memory_system(MemSystem *ms);
 
-void free_memory_controller(MemController *mc);
+/* Select DRAM timing by preset name, or timing and organization from a file
+ * (see dram_timing.h), and rebuild the channels. Returns 0 on success. Use
+ * before the program runs. */
+int set_dram_config(MemSystem *ms, const char *name);
+
+/* Select the row buffer policy of all channels by name (open, closed,
+ * timeout, adaptive), returns -1 for an unknown policy */
+int set_row_policy(MemSystem *ms, const char *name);
+
+/* Select the refresh mode of all channels by name (off, all, perbank), a
+ * "-flex" suffix enables postponing and pulling in refreshes. Returns -1 for
+ * an unknown mode or one the DRAM timing doesn't support. */
+int set_refresh_mode(MemSystem *ms, const char *name);
+
+/* Select the request scheduling policy of all channels by name (see
+ * sched_policy.h), returns -1 for an unknown policy */
+int set_mem_scheduler(MemSystem *ms, const char *name);
 
 /**
- * Simulate one cycle of memory controller operation.
- * This processes pending requests, issues DRAM commands, handles fills.
+ * Simulate one cycle of the memory system.
+ * This handles fills, routes new misses to their channel and lets each
+ * channel's controller issue DRAM commands.
  */
-void memory_controller_cycle(MemController *mc, uint32_t current_cycle);
+void memory_system_cycle(MemSystem *ms, uint32_t current_cycle);
+
+/* Print timing, organization and per-channel bandwidth utilization over
+ * the first cycles cycles, and request latencies and fairness per source */
+void print_memory_stats(MemSystem *ms, uint32_t cycles);
+
+/* Print the per cycle accounting of each channel: queue occupancy, bank-level
+ * parallelism, command and data bus utilization and row buffer outcomes */
+void print_memory_controller_stats(MemSystem *ms);
+
+/* Write the same accounting to out as JSON */
+void write_memory_controller_json(MemSystem *ms, FILE *out);
 
-// Decl. of global instances
-extern MSHR mshrs[NUM_MSHR];
+// the memory system behind the caches (pipe.c)
+extern MemSystem mem_system;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "mshr.h"
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+MSHR mshrs[NUM_MSHR];
+
+static MSHR *buckets[MSHR_HASH_SIZE];
+static uint64_t free_map[MSHR_WORDS];    // bit set = entry free
+static uint64_t mem_miss_map[MSHR_WORDS]; // bit set = memory miss not yet queued
+
+// min-heap of entries waiting for their fill, each entry is in it at most once
+static MSHR *fill_heap[NUM_MSHR];
+static uint32_t fill_heap_size;
+
+static uint32_t mshr_index(MSHR *mshr) { return mshr - mshrs; }
+
+static uint32_t hash_block(uint32_t block_addr) {
+    // multiplicative hash, the high product bits mix all address bits
+    return ((block_addr * 2654435761u) >> 16) % MSHR_HASH_SIZE;
+}
+
+// Lowest set bit of a bitmap, removed from it. Returns -1 if empty.
+static int take_lowest(uint64_t *map) {
+    for (uint32_t w = 0; w < MSHR_WORDS; w++) {
+        if (map[w]) {
+            int bit = __builtin_ctzll(map[w]);
+            map[w] &= map[w] - 1;
+            return w * 64 + bit;
+        }
+    }
+    return -1;
+}
+
+static void set_bit(uint64_t *map, uint32_t i) { map[i / 64] |= 1ull << (i % 64); }
+
+void init_mshrs() {
+    memset(mshrs, 0, sizeof(mshrs));
+    memset(buckets, 0, sizeof(buckets));
+    memset(free_map, 0, sizeof(free_map));
+    memset(mem_miss_map, 0, sizeof(mem_miss_map));
+    for (uint32_t i = 0; i < NUM_MSHR; i++) {
+        set_bit(free_map, i);
+    }
+    fill_heap_size = 0;
+}
+
+MSHR *find_mshr(uint32_t block_addr, uint8_t core) {
+    for (MSHR *m = buckets[hash_block(block_addr)]; m; m = m->hash_next) {
+        if (m->address == block_addr && m->core == core && !m->writeback) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+MSHR *find_writeback(uint32_t block_addr) {
+    for (MSHR *m = buckets[hash_block(block_addr)]; m; m = m->hash_next) {
+        if (m->address == block_addr && m->writeback) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+MSHR *allocate_mshr(uint32_t block_addr, uint8_t core, uint8_t is_icache) {
+    int i = take_lowest(free_map);
+    if (i < 0) {
+        return NULL;
+    }
+
+    MSHR *mshr = &mshrs[i];
+    memset(mshr, 0, sizeof(MSHR));
+    mshr->address = block_addr;
+    mshr->valid = 1;
+    mshr->is_icache = is_icache;
+    mshr->core = core;
+
+    uint32_t b = hash_block(block_addr);
+    mshr->hash_next = buckets[b];
+    buckets[b] = mshr;
+    return mshr;
+}
+
+uint32_t mshrs_in_use() {
+    uint32_t free_entries = 0;
+    for (uint32_t w = 0; w < MSHR_WORDS; w++) {
+        free_entries += __builtin_popcountll(free_map[w]);
+    }
+    return NUM_MSHR - free_entries;
+}
+
+void free_mshr(MSHR *mshr) {
+    assert(mshr->valid);
+
+    MSHR **link = &buckets[hash_block(mshr->address)];
+    while (*link != mshr) {
+        link = &(*link)->hash_next;
+    }
+    *link = mshr->hash_next;
+
+    mshr->valid = 0;
+    mshr->done = 0;
+    set_bit(free_map, mshr_index(mshr));
+}
+
+// heap order: earlier fill first, lower index first among equal cycles
+static int fill_before(MSHR *a, MSHR *b) {
+    if (a->fill_ready_cycle != b->fill_ready_cycle) {
+        return a->fill_ready_cycle < b->fill_ready_cycle;
+    }
+    return a < b;
+}
+
+void schedule_mshr_fill(MSHR *mshr, uint32_t cycle) {
+    assert(mshr->fill_ready_cycle == 0 && fill_heap_size < NUM_MSHR);
+    mshr->fill_ready_cycle = cycle;
+
+    // sift up
+    uint32_t i = fill_heap_size++;
+    while (i > 0 && fill_before(mshr, fill_heap[(i - 1) / 2])) {
+        fill_heap[i] = fill_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    fill_heap[i] = mshr;
+}
+
+MSHR *next_due_fill(uint32_t cycle) {
+    if (fill_heap_size == 0 || fill_heap[0]->fill_ready_cycle > cycle) {
+        return NULL;
+    }
+
+    MSHR *top = fill_heap[0];
+    MSHR *last = fill_heap[--fill_heap_size];
+
+    // sift the last entry down from the root
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= fill_heap_size) {
+            break;
+        }
+        if (child + 1 < fill_heap_size && fill_before(fill_heap[child + 1], fill_heap[child])) {
+            child++;
+        }
+        if (!fill_before(fill_heap[child], last)) {
+            break;
+        }
+        fill_heap[i] = fill_heap[child];
+        i = child;
+    }
+    fill_heap[i] = last;
+    return top;
+}
+
+void add_mem_miss(MSHR *mshr) {
+    mshr->mem_miss = 1;
+    set_bit(mem_miss_map, mshr_index(mshr));
+}
+
+MSHR *next_mem_miss() {
+    int i = take_lowest(mem_miss_map);
+    return i < 0 ? NULL : &mshrs[i];
+}
@@ -0,0 +1,82 @@
+#ifndef _MSHR_H_
+#define _MSHR_H_
+
+#include <stdint.h>
+
+// number of outstanding misses below the L1s, override with
+// make DEFINES=-DNUM_MSHR=128 for memory-level parallelism studies
+#ifndef NUM_MSHR
+#define NUM_MSHR 16
+#endif
+
+// hash buckets for block address lookups, load factor <= 1/2
+#define MSHR_HASH_SIZE (2 * NUM_MSHR)
+#define MSHR_WORDS ((NUM_MSHR + 63) / 64)
+
+struct Cache;
+
+// Miss status holding registers of the levels below the L1s
+typedef struct MSHR {
+    uint32_t address;
+    uint8_t valid;             // 1 = entry in use, 0 = free
+    uint8_t done;              // 1 = memory fill ready, 0 = still waiting
+    uint32_t fill_ready_cycle; // cycle when fill will be ready, 0 = not yet known
+    uint8_t is_icache;         // 1 if for icache, 0 if for dcache
+    uint8_t core;              // core whose L1 missed
+    uint8_t mem_miss;          // 1 if the fill comes from memory
+    uint8_t row_conflict;      // 1 if its DRAM access found another row open
+    uint8_t writeback;         // 1 if it carries a dirty block down, freed once written
+    uint32_t mem_delay;        // lookup latency of the levels below the first one missed
+    struct Cache *lower;       // first level probed after the L1 miss
+    struct Cache *source;      // level supplying the block, NULL = memory
+    struct MSHR *hash_next;    // next entry in the same hash bucket
+} MSHR;
+
+/**
+ * The MSHRs are indexed three ways so no per-cycle operation scans all
+ * NUM_MSHR entries:
+ *  - a hash table from block address to entry for lookups,
+ *  - a min-heap of entries with a known fill cycle, ordered by
+ *    (fill_ready_cycle, index), so due fills pop off the top,
+ *  - bitmaps of free entries and of memory misses not yet queued at the
+ *    memory controller, scanned a word at a time in index order.
+ */
+
+/* Reset all MSHRs to free */
+void init_mshrs();
+
+/* Entry tracking a miss of a core's L1s on the block at block_addr, NULL if
+ * none. Misses of different cores never merge, each core waits for its own
+ * fill. */
+MSHR *find_mshr(uint32_t block_addr, uint8_t core);
+
+/* Entry writing the block at block_addr back from any core's L1, NULL if none */
+MSHR *find_writeback(uint32_t block_addr);
+
+/* Claim the lowest numbered free entry for a miss of a core's L1 on block_addr,
+ * NULL if all are in use */
+MSHR *allocate_mshr(uint32_t block_addr, uint8_t core, uint8_t is_icache);
+
+/* Release an entry */
+void free_mshr(MSHR *mshr);
+
+/* Number of entries in use */
+uint32_t mshrs_in_use();
+
+/* Set the cycle the fill of an entry is ready in */
+void schedule_mshr_fill(MSHR *mshr, uint32_t cycle);
+
+/* Pop the entry with the earliest fill ready by cycle, NULL if none is due */
+MSHR *next_due_fill(uint32_t cycle);
+
+/* Mark an entry as missing in every level, it is queued at the memory
+ * controller in its next cycle */
+void add_mem_miss(MSHR *mshr);
+
+/* Pop the lowest numbered memory miss not yet queued, NULL if none */
+MSHR *next_mem_miss();
+
+// Decl. of global instances used by mem_controller.c and cache.c
+extern MSHR mshrs[NUM_MSHR];
+
+#endif
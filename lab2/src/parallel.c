@@ -0,0 +1,114 @@
+#include "parallel.h"
+#include "pipe.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+static EventQueue queues[MAX_CORES];
+
+static pthread_t threads[MAX_CORES];
+static uint32_t num_threads; // 0 = not started
+static pthread_barrier_t start_barrier, done_barrier;
+
+// cycles of the quantum being run, and whether the threads should exit
+static uint32_t quantum_first, quantum_end;
+static int stopping;
+
+static void *core_thread(void *arg) {
+    Pipe_State *p = arg;
+    for (;;) {
+        pthread_barrier_wait(&start_barrier);
+        if (stopping) {
+            return NULL;
+        }
+        for (uint32_t cycle = quantum_first; cycle < quantum_end; cycle++) {
+            p->cycle = cycle;
+            pipe_core_cycle(p);
+        }
+        pthread_barrier_wait(&done_barrier);
+    }
+}
+
+// Make room for the events of a quantum, only while the queue is empty
+static void reserve_queue(EventQueue *q, uint32_t events) {
+    if (q->size >= events) {
+        return;
+    }
+    assert(atomic_load(&q->head) == atomic_load(&q->tail));
+
+    uint32_t size = 1;
+    while (size < events) {
+        size *= 2;
+    }
+    free(q->events);
+    q->events = malloc(size * sizeof(CoreEvent));
+    assert(q->events);
+    q->size = size;
+    atomic_store(&q->head, 0);
+    atomic_store(&q->tail, 0);
+}
+
+static void start_core_threads(uint32_t cores) {
+    pthread_barrier_init(&start_barrier, NULL, cores + 1);
+    pthread_barrier_init(&done_barrier, NULL, cores + 1);
+    stopping = 0;
+    for (uint32_t core = 0; core < cores; core++) {
+        pthread_create(&threads[core], NULL, core_thread, &pipes[core]);
+    }
+    num_threads = cores;
+}
+
+void stop_core_threads() {
+    if (num_threads == 0) {
+        return;
+    }
+    stopping = 1;
+    pthread_barrier_wait(&start_barrier);
+    for (uint32_t core = 0; core < num_threads; core++) {
+        pthread_join(threads[core], NULL);
+    }
+    pthread_barrier_destroy(&start_barrier);
+    pthread_barrier_destroy(&done_barrier);
+    num_threads = 0;
+}
+
+void run_core_threads(uint32_t cores, uint32_t first, uint32_t end) {
+    if (num_threads != cores) {
+        stop_core_threads();
+        start_core_threads(cores);
+    }
+    for (uint32_t core = 0; core < cores; core++) {
+        reserve_queue(&queues[core], CORE_EVENTS_PER_CYCLE * (end - first));
+    }
+
+    // the barriers order the threads' simulation against ours
+    quantum_first = first;
+    quantum_end = end;
+    pthread_barrier_wait(&start_barrier);
+    pthread_barrier_wait(&done_barrier);
+}
+
+void post_core_event(uint32_t core, const CoreEvent *ev) {
+    EventQueue *q = &queues[core];
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    assert(tail - atomic_load_explicit(&q->head, memory_order_acquire) < q->size);
+
+    q->events[tail & (q->size - 1)] = *ev;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+int take_core_event(uint32_t core, uint32_t cycle, CoreEvent *ev) {
+    EventQueue *q = &queues[core];
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&q->tail, memory_order_acquire)) {
+        return 0;
+    }
+
+    const CoreEvent *next = &q->events[head & (q->size - 1)];
+    if (next->cycle > cycle) {
+        return 0;
+    }
+    *ev = *next;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return 1;
+}
@@ -0,0 +1,58 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// largest quantum of cycles the cores run ahead of the shared levels
+#define MAX_QUANTUM 100000
+
+// events a core posts per cycle at most: fetch and MEM each free the MSHR of
+// a cancelled miss and then miss again
+#define CORE_EVENTS_PER_CYCLE 4
+
+typedef enum {
+    CORE_EVENT_MISS,   // an L1 missed, probe the levels below
+    CORE_EVENT_RELEASE // an L1 miss completed or was cancelled, free its MSHR
+} CoreEventKind;
+
+// Request of a core to the shared levels, replayed in the cycle it was made
+typedef struct CoreEvent {
+    uint32_t cycle;
+    uint32_t address;
+    uint8_t kind;
+    uint8_t is_icache;
+} CoreEvent;
+
+// Lock-free ring of events from one producer (the core's thread) to one
+// consumer (the thread simulating the shared levels)
+typedef struct EventQueue {
+    CoreEvent *events;
+    uint32_t size;         // power of two number of slots
+    _Atomic uint32_t head; // next event to consume, advanced by the consumer
+    _Atomic uint32_t tail; // next free slot, advanced by the producer
+} EventQueue;
+
+/**
+ * Host threads running the cores. Each core runs on its own thread for a
+ * quantum of cycles, its requests to the shared levels go into its event
+ * queue; the calling thread then replays the queued events in cycle order
+ * against the shared caches, MSHRs and memory controllers.
+ */
+
+/* Run cycles [first, end) of each of cores cores on its own thread, calling
+ * pipe_core_cycle, and return once all of them are done. Starts the threads
+ * on first use. */
+void run_core_threads(uint32_t cores, uint32_t first, uint32_t end);
+
+/* Join the threads, the next run starts them again */
+void stop_core_threads();
+
+/* Queue an event of a core, from the core's thread */
+void post_core_event(uint32_t core, const CoreEvent *ev);
+
+/* Take the next event of a core if it was made in cycle or earlier,
+ * returns 0 if there is none */
+int take_core_event(uint32_t core, uint32_t cycle, CoreEvent *ev);
+
+#endif
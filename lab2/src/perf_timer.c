@@ -0,0 +1,62 @@
+#include "perf_timer.h"
+
+#ifdef PERF_TIMERS
+
+#include <stdio.h>
+#include <time.h>
+
+uint64_t perf_ticks[NUM_PERF_COMPONENTS];
+
+static uint64_t start_ticks;
+static double start_sec;
+
+static double wall_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void start_perf_timers() {
+    start_ticks = perf_now();
+    start_sec = wall_sec();
+}
+
+// Peak resident set of the simulator in KB, 0 if unknown. VmHWM belongs to the
+// address space, unlike ru_maxrss which an exec inherits from the parent.
+static long peak_rss_kb() {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    char line[128];
+    long kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+void print_perf_timers() {
+    double secs = wall_sec() - start_sec;
+    double ticks = perf_now() - start_ticks;
+    double share[NUM_PERF_COMPONENTS];
+    for (int i = 0; i < NUM_PERF_COMPONENTS; i++) {
+        share[i] = ticks > 0 ? 100 * perf_ticks[i] / ticks : 0;
+    }
+    // the cache accesses happen within the cores' time
+    printf("Host time: %.3f s, pipeline %.1f%%, caches %.1f%%, memory %.1f%%, other %.1f%%, "
+           "peak RSS %ld KB\n",
+           secs, share[PERF_CORES] - share[PERF_CACHES], share[PERF_CACHES], share[PERF_MEMORY],
+           100 - share[PERF_CORES] - share[PERF_MEMORY], peak_rss_kb());
+}
+
+#else
+
+void start_perf_timers() {}
+
+void print_perf_timers() {}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef _PERF_TIMER_H_
+#define _PERF_TIMER_H_
+
+#include <stdint.h>
+
+// Components of the simulator whose host time is measured
+typedef enum {
+    PERF_CORES,  // pipeline stages of all cores, including their cache accesses
+    PERF_CACHES, // L1 lookups, the lower levels they probe, MSHR releases
+    PERF_MEMORY, // memory system cycle: fills, memory controllers, DRAM
+    NUM_PERF_COMPONENTS
+} PerfComponent;
+
+/**
+ * Host timers, built into the simulator with -DPERF_TIMERS (make perfbench)
+ * and compiled out otherwise. They read the time stamp counter, a few cycles
+ * per timer, and convert ticks to seconds with the wall clock time since
+ * start_perf_timers(). The components are timed in the calling thread only,
+ * so they are meaningless with parallel simulation.
+ */
+
+#ifdef PERF_TIMERS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t perf_now() { return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t perf_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+extern uint64_t perf_ticks[NUM_PERF_COMPONENTS];
+
+#define PERF_START(t) uint64_t t = perf_now()
+#define PERF_STOP(component, t) (perf_ticks[component] += perf_now() - (t))
+
+#else
+
+#define PERF_START(t)
+#define PERF_STOP(component, t)
+
+#endif
+
+/* Start measuring, called at startup */
+void start_perf_timers();
+
+/* Print the host time since start_perf_timers(), the share of each component
+ * and the peak RSS, nothing without PERF_TIMERS */
+void print_perf_timers();
+
+#endif
@@ -8,14 +8,22 @@
 
 #include "pipe.h"
 #include "cache.h"
+#include "coherence.h"
+#include "hierarchy.h"
+#include "interp.h"
+#include "lockstep.h"
 #include "mem_controller.h"
 #include "mips.h"
+#include "parallel.h"
+#include "perf_timer.h"
+#include "repl_policy.h"
 #include "shell.h"
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 // #define DEBUG
 
 /* debug */
@@ -30,148 +38,698 @@ void print_op(Pipe_Op *op) {
         printf("(null)\n");
 }
 
-/* global pipeline state */
-Pipe_State pipe;
+/* global pipeline state of each core */
+Pipe_State pipes[MAX_CORES];
+uint32_t num_cores = 1;
+int shared_memory;
+
+/* global memory system state (the caches are in hierarchy.c, the MSHRs in
+ * mshr.c) */
+MemSystem mem_system;
+
+/* parallel simulation: quantum of cycles the cores run on their host threads
+ * (0 = lookahead), whether it is enabled, and whether the cores are running
+ * on their threads right now */
+static uint32_t parallel_quantum;
+static int parallel_enabled;
+static int on_threads;
+
+/* instructions a core of a parallel program fast-forwards before the next
+ * core takes its turn */
+#define FAST_FORWARD_TURN 10000
+
+/* misses that found no free MSHR when replayed, retried in the next cycle */
+#define MAX_RETRY_EVENTS 16
+static CoreEvent retry_events[MAX_CORES][MAX_RETRY_EVENTS];
+static uint32_t num_retry_events[MAX_CORES];
+static uint32_t mshr_retries;
+
+void pipe_init(uint32_t cores, int shared) {
+    assert(cores >= 1 && cores <= MAX_CORES);
+    num_cores = cores;
+    memset(pipes, 0, sizeof(pipes));
+    for (uint32_t core = 0; core < num_cores; core++) {
+        pipes[core].core = core;
+        pipes[core].PC = 0x00400000;
+    }
 
-/* global cache state */
-Cache dcache, icache, l2cache;
-MSHR mshrs[NUM_MSHR];
-MemController mem_controller;
+    // the cores of a parallel program tell their share of the work apart by
+    // $a0 = core, $a1 = cores
+    shared_memory = shared;
+    if (shared) {
+        enable_coherence();
+        set_hierarchy_coherent(1);
+        for (uint32_t core = 0; core < num_cores; core++) {
+            pipes[core].REGS[4] = core;
+            pipes[core].REGS[5] = num_cores;
+        }
+    }
 
-// Track addresses for pending cache misses
-uint32_t l1_fetch_miss_addr = 0;
-uint8_t l1_fetch_waiting = 0;
-uint8_t l1_fetch_cancelled = 0; // 1 if fetch miss was cancelled by branch
+    // Initialize the caches, a config file loaded later replaces them
+    set_hierarchy_cores(num_cores);
+    init_default_hierarchy();
+    init_mshrs();
 
-uint32_t l1_mem_miss_addr = 0;
-uint8_t l1_mem_waiting = 0;
-uint8_t l1_mem_cancelled = 0; // 1 if mem miss was cancelled by branch
+    // Initialize the memory controllers with large queues (effectively infinite)
+    init_memory_system(&mem_system, 256);
+    start_perf_timers();
+}
 
-void pipe_init() {
-    memset(&pipe, 0, sizeof(Pipe_State));
-    pipe.PC = 0x00400000;
+int pipe_set_policy(const char *cache_name, const char *policy_name) {
+    const ReplPolicy *policy = find_repl_policy(policy_name);
+    if (policy == NULL) {
+        return -1;
+    }
 
-    // Initialize the caches
-    alloc_cache(&icache, ICACHE_SIZE, ICACHE_WAYS, BLOCK_SIZE);
-    alloc_cache(&dcache, DCACHE_SIZE, DCACHE_WAYS, BLOCK_SIZE);
-    alloc_cache(&l2cache, L2CACHE_SIZE, L2CACHE_WAYS, BLOCK_SIZE);
+    // the copies of a private cache all have the same ways
+    Cache *c = find_cache(cache_name);
+    if (c == NULL || c->num_ways > policy->max_ways) {
+        return -1;
+    }
+    // all copies of a private cache
+    for (uint32_t i = 0; i < num_caches; i++) {
+        if (strcmp(caches[i].name, cache_name) == 0) {
+            set_cache_policy(&caches[i], policy);
+        }
+    }
+    return 0;
+}
 
-    // Initialize memory controller with large queue (effectively infinite)
-    init_memory_controller(&mem_controller, 256);
+int pipe_set_victim_entries(uint32_t num_entries) {
+    if (num_entries != 0 &&
+        (num_entries < VICTIM_CACHE_MIN_ENTRIES || num_entries > VICTIM_CACHE_MAX_ENTRIES ||
+         coherence_enabled())) {
+        return -1;
+    }
+    for (uint32_t core = 0; core < num_cores; core++) {
+        init_victim_cache(dcache[core]->victim, num_entries);
+    }
+    return 0;
 }
 
-void pipe_cycle() {
+int pipe_set_dram_config(const char *name) {
+    if (set_dram_config(&mem_system, name) != 0) {
+        return -1;
+    }
+    print_dram_timing(&mem_system.channels[0].timing);
+    print_address_map(&mem_system.map);
+    return 0;
+}
+
+int pipe_set_mem_scheduler(const char *name) { return set_mem_scheduler(&mem_system, name); }
+
+int pipe_set_row_policy(const char *name) { return set_row_policy(&mem_system, name); }
+
+int pipe_set_refresh_mode(const char *name) { return set_refresh_mode(&mem_system, name); }
+
+int pipe_set_coherence(const char *name) { return set_coherence_protocol(name); }
+
+int pipe_set_alone_ipc(uint32_t core, double ipc) {
+    if (core >= num_cores || !(ipc > 0)) {
+        return -1;
+    }
+    pipes[core].alone_ipc = ipc;
+    return 0;
+}
+
+int pipe_fast_forward(uint64_t n) {
+    if (stat_cycles > 0) {
+        return -1;
+    }
+
+    // the functional cores run on the simulator's memory
+    static uint8_t *regions[FUNC_REGIONS];
+    static FuncCore cores[MAX_CORES];
+    func_map_regions(regions, 0);
+    for (uint32_t core = 0; core < num_cores; core++) {
+        FuncCore *c = &cores[core];
+        memcpy(c->REGS, pipes[core].REGS, sizeof(c->REGS));
+        c->HI = pipes[core].HI;
+        c->LO = pipes[core].LO;
+        c->PC = pipes[core].PC;
+        c->space = core_address(core, 0);
+        c->regions = regions;
+        c->ll_valid = 0;
+        c->halted = pipes[core].halted;
+    }
+
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t executed = 0;
+    if (shared_memory) {
+        // the cores take turns; an LL reservation doesn't last past a turn, as
+        // another core may store to the word in its turn
+        for (uint64_t done = 0; done < n; done += FAST_FORWARD_TURN) {
+            uint64_t turn = n - done < FAST_FORWARD_TURN ? n - done : FAST_FORWARD_TURN;
+            int running = 0;
+            for (uint32_t core = 0; core < num_cores; core++) {
+                executed += interp_run(&cores[core], turn);
+                cores[core].ll_valid = 0;
+                running |= !cores[core].halted;
+            }
+            if (!running) {
+                break;
+            }
+        }
+    } else {
+        for (uint32_t core = 0; core < num_cores; core++) {
+            executed += interp_run(&cores[core], n);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    RUN_BIT = 0;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Pipe_State *p = &pipes[core];
+        memcpy(p->REGS, cores[core].REGS, sizeof(p->REGS));
+        p->HI = cores[core].HI;
+        p->LO = cores[core].LO;
+        p->PC = cores[core].PC;
+        p->halted = cores[core].halted;
+        p->ll_valid = 0;
+        RUN_BIT |= !p->halted;
+    }
+
+    double seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("Fast-forwarded %llu instructions in %.3f s, %.1f MIPS\n", (unsigned long long)executed,
+           seconds, seconds > 0 ? executed / seconds / 1e6 : 0);
+    return 0;
+}
+
+// IPC of a core over the cycles until it halted, or so far if it still runs
+static double core_ipc(const Pipe_State *p) {
+    uint32_t cycles = p->halted ? p->cycles : stat_cycles;
+    return cycles ? (double)p->inst_retire / cycles : 0;
+}
+
+// IPC of each core and the system throughput metrics of the mix: harmonic
+// mean IPC, and the weighted speedup once the alone IPCs of all cores are set
+static void print_core_stats() {
+    double inv_ipc_sum = 0, weighted_speedup = 0;
+    int all_alone = 1, all_running = 1;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Pipe_State *p = &pipes[core];
+        double ipc = core_ipc(p);
+        printf("Core %u: %u instructions retired in %u cycles, IPC %.3f, %u flushes%s", core,
+               p->inst_retire, p->halted ? p->cycles : stat_cycles, ipc, p->squash,
+               p->halted ? "" : " (running)");
+        if (p->alone_ipc > 0) {
+            printf(", alone IPC %.3f, slowdown %.2f", p->alone_ipc,
+                   ipc > 0 ? p->alone_ipc / ipc : 0);
+            weighted_speedup += ipc / p->alone_ipc;
+        } else {
+            all_alone = 0;
+        }
+        printf("\n");
+
+        if (ipc > 0) {
+            inv_ipc_sum += 1 / ipc;
+        } else {
+            all_running = 0;
+        }
+    }
+
+    printf("Harmonic mean IPC: %.3f\n", all_running ? num_cores / inv_ipc_sum : 0);
+    if (all_alone) {
+        printf("Weighted speedup: %.3f\n", weighted_speedup);
+    } else {
+        printf("Weighted speedup: needs the alone IPC of every core\n");
+    }
+}
+
+int pipe_set_parallel(uint32_t quantum) {
+    if (quantum > MAX_QUANTUM || num_cores < 2 || get_inclusion_policy() != INCLUSION_NINE ||
+        shared_memory) {
+        return -1;
+    }
+    parallel_quantum = quantum;
+    parallel_enabled = 1;
+    return 0;
+}
+
+void pipe_set_serial() {
+    parallel_enabled = 0;
+    stop_core_threads();
+}
+
+// Cycles until an L2 hit reaches the L1: a miss posted in a quantum this long
+// can't be filled before the quantum ends, so the cores never wait on a fill
+// the shared levels haven't simulated yet
+static uint32_t lookahead_quantum() {
+    uint32_t latency = UINT32_MAX;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        Cache *below[2] = {icache[core]->next, dcache[core]->next};
+        for (int i = 0; i < 2; i++) {
+            if (below[i] == NULL) {
+                return 1; // memory latency depends on the DRAM state
+            }
+            latency = below[i]->latency < latency ? below[i]->latency : latency;
+        }
+    }
+    return latency + 1;
+}
+
+static void print_parallel_stats() {
+    uint32_t late_fills = 0;
+    uint64_t late_cycles = 0;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        late_fills += pipes[core].late_fills;
+        late_cycles += pipes[core].late_fill_cycles;
+    }
+    printf("Parallel simulation: %u threads, quantum %u cycles%s\n", num_cores,
+           parallel_quantum ? parallel_quantum : lookahead_quantum(),
+           parallel_quantum ? "" : " (lookahead)");
+    printf("  %u fills seen late by %.1f cycles on average, %u misses retried for an MSHR\n",
+           late_fills, late_fills ? (double)late_cycles / late_fills : 0, mshr_retries);
+}
+
+// Latency distributions of the loads and L1 misses of all cores
+static void print_latency_stats() {
+    Histogram load = {0}, cache = {0}, dram = {0};
+    for (uint32_t core = 0; core < num_cores; core++) {
+        histogram_merge(&load, &pipes[core].load_to_use);
+        histogram_merge(&cache, &pipes[core].miss_cache);
+        histogram_merge(&dram, &pipes[core].miss_dram);
+    }
+    print_histogram("Load-to-use latency", "loads", &load);
+    print_histogram("L1 miss service, cache hit", "misses", &cache);
+    print_histogram("L1 miss service, DRAM", "misses", &dram);
+}
+
+void pipe_print_stats() {
+    if (num_cores > 1) {
+        print_core_stats();
+    }
+    if (parallel_enabled) {
+        print_parallel_stats();
+    }
+    for (uint32_t i = 0; i < num_caches; i++) {
+        print_cache_stats(&caches[i]);
+    }
+    if (coherence_enabled()) {
+        print_coherence_stats();
+    }
+    print_hierarchy_stats();
+    print_latency_stats();
+    print_memory_stats(&mem_system, stat_cycles);
+    print_perf_timers();
+}
+
+void pipe_print_memstats() { print_memory_controller_stats(&mem_system); }
+
+int pipe_write_memstats_json(const char *path) {
+    if (strcmp(path, "-") == 0) {
+        write_memory_controller_json(&mem_system, stdout);
+        return 0;
+    }
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+    write_memory_controller_json(&mem_system, out);
+    fclose(out);
+    return 0;
+}
+
+// ======================
+// Accesses of the stages to the memory system. A core on a host thread only
+// touches its private L1s, its misses and MSHR releases are queued for the
+// shared levels.
+
+static void post_event(Pipe_State *p, uint8_t kind, uint32_t address, uint8_t is_icache) {
+    CoreEvent ev = {p->cycle, address, kind, is_icache};
+    post_core_event(p->core, &ev);
+}
+
+static CacheAccessResult l1_access(Pipe_State *p, Cache *c, uint32_t address,
+                                   uint8_t is_icache) {
+    if (!on_threads) {
+        PERF_START(access);
+        CacheAccessResult result = cache_access(c, address, is_icache);
+        PERF_STOP(PERF_CACHES, access);
+        return result;
+    }
+    CacheAccessResult result = cache_lookup_l1(c, address);
+    if (result == CACHE_MISS_WAIT) {
+        post_event(p, CORE_EVENT_MISS, address, is_icache);
+    }
+    return result;
+}
+
+// 1 if the fill of a pending miss is ready. On a host thread the shared levels
+// are simulated up to the end of the last quantum only, but they know the
+// cycle of every fill due before the end of this one.
+static int l1_fill_ready(Pipe_State *p, Cache *c, uint32_t address) {
+    if (!on_threads) {
+        return check_l1_fill_ready(c, address);
+    }
+    MSHR *mshr = find_mshr(address & ~(c->block_size - 1), p->core);
+    if (mshr == NULL || mshr->fill_ready_cycle == 0 || mshr->fill_ready_cycle >= p->cycle) {
+        return 0;
+    }
+    // run serially, the fill would have been seen in the cycle after it
+    uint32_t late = p->cycle - mshr->fill_ready_cycle - 1;
+    if (late) {
+        p->late_fills++;
+        p->late_fill_cycles += late;
+    }
+    return 1;
+}
+
+// Access of the MEM stage to the D-cache, coherent if the cores share memory
+static CacheAccessResult data_access(Pipe_State *p, uint32_t address, int is_write) {
+    if (coherence_enabled()) {
+        PERF_START(access);
+        CacheAccessResult result = coherent_access(dcache[p->core], address, is_write);
+        PERF_STOP(PERF_CACHES, access);
+        return result;
+    }
+    return l1_access(p, dcache[p->core], address, 0);
+}
+
+// Free the MSHR of a completed or cancelled L1 miss
+static void release_mshr(Pipe_State *p, Cache *c, uint32_t address) {
+    if (on_threads) {
+        post_event(p, CORE_EVENT_RELEASE, address, c == icache[p->core]);
+    } else {
+        PERF_START(release);
+        free_l1_miss(c, address);
+        PERF_STOP(PERF_CACHES, release);
+    }
+}
+
+// Account the service time of a completed L1 miss by the level that served
+// it, before its MSHR is released
+static void record_miss_service(Pipe_State *p, Cache *c, uint32_t address, uint32_t start) {
+    MSHR *mshr = find_mshr(address & ~(c->block_size - 1), p->core);
+    if (mshr) {
+        histogram_record(mshr->source ? &p->miss_cache : &p->miss_dram, p->cycle - start);
+    }
+}
+
+// Count a completed D-cache miss of the instruction at pc by the level that
+// served it, before its MSHR is released
+static void profile_dcache_miss(Pipe_State *p, uint32_t pc, uint32_t address) {
+    ProfileEntry *e = profile_at(p->profile, pc);
+    Cache *c = dcache[p->core];
+    MSHR *mshr = e ? find_mshr(address & ~(c->block_size - 1), p->core) : NULL;
+    if (mshr == NULL) {
+        return;
+    }
+
+    uint32_t level = PROFILE_LEVELS - 1; // memory
+    if (mshr->source) {
+        level = 0;
+        for (Cache *lvl = c->next; lvl && lvl != mshr->source && level < PROFILE_LEVELS - 2;
+             lvl = lvl->next) {
+            level++;
+        }
+    }
+    e->dcache_misses[level]++;
+    e->row_conflicts += mshr->row_conflict;
+}
+
+// Apply a queued event of a core to the shared levels, returns 0 if a miss
+// found no free MSHR
+static int replay_event(uint32_t core, const CoreEvent *ev) {
+    Cache *c = ev->is_icache ? icache[core] : dcache[core];
+    if (ev->kind == CORE_EVENT_RELEASE) {
+        free_l1_miss(c, ev->address);
+        return 1;
+    }
+    return cache_access_below(c, ev->address, ev->is_icache) != CACHE_NO_MSHR;
+}
+
+// Simulate the shared levels for cycles first to last, applying the events
+// the cores queued in the cycle they were made, in core order like a serial
+// run
+static void replay_shared_levels(uint32_t first, uint32_t last) {
+    for (uint32_t cycle = first; cycle <= last; cycle++) {
+        stat_cycles = cycle; // the caches schedule fills relative to it
+        for (uint32_t core = 0; core < num_cores; core++) {
+            uint32_t n = num_retry_events[core];
+            num_retry_events[core] = 0;
+            CoreEvent ev;
+            for (uint32_t i = 0; i < n; i++) {
+                ev = retry_events[core][i];
+                if (!replay_event(core, &ev)) {
+                    retry_events[core][num_retry_events[core]++] = ev;
+                }
+            }
+            while (take_core_event(core, cycle, &ev)) {
+                if (!replay_event(core, &ev)) {
+                    assert(num_retry_events[core] < MAX_RETRY_EVENTS);
+                    retry_events[core][num_retry_events[core]++] = ev;
+                    mshr_retries++;
+                }
+            }
+        }
+        memory_system_cycle(&mem_system, cycle);
+    }
+}
+
+// A halted core no longer runs its stages, but still has to give back the
+// shared MSHRs of the misses it had pending
+static void drain_halted_core(Pipe_State *p) {
+    if ((p->fetch_waiting || p->fetch_cancelled) &&
+        l1_fill_ready(p, icache[p->core], p->fetch_miss_addr)) {
+        release_mshr(p, icache[p->core], p->fetch_miss_addr);
+        p->fetch_waiting = p->fetch_cancelled = 0;
+    }
+    if ((p->mem_waiting || p->mem_cancelled) &&
+        l1_fill_ready(p, dcache[p->core], p->mem_miss_addr)) {
+        release_mshr(p, dcache[p->core], p->mem_miss_addr);
+        p->mem_waiting = p->mem_cancelled = 0;
+    }
+}
+
+// ======================
+// Shared memory
+
+// Block an LL reserves, stores to it by other cores make the SC fail
+static uint32_t reserved_block(uint32_t address) {
+    return address & ~(dcache[0]->block_size - 1);
+}
+
+// A store becomes visible to the other cores: it breaks their reservations
+// on the block, and coherence notes the word for telling false sharing apart
+static void shared_store(Pipe_State *p, uint32_t address) {
+    if (!shared_memory) {
+        return;
+    }
+    for (uint32_t core = 0; core < num_cores; core++) {
+        if (core != p->core && pipes[core].ll_block == reserved_block(address)) {
+            pipes[core].ll_valid = 0;
+        }
+    }
+    coherent_store(p->core, address);
+}
+
+// ======================
+// Cycles
+
+// Charge a cycle to the oldest instruction in the pipeline, or to the one
+// being fetched if the pipeline is empty
+static void profile_cycle(Pipe_State *p) {
+    Pipe_Op *oldest = p->wb_op        ? p->wb_op
+                      : p->mem_op     ? p->mem_op
+                      : p->execute_op ? p->execute_op
+                                      : p->decode_op;
+    ProfileEntry *e = profile_at(p->profile, oldest ? oldest->pc : p->PC);
+    if (e) {
+        e->cycles++;
+    }
+}
+
+// Fetch the record of a flushed op again, with the PC fetch restarts from
+static void refetch_record(Pipe_State *p, const Pipe_Op *op) {
+    if (op->record && (int32_t)(op->seq - p->feed_next) < 0) {
+        p->feed_next = op->seq;
+    }
+}
+
+static void core_cycle(Pipe_State *p) {
 #ifdef DEBUG
     printf("\n\n----\n\nPIPELINE:\n");
     printf("DCODE: ");
-    print_op(pipe.decode_op);
+    print_op(p->decode_op);
     printf("EXEC : ");
-    print_op(pipe.execute_op);
+    print_op(p->execute_op);
     printf("MEM  : ");
-    print_op(pipe.mem_op);
+    print_op(p->mem_op);
     printf("WB   : ");
-    print_op(pipe.wb_op);
+    print_op(p->wb_op);
     printf("\n");
 #endif
 
-    pipe_stage_wb();
-    pipe_stage_mem();
-    pipe_stage_execute();
-    pipe_stage_decode();
-    pipe_stage_fetch();
+    if (p->profile) {
+        profile_cycle(p);
+    }
+
+    pipe_stage_wb(p);
+    pipe_stage_mem(p);
+    pipe_stage_execute(p);
+    pipe_stage_decode(p);
+    pipe_stage_fetch(p);
 
     /* handle branch recoveries */
-    if (pipe.branch_recover) {
+    if (p->branch_recover) {
 #ifdef DEBUG
-        printf("branch recovery: new dest %08x flush %d stages\n", pipe.branch_dest,
-               pipe.branch_flush);
+        printf("branch recovery: new dest %08x flush %d stages\n", p->branch_dest,
+               p->branch_flush);
 #endif
 
-        pipe.PC = pipe.branch_dest;
+        p->PC = p->branch_dest;
 
-        if (pipe.branch_flush >= 2) {
-            if (pipe.decode_op)
-                free(pipe.decode_op);
-            pipe.decode_op = NULL;
+        if (p->branch_flush >= 2) {
+            if (p->decode_op) {
+                refetch_record(p, p->decode_op);
+                free(p->decode_op);
+            }
+            p->decode_op = NULL;
         }
 
-        if (pipe.branch_flush >= 3) {
-            if (pipe.execute_op)
-                free(pipe.execute_op);
-            pipe.execute_op = NULL;
+        if (p->branch_flush >= 3) {
+            if (p->execute_op) {
+                refetch_record(p, p->execute_op);
+                free(p->execute_op);
+            }
+            p->execute_op = NULL;
         }
 
-        if (pipe.branch_flush >= 4) {
-            if (pipe.mem_op)
-                free(pipe.mem_op);
-            pipe.mem_op = NULL;
+        if (p->branch_flush >= 4) {
+            if (p->mem_op) {
+                refetch_record(p, p->mem_op);
+                free(p->mem_op);
+            }
+            p->mem_op = NULL;
 
             // If MEM stage is flushed and was waiting on a cache miss, cancel
             // it
-            if (l1_mem_waiting) {
-                l1_mem_cancelled = 1;
-                l1_mem_waiting = 0; // Unstall immediately
+            if (p->mem_waiting) {
+                p->mem_cancelled = 1;
+                p->mem_waiting = 0; // Unstall immediately
             }
         }
 
-        if (pipe.branch_flush >= 5) {
-            if (pipe.wb_op)
-                free(pipe.wb_op);
-            pipe.wb_op = NULL;
+        if (p->branch_flush >= 5) {
+            if (p->wb_op) {
+                refetch_record(p, p->wb_op);
+                free(p->wb_op);
+            }
+            p->wb_op = NULL;
         }
 
         // If fetch was waiting on a cache miss, cancel it
         // (fetch is always flushed on any branch recovery)
-        if (l1_fetch_waiting) {
-            l1_fetch_cancelled = 1;
-            l1_fetch_waiting = 0; // Unstall immediately
+        if (p->fetch_waiting) {
+            p->fetch_cancelled = 1;
+            p->fetch_waiting = 0; // Unstall immediately
         }
 
-        pipe.branch_recover = 0;
-        pipe.branch_dest = 0;
-        pipe.branch_flush = 0;
+        p->branch_recover = 0;
+        p->branch_dest = 0;
+        p->branch_flush = 0;
 
-        stat_squash++;
+        p->squash++;
     }
+}
 
-    // Simulate memory controller (processes DRAM, L2 fills, etc.)
-    memory_controller_cycle(&mem_controller, stat_cycles);
+void pipe_core_cycle(Pipe_State *p) {
+    if (p->halted) {
+        drain_halted_core(p);
+    } else {
+        core_cycle(p);
+    }
+}
+
+// Sum the statistics of the cores, and stop once the last one has halted or a
+// core diverged from its lockstep reference
+static void update_run_state() {
+    stat_inst_retire = stat_inst_fetch = stat_squash = 0;
+    RUN_BIT = 0;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        stat_inst_retire += pipes[core].inst_retire;
+        stat_inst_fetch += pipes[core].inst_fetch;
+        stat_squash += pipes[core].squash;
+        RUN_BIT |= !pipes[core].halted;
+    }
+    if (lockstep_diverged) {
+        RUN_BIT = 0;
+    }
+}
 
-    // if final cycle, free cache memory
-    if (RUN_BIT == 0) {
-        free_cache(&icache);
-        free_cache(&dcache);
-        free_cache(&l2cache);
-        free_memory_controller(&mem_controller);
+// Run a quantum of the cores on their host threads, then catch the shared
+// levels up with them
+static void parallel_cycle() {
+    uint32_t quantum = parallel_quantum ? parallel_quantum : lookahead_quantum();
+    uint32_t first = stat_cycles, end = first + quantum;
+
+    on_threads = 1;
+    run_core_threads(num_cores, first, end);
+    on_threads = 0;
+
+    // the shared levels stop with the last core to halt
+    uint32_t last = end - 1, last_halt = 0, all_halted = 1;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        all_halted &= pipes[core].halted;
+        last_halt = pipes[core].cycles > last_halt ? pipes[core].cycles : last_halt;
+    }
+    if (all_halted) {
+        last = last_halt - 1;
     }
+    replay_shared_levels(first, last);
 }
 
-void pipe_recover(int flush, uint32_t dest) {
+void pipe_cycle() {
+    if (parallel_enabled && get_inclusion_policy() == INCLUSION_NINE) {
+        parallel_cycle();
+        update_run_state();
+        return;
+    }
+
+    // cores go in order, a lower numbered core gets free MSHRs first
+    PERF_START(cores);
+    for (uint32_t core = 0; core < num_cores; core++) {
+        pipes[core].cycle = stat_cycles;
+        pipe_core_cycle(&pipes[core]);
+    }
+    PERF_STOP(PERF_CORES, cores);
+
+    // Simulate memory controllers (processes DRAM, L2 fills, etc.), they and
+    // the caches stay around for stats after the final cycle
+    PERF_START(memory);
+    memory_system_cycle(&mem_system, stat_cycles);
+    PERF_STOP(PERF_MEMORY, memory);
+    update_run_state();
+}
+
+void pipe_recover(Pipe_State *p, int flush, uint32_t dest) {
     /* if there is already a recovery scheduled, it must have come from a later
      * stage (which executes older instructions), hence that recovery overrides
      * our recovery. Simply return in this case. */
-    if (pipe.branch_recover)
+    if (p->branch_recover)
         return;
 
     /* schedule the recovery. This will be done once all pipeline stages
      * simulate the current cycle. */
-    pipe.branch_recover = 1;
-    pipe.branch_flush = flush;
-    pipe.branch_dest = dest;
+    p->branch_recover = 1;
+    p->branch_flush = flush;
+    p->branch_dest = dest;
 }
 
-void pipe_stage_wb() {
+void pipe_stage_wb(Pipe_State *p) {
     /* if there is no instruction in this pipeline stage, we are done */
-    if (!pipe.wb_op)
+    if (!p->wb_op)
         return;
 
     /* grab the op out of our input slot */
-    Pipe_Op *op = pipe.wb_op;
-    pipe.wb_op = NULL;
+    Pipe_Op *op = p->wb_op;
+    p->wb_op = NULL;
 
     /* if this instruction writes a register, do so now */
     if (op->reg_dst != -1 && op->reg_dst != 0) {
-        pipe.REGS[op->reg_dst] = op->reg_dst_value;
+        p->REGS[op->reg_dst] = op->reg_dst_value;
 #ifdef DEBUG
         printf("R%d = %08x\n", op->reg_dst, op->reg_dst_value);
 #endif
@@ -180,102 +738,141 @@ void pipe_stage_wb() {
     /* if this was a syscall, perform action */
     if (op->opcode == OP_SPECIAL && op->subop == SUBOP_SYSCALL) {
         if (op->reg_src1_value == 0xA) {
-            pipe.PC = op->pc; /* fetch will do pc += 4, then we stop with
+            p->PC = op->pc; /* fetch will do pc += 4, then we stop with
                                  correct PC */
 
             // fetch stage won't run if waiting on cache miss
-            if (l1_fetch_waiting) {
-                pipe.PC += 4;
+            if (p->fetch_waiting) {
+                p->PC += 4;
             }
-            RUN_BIT = 0;
+            /* the simulation ends when the last core halts */
+            p->halted = 1;
+            p->cycles = p->cycle + 1;
         }
     }
 
+    if (p->reference) {
+        lockstep_retire(p, op);
+    }
+    if (op->record) {
+        ring_release(p->feed, op->seq + 1);
+    }
+
+    ProfileEntry *e = profile_at(p->profile, op->pc);
+    if (e) {
+        e->retired++;
+    }
+
     /* free the op */
     free(op);
 
-    stat_inst_retire++;
+    p->inst_retire++;
 }
 
-static void free_mshr(uint32_t address) {
-    // Free the MSHR
-    MSHR *mshr = NULL;
-    for (size_t i = 0; i < NUM_MSHR; i++) {
-        uint32_t block_addr = address & ~(BLOCK_SIZE - 1);
-        if (mshrs[i].valid && (mshrs[i].address & ~(BLOCK_SIZE - 1)) == block_addr) {
-            mshr = &mshrs[i];
-            break;
-        }
-    }
-    if (mshr) {
-        mshr->valid = 0;
-        mshr->done = 0;
+// Write the word of a store, unless the front end that feeds the core did
+static void store_word(const Pipe_State *p, uint32_t address, uint32_t val) {
+    if (!p->feed) {
+        mem_write_32(address, val);
     }
 }
 
-void pipe_stage_mem() {
+void pipe_stage_mem(Pipe_State *p) {
     /* if there is no instruction in this pipeline stage, we are done */
-    if (!pipe.mem_op)
+    if (!p->mem_op)
         return;
 
     /* if waiting for a cache fill, check if ready */
-    if (l1_mem_waiting) {
-        if (check_l1_fill_ready(&dcache, l1_mem_miss_addr)) {
-            // Fill is ready - complete it and unstall next cycle
-            complete_l1_fill(&dcache, l1_mem_miss_addr);
-
-            free_mshr(l1_mem_miss_addr);
-            l1_mem_waiting = 0;
-            l1_mem_miss_addr = 0;
+    if (p->mem_waiting) {
+        if (l1_fill_ready(p, dcache[p->core], p->mem_miss_addr)) {
+            // a fill that has another core write back waits for an MSHR for it
+            if (coherence_enabled() &&
+                !coherent_fill_ready(dcache[p->core], p->mem_miss_addr, p->mem_op->mem_write)) {
+                return;
+            }
+            if (p->profile) {
+                profile_dcache_miss(p, p->mem_op->pc, p->mem_miss_addr);
+            }
+            record_miss_service(p, dcache[p->core], p->mem_miss_addr, p->mem_miss_cycle);
+
+            // Fill is ready - complete it and unstall next cycle. The MSHR is
+            // freed first, for the writeback of a dirty block the fill evicts.
+            release_mshr(p, dcache[p->core], p->mem_miss_addr);
+            complete_l1_fill(dcache[p->core], p->mem_miss_addr);
+            if (coherence_enabled()) {
+                coherent_fill(dcache[p->core], p->mem_miss_addr, p->mem_op->mem_write);
+            }
+            p->mem_waiting = 0;
+            p->mem_miss_addr = 0;
             // Will process the instruction next cycle
         }
         return;
     }
 
     /* if there was a cancelled miss, check if fill is ready to free MSHR */
-    if (l1_mem_cancelled) {
-        if (check_l1_fill_ready(&dcache, l1_mem_miss_addr)) {
+    if (p->mem_cancelled) {
+        if (l1_fill_ready(p, dcache[p->core], p->mem_miss_addr)) {
             // Fill is ready but was cancelled - just free MSHR, don't insert into L1
-            free_mshr(l1_mem_miss_addr);
-            l1_mem_cancelled = 0;
-            l1_mem_miss_addr = 0;
+            release_mshr(p, dcache[p->core], p->mem_miss_addr);
+            p->mem_cancelled = 0;
+            p->mem_miss_addr = 0;
         }
         // Don't return - allow stage to process (if there's a new instruction)
     }
 
     /* grab the op out of our input slot */
-    Pipe_Op *op = pipe.mem_op;
+    Pipe_Op *op = p->mem_op;
+
+    /* caches and memory see the core's physical address of the word */
+    uint32_t address = core_address(p->core, op->mem_addr & ~3);
+
+    /* an SC whose reservation is gone fails without accessing memory; fed by
+     * the front end, it fails if the front end's did */
+    int sc_failed = 0;
+    if (op->opcode == OP_SC) {
+        sc_failed = p->feed ? !op->record->mem_write
+                            : !(p->ll_valid && p->ll_block == reserved_block(address));
+    }
 
     uint32_t val = 0;
-    if (op->is_mem) {
-        CacheAccessResult result = l1_cache_access(&dcache, op->mem_addr & ~3, 0);
+    if (op->is_mem && !sc_failed) {
+        if (!op->mem_started) {
+            op->mem_started = 1;
+            op->mem_start = p->cycle;
+        }
+        CacheAccessResult result = data_access(p, address, op->mem_write);
 
         if (result == CACHE_NO_MSHR) {
-            assert(0); // sanity check
-            // No free MSHRs - stall and retry
+            // No free MSHRs (taken by other cores) - stall and retry
             return;
         }
 
         if (result == CACHE_MISS_WAIT) {
             // Miss - start waiting for fill
-            l1_mem_waiting = 1;
-            l1_mem_miss_addr = op->mem_addr & ~3;
+            p->mem_waiting = 1;
+            p->mem_miss_addr = address;
+            p->mem_miss_cycle = p->cycle;
             return;
         }
 
         // Hit - proceed normally
-        val = mem_read_32(op->mem_addr & ~3);
+        if (!p->feed) {
+            val = mem_read_32(address);
+        }
     }
 
     switch (op->opcode) {
     case OP_LW:
+    case OP_LL:
     case OP_LH:
     case OP_LHU:
     case OP_LB:
     case OP_LBU: {
         /* extract needed value */
         op->reg_dst_value_ready = 1;
-        if (op->opcode == OP_LW) {
+        if (p->feed) {
+            // the front end loaded it
+            op->reg_dst_value = op->record->reg_value;
+        } else if (op->opcode == OP_LW || op->opcode == OP_LL) {
             op->reg_dst_value = val;
         } else if (op->opcode == OP_LH || op->opcode == OP_LHU) {
             if (op->mem_addr & 2)
@@ -308,6 +905,12 @@ void pipe_stage_mem() {
 
             op->reg_dst_value = val;
         }
+
+        if (op->opcode == OP_LL) {
+            p->ll_valid = 1;
+            p->ll_block = reserved_block(address);
+        }
+        histogram_record(&p->load_to_use, p->cycle - op->mem_start + 1);
     } break;
 
     case OP_SB:
@@ -326,7 +929,7 @@ void pipe_stage_mem() {
             break;
         }
 
-        mem_write_32(op->mem_addr & ~3, val);
+        store_word(p, address, val);
         break;
 
     case OP_SH:
@@ -341,64 +944,76 @@ void pipe_stage_mem() {
         printf("new word %08x\n", val);
 #endif
 
-        mem_write_32(op->mem_addr & ~3, val);
+        store_word(p, address, val);
         break;
 
     case OP_SW:
         val = op->mem_value;
-        mem_write_32(op->mem_addr & ~3, val);
+        store_word(p, address, val);
+        break;
+
+    case OP_SC:
+        /* rt = 1 if the store was done */
+        op->reg_dst_value_ready = 1;
+        op->reg_dst_value = !sc_failed;
+        if (!sc_failed)
+            store_word(p, address, op->mem_value);
+        p->ll_valid = 0;
         break;
     }
 
+    if (op->mem_write && !sc_failed)
+        shared_store(p, address);
+
     /* clear stage input and transfer to next stage */
-    pipe.mem_op = NULL;
-    pipe.wb_op = op;
+    p->mem_op = NULL;
+    p->wb_op = op;
 }
 
-void pipe_stage_execute() {
+void pipe_stage_execute(Pipe_State *p) {
     /* if a multiply/divide is in progress, decrement cycles until value is
      * ready */
-    if (pipe.multiplier_stall > 0)
-        pipe.multiplier_stall--;
+    if (p->multiplier_stall > 0)
+        p->multiplier_stall--;
 
     /* if downstream stall, return (and leave any input we had) */
-    if (pipe.mem_op != NULL)
+    if (p->mem_op != NULL)
         return;
 
     /* if no op to execute, return */
-    if (pipe.execute_op == NULL)
+    if (p->execute_op == NULL)
         return;
 
     /* grab op and read sources */
-    Pipe_Op *op = pipe.execute_op;
+    Pipe_Op *op = p->execute_op;
 
     /* read register values, and check for bypass; stall if necessary */
     int stall = 0;
     if (op->reg_src1 != -1) {
         if (op->reg_src1 == 0)
             op->reg_src1_value = 0;
-        else if (pipe.mem_op && pipe.mem_op->reg_dst == op->reg_src1) {
-            if (!pipe.mem_op->reg_dst_value_ready)
+        else if (p->mem_op && p->mem_op->reg_dst == op->reg_src1) {
+            if (!p->mem_op->reg_dst_value_ready)
                 stall = 1;
             else
-                op->reg_src1_value = pipe.mem_op->reg_dst_value;
-        } else if (pipe.wb_op && pipe.wb_op->reg_dst == op->reg_src1) {
-            op->reg_src1_value = pipe.wb_op->reg_dst_value;
+                op->reg_src1_value = p->mem_op->reg_dst_value;
+        } else if (p->wb_op && p->wb_op->reg_dst == op->reg_src1) {
+            op->reg_src1_value = p->wb_op->reg_dst_value;
         } else
-            op->reg_src1_value = pipe.REGS[op->reg_src1];
+            op->reg_src1_value = p->REGS[op->reg_src1];
     }
     if (op->reg_src2 != -1) {
         if (op->reg_src2 == 0)
             op->reg_src2_value = 0;
-        else if (pipe.mem_op && pipe.mem_op->reg_dst == op->reg_src2) {
-            if (!pipe.mem_op->reg_dst_value_ready)
+        else if (p->mem_op && p->mem_op->reg_dst == op->reg_src2) {
+            if (!p->mem_op->reg_dst_value_ready)
                 stall = 1;
             else
-                op->reg_src2_value = pipe.mem_op->reg_dst_value;
-        } else if (pipe.wb_op && pipe.wb_op->reg_dst == op->reg_src2) {
-            op->reg_src2_value = pipe.wb_op->reg_dst_value;
+                op->reg_src2_value = p->mem_op->reg_dst_value;
+        } else if (p->wb_op && p->wb_op->reg_dst == op->reg_src2) {
+            op->reg_src2_value = p->wb_op->reg_dst_value;
         } else
-            op->reg_src2_value = pipe.REGS[op->reg_src2];
+            op->reg_src2_value = p->REGS[op->reg_src2];
     }
 
     /* if bypassing requires a stall (e.g. use immediately after load),
@@ -447,19 +1062,19 @@ void pipe_stage_execute() {
             int64_t val =
                 (int64_t)((int32_t)op->reg_src1_value) * (int64_t)((int32_t)op->reg_src2_value);
             uint64_t uval = (uint64_t)val;
-            pipe.HI = (uval >> 32) & 0xFFFFFFFF;
-            pipe.LO = (uval >> 0) & 0xFFFFFFFF;
+            p->HI = (uval >> 32) & 0xFFFFFFFF;
+            p->LO = (uval >> 0) & 0xFFFFFFFF;
 
             /* four-cycle multiplier latency */
-            pipe.multiplier_stall = 4;
+            p->multiplier_stall = 4;
         } break;
         case SUBOP_MULTU: {
             uint64_t val = (uint64_t)op->reg_src1_value * (uint64_t)op->reg_src2_value;
-            pipe.HI = (val >> 32) & 0xFFFFFFFF;
-            pipe.LO = (val >> 0) & 0xFFFFFFFF;
+            p->HI = (val >> 32) & 0xFFFFFFFF;
+            p->LO = (val >> 0) & 0xFFFFFFFF;
 
             /* four-cycle multiplier latency */
-            pipe.multiplier_stall = 4;
+            p->multiplier_stall = 4;
         } break;
 
         case SUBOP_DIV:
@@ -472,58 +1087,58 @@ void pipe_stage_execute() {
                 div = val1 / val2;
                 mod = val1 % val2;
 
-                pipe.LO = div;
-                pipe.HI = mod;
+                p->LO = div;
+                p->HI = mod;
             } else {
                 // really this would be a div-by-0 exception
-                pipe.HI = pipe.LO = 0;
+                p->HI = p->LO = 0;
             }
 
             /* 32-cycle divider latency */
-            pipe.multiplier_stall = 32;
+            p->multiplier_stall = 32;
             break;
 
         case SUBOP_DIVU:
             if (op->reg_src2_value != 0) {
-                pipe.HI = (uint32_t)op->reg_src1_value % (uint32_t)op->reg_src2_value;
-                pipe.LO = (uint32_t)op->reg_src1_value / (uint32_t)op->reg_src2_value;
+                p->HI = (uint32_t)op->reg_src1_value % (uint32_t)op->reg_src2_value;
+                p->LO = (uint32_t)op->reg_src1_value / (uint32_t)op->reg_src2_value;
             } else {
                 /* really this would be a div-by-0 exception */
-                pipe.HI = pipe.LO = 0;
+                p->HI = p->LO = 0;
             }
 
             /* 32-cycle divider latency */
-            pipe.multiplier_stall = 32;
+            p->multiplier_stall = 32;
             break;
 
         case SUBOP_MFHI:
             /* stall until value is ready */
-            if (pipe.multiplier_stall > 0)
+            if (p->multiplier_stall > 0)
                 return;
 
-            op->reg_dst_value = pipe.HI;
+            op->reg_dst_value = p->HI;
             break;
         case SUBOP_MTHI:
             /* stall to respect WAW dependence */
-            if (pipe.multiplier_stall > 0)
+            if (p->multiplier_stall > 0)
                 return;
 
-            pipe.HI = op->reg_src1_value;
+            p->HI = op->reg_src1_value;
             break;
 
         case SUBOP_MFLO:
             /* stall until value is ready */
-            if (pipe.multiplier_stall > 0)
+            if (p->multiplier_stall > 0)
                 return;
 
-            op->reg_dst_value = pipe.LO;
+            op->reg_dst_value = p->LO;
             break;
         case SUBOP_MTLO:
             /* stall to respect WAW dependence */
-            if (pipe.multiplier_stall > 0)
+            if (p->multiplier_stall > 0)
                 return;
 
-            pipe.LO = op->reg_src1_value;
+            p->LO = op->reg_src1_value;
             break;
 
         case SUBOP_ADD:
@@ -622,6 +1237,7 @@ void pipe_stage_execute() {
         break;
 
     case OP_LW:
+    case OP_LL:
     case OP_LH:
     case OP_LHU:
     case OP_LB:
@@ -630,6 +1246,7 @@ void pipe_stage_execute() {
         break;
 
     case OP_SW:
+    case OP_SC:
     case OP_SH:
     case OP_SB:
         op->mem_addr = op->reg_src1_value + op->se_imm16;
@@ -638,26 +1255,32 @@ void pipe_stage_execute() {
     }
 
     /* handle branch recoveries at this point */
-    if (op->branch_taken)
-        pipe_recover(3, op->branch_dest);
+    if (op->branch_taken) {
+        pipe_recover(p, 3, op->branch_dest);
+
+        ProfileEntry *e = profile_at(p->profile, op->pc);
+        if (e) {
+            e->flushes++;
+        }
+    }
 
     /* remove from upstream stage and place in downstream stage */
-    pipe.execute_op = NULL;
-    pipe.mem_op = op;
+    p->execute_op = NULL;
+    p->mem_op = op;
 }
 
-void pipe_stage_decode() {
+void pipe_stage_decode(Pipe_State *p) {
     /* if downstream stall, return (and leave any input we had) */
-    if (pipe.execute_op != NULL)
+    if (p->execute_op != NULL)
         return;
 
     /* if no op to decode, return */
-    if (pipe.decode_op == NULL)
+    if (p->decode_op == NULL)
         return;
 
     /* grab op and remove from stage input */
-    Pipe_Op *op = pipe.decode_op;
-    pipe.decode_op = NULL;
+    Pipe_Op *op = p->decode_op;
+    p->decode_op = NULL;
 
     /* set up info fields (source/dest regs, immediate, jump dest) as necessary
      */
@@ -757,25 +1380,29 @@ void pipe_stage_decode() {
         break;
 
     case OP_LW:
+    case OP_LL:
     case OP_LH:
     case OP_LHU:
     case OP_LB:
     case OP_LBU:
     case OP_SW:
+    case OP_SC:
     case OP_SH:
     case OP_SB:
         /* memory ops */
         op->is_mem = 1;
         op->reg_src1 = rs;
-        if (opcode == OP_LW || opcode == OP_LH || opcode == OP_LHU || opcode == OP_LB ||
-            opcode == OP_LBU) {
+        if (opcode == OP_LW || opcode == OP_LL || opcode == OP_LH || opcode == OP_LHU ||
+            opcode == OP_LB || opcode == OP_LBU) {
             /* load */
             op->mem_write = 0;
             op->reg_dst = rt;
         } else {
-            /* store */
+            /* store, an SC also writes its success to rt */
             op->mem_write = 1;
             op->reg_src2 = rt;
+            if (opcode == OP_SC)
+                op->reg_dst = rt;
         }
         break;
     }
@@ -783,52 +1410,59 @@ void pipe_stage_decode() {
     /* we will handle reg-read together with bypass in the execute stage */
 
     /* place op in downstream slot */
-    pipe.execute_op = op;
+    p->execute_op = op;
 }
 
-void pipe_stage_fetch() {
+void pipe_stage_fetch(Pipe_State *p) {
     /* if pipeline is stalled (our output slot is not empty), return */
-    if (pipe.decode_op != NULL)
+    if (p->decode_op != NULL)
         return;
 
     /* if waiting for a cache fill, check if ready */
-    if (l1_fetch_waiting) {
-        if (check_l1_fill_ready(&icache, l1_fetch_miss_addr)) {
+    if (p->fetch_waiting) {
+        if (l1_fill_ready(p, icache[p->core], p->fetch_miss_addr)) {
             // Fill is ready - complete it and unstall next cycle
-            complete_l1_fill(&icache, l1_fetch_miss_addr);
-            printf("Filling L1 cache in cycle 0x%08x\r\n", stat_cycles);
-            free_mshr(l1_fetch_miss_addr);
-            l1_fetch_waiting = 0;
-            l1_fetch_miss_addr = 0;
+            complete_l1_fill(icache[p->core], p->fetch_miss_addr);
+            printf("Filling L1 cache in cycle 0x%08x\r\n", p->cycle);
+            record_miss_service(p, icache[p->core], p->fetch_miss_addr, p->fetch_miss_cycle);
+            release_mshr(p, icache[p->core], p->fetch_miss_addr);
+            p->fetch_waiting = 0;
+            p->fetch_miss_addr = 0;
             // Will fetch the instruction next cycle
         }
         return;
     }
 
     /* if there was a cancelled miss, check if fill is ready to free MSHR */
-    if (l1_fetch_cancelled) {
-        if (check_l1_fill_ready(&icache, l1_fetch_miss_addr)) {
+    if (p->fetch_cancelled) {
+        if (l1_fill_ready(p, icache[p->core], p->fetch_miss_addr)) {
             // Fill is ready but was cancelled - just free MSHR, don't insert into L1
-            free_mshr(l1_fetch_miss_addr);
-            l1_fetch_cancelled = 0;
-            l1_fetch_miss_addr = 0;
+            release_mshr(p, icache[p->core], p->fetch_miss_addr);
+            p->fetch_cancelled = 0;
+            p->fetch_miss_addr = 0;
         }
         // Don't return - allow stage to fetch (new PC was set by branch recovery)
     }
 
     // Check I-cache
-    CacheAccessResult result = l1_cache_access(&icache, pipe.PC, 1);
+    uint32_t address = core_address(p->core, p->PC);
+    CacheAccessResult result = l1_access(p, icache[p->core], address, 1);
 
     if (result == CACHE_NO_MSHR) {
-        assert(0); // sanity check
-        // No free MSHRs - stall and retry
+        // No free MSHRs (taken by other cores) - stall and retry
         return;
     }
 
     if (result == CACHE_MISS_WAIT) {
+        ProfileEntry *e = profile_at(p->profile, p->PC);
+        if (e) {
+            e->icache_misses++;
+        }
+
         // Miss - start waiting for fill
-        l1_fetch_waiting = 1;
-        l1_fetch_miss_addr = pipe.PC;
+        p->fetch_waiting = 1;
+        p->fetch_miss_addr = address;
+        p->fetch_miss_cycle = p->cycle;
         return;
     }
 
@@ -838,12 +1472,23 @@ void pipe_stage_fetch() {
     memset(op, 0, sizeof(Pipe_Op));
     op->reg_src1 = op->reg_src2 = op->reg_dst = -1;
 
-    op->instruction = mem_read_32(pipe.PC);
-    op->pc = pipe.PC;
-    pipe.decode_op = op;
+    if (p->feed) {
+        // down the wrong path the PC isn't the next record's, the op is
+        // flushed before it executes
+        const FuncRecord *r = ring_peek(p->feed, p->feed_next);
+        if (r && r->pc == p->PC) {
+            op->instruction = r->instruction;
+            op->record = r;
+            op->seq = p->feed_next++;
+        }
+    } else {
+        op->instruction = mem_read_32(address);
+    }
+    op->pc = p->PC;
+    p->decode_op = op;
 
     /* update PC */
-    pipe.PC += 4;
+    p->PC += 4;
 
-    stat_inst_fetch++;
+    p->inst_fetch++;
 }
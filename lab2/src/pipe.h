@@ -10,6 +10,10 @@
 #define _PIPE_H_
 
 #include "cache.h"
+#include "frontend.h"
+#include "functional.h"
+#include "histogram.h"
+#include "profile.h"
 #include "shell.h"
 
 /* Pipeline ops (instances of this structure) are high-level representations
@@ -43,6 +47,8 @@ typedef struct Pipe_Op {
     int mem_write;           /* is this a write to memory? */
     uint32_t mem_value;      /* value loaded from memory or to be written to memory */
     uint32_t mem_value_read; // temp variable for cache reads if stage stalls
+    uint32_t mem_start;      /* cycle MEM first accessed the D-cache for it */
+    int mem_started;         /* mem_start is set */
     /* register destination information */
     int reg_dst;             /* 0 -- 31 if this inst has a destination register, -1
                                 otherwise */
@@ -58,6 +64,11 @@ typedef struct Pipe_Op {
     int is_link;          /* jump-and-link or branch-and-link inst? */
     int link_reg;         /* register to place link into? */
 
+    /* functional-first: the front end's record of this instruction and its
+     * number in the ring, NULL for an op fetched down the wrong path */
+    const FuncRecord *record;
+    uint32_t seq;
+
 } Pipe_Op;
 
 /* The pipe state represents the current state of the pipeline. It holds a
@@ -93,27 +104,165 @@ typedef struct Pipe_State {
 
     /* place other information here as necessary */
 
+    /* core number: selects the private caches, the memory image and the DRAM
+     * request sources of this pipeline */
+    uint32_t core;
+
+    /* cycle being simulated, the core's own when it runs on a host thread */
+    uint32_t cycle;
+
+    /* pending L1 misses of fetch and MEM. A miss cancelled by a flush keeps
+     * its MSHR until the fill arrives. */
+    uint32_t fetch_miss_addr;
+    uint8_t fetch_waiting;
+    uint8_t fetch_cancelled;
+    uint32_t mem_miss_addr;
+    uint8_t mem_waiting;
+    uint8_t mem_cancelled;
+
+    /* set once the core executed its exit syscall */
+    int halted;
+
+    /* reservation of the last LL: its block, cleared by an SC or a store of
+     * another core to the block */
+    uint32_t ll_block;
+    uint8_t ll_valid;
+
+    /* per-PC profile (profile.h), NULL when profiling is off */
+    ProfileEntry *profile;
+
+    /* functional reference retirement is checked against (lockstep.h), NULL
+     * when the check is off */
+    FuncCore *reference;
+
+    /* ring the front end feeds this core's retired instructions into
+     * (frontend.h), NULL when the pipeline executes on its own; the record
+     * fetch takes next */
+    RecordRing *feed;
+    uint32_t feed_next;
+
+    /* per-core statistics, the shell's stat_ counters sum them over all cores */
+    uint32_t cycles; /* cycles until the core halted */
+    uint32_t inst_retire, inst_fetch, squash;
+    double alone_ipc; /* IPC of the program running alone, 0 = unknown */
+
+    /* fills a core on a host thread saw after the cycle it would have seen
+     * them in (quantum longer than the lookahead), and the cycles lost */
+    uint32_t late_fills;
+    uint64_t late_fill_cycles;
+
+    /* cycles the pending L1 misses of fetch and MEM started in */
+    uint32_t fetch_miss_cycle, mem_miss_cycle;
+
+    /* latency histograms: cycles a load spends in MEM (1 for a hit), and the
+     * service time of L1 misses by whether a cache or DRAM served them */
+    Histogram load_to_use, miss_cache, miss_dram;
+
 } Pipe_State;
 
-/* global variable -- pipeline state */
-extern Pipe_State pipe;
+/* Each core runs its own program in a private address space. Bits 26:24 of a
+ * physical address hold the core number (XORed into the program's addresses),
+ * so the cores' text, data and stack never share blocks in the shared caches
+ * or DRAM rows. Core 0's physical addresses equal its program addresses.
+ * The cores of a parallel program all use core 0's address space. */
+#define CORE_ADDRESS_SHIFT 24
+
+extern int shared_memory;
+
+static inline uint32_t core_address(uint32_t core, uint32_t address) {
+    return shared_memory ? address : address ^ (core << CORE_ADDRESS_SHIFT);
+}
+
+/* global variables -- pipeline state of each core */
+extern Pipe_State pipes[MAX_CORES];
+extern uint32_t num_cores;
 
-/* called during simulator startup */
-void pipe_init();
+/* called during simulator startup with the number of cores (1 to MAX_CORES),
+ * which share the caches marked shared and the memory system. With shared
+ * set the cores run one program in one address space and their D-caches are
+ * kept coherent. */
+void pipe_init(uint32_t cores, int shared);
 
-/* this function calls the others */
+/* select the replacement policy of "icache", "dcache" or "l2" by name,
+ * returns 0 on success and -1 for an unknown cache or policy, or a policy
+ * whose metadata can't hold the ways of the cache */
+int pipe_set_policy(const char *cache_name, const char *policy_name);
+
+/* size the victim cache behind the L1 D-cache, 0 disables it,
+ * returns -1 for sizes outside 4 to 32 entries, or if the cores share memory */
+int pipe_set_victim_entries(uint32_t num_entries);
+
+/* select DRAM timing by preset name (lab|ddr3|ddr4|lpddr4|hbm), or timing
+ * and organization from a file, and print them; returns -1 if neither matches */
+int pipe_set_dram_config(const char *name);
+
+/* select the DRAM request scheduler (fcfs|frfcfs|frfcfs-cap|parbs|atlas|
+ * bliss), returns -1 for an unknown one */
+int pipe_set_mem_scheduler(const char *name);
+
+/* select the DRAM row buffer policy (open|closed|timeout|adaptive), returns
+ * -1 for an unknown one */
+int pipe_set_row_policy(const char *name);
+
+/* select the DRAM refresh mode (off|all|perbank, -flex to postpone and pull
+ * in), returns -1 for an unknown or unsupported one */
+int pipe_set_refresh_mode(const char *name);
+
+/* select the coherence protocol of cores sharing memory (mesi|moesi), returns
+ * -1 for an unknown one */
+int pipe_set_coherence(const char *name);
+
+/* set the IPC of a core's program when it runs alone, used to report the
+ * weighted speedup. Returns -1 for an unknown core or a non-positive IPC. */
+int pipe_set_alone_ipc(uint32_t core, double ipc);
+
+/* Run n instructions of each core (or until it exits) on the threaded
+ * interpreter of the functional model, without timing, then leave the
+ * pipelines to continue from there. Returns -1 once the simulation has
+ * started. */
+int pipe_fast_forward(uint64_t n);
+
+/* Run the cores on host threads for quanta of quantum cycles (1 to
+ * MAX_QUANTUM), synchronized with the shared levels between quanta; 0 uses
+ * the lookahead quantum, the cycles until an L2 hit reaches the L1, which
+ * keeps the timing exact. Returns -1 if the quantum is too long, or if there
+ * is a single core, the cores share memory (coherence reaches into the other
+ * cores' caches) or the inclusion policy isn't nine (inclusive and exclusive
+ * levels move blocks between the shared and private caches). */
+int pipe_set_parallel(uint32_t quantum);
+
+/* Run all cores in one thread again */
+void pipe_set_serial();
+
+/* print per-core, cache and memory statistics */
+void pipe_print_stats();
+
+/* print the per cycle accounting of the memory controllers */
+void pipe_print_memstats();
+
+/* write it as JSON to the file at path, "-" for stdout; returns -1 if the
+ * file can't be created */
+int pipe_write_memstats_json(const char *path);
+
+/* this function calls the others, for each core that has not halted, and
+ * then simulates the shared memory system. With host threads, it simulates
+ * a quantum and advances stat_cycles to the last cycle of it. */
 void pipe_cycle();
 
+/* one cycle of a core, the stages if it runs, freeing the MSHRs of its last
+ * misses if it halted */
+void pipe_core_cycle(Pipe_State *p);
+
 /* helper: pipe stages can call this to schedule a branch recovery */
 /* flushes 'flush' stages (1 = execute only, 2 = fetch/decode, ...) and then
  * sets the fetch PC to the given destination. */
-void pipe_recover(int flush, uint32_t dest);
-
-/* each of these functions implements one stage of the pipeline */
-void pipe_stage_fetch();
-void pipe_stage_decode();
-void pipe_stage_execute();
-void pipe_stage_mem();
-void pipe_stage_wb();
+void pipe_recover(Pipe_State *p, int flush, uint32_t dest);
+
+/* each of these functions implements one stage of the pipeline of a core */
+void pipe_stage_fetch(Pipe_State *p);
+void pipe_stage_decode(Pipe_State *p);
+void pipe_stage_execute(Pipe_State *p);
+void pipe_stage_mem(Pipe_State *p);
+void pipe_stage_wb(Pipe_State *p);
 
 #endif
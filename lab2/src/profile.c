@@ -0,0 +1,131 @@
+#include "profile.h"
+#include "disasm.h"
+#include "pipe.h"
+#include "shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static ProfileEntry *profiles[MAX_CORES];
+
+void profile_start() {
+    profile_stop();
+    for (uint32_t core = 0; core < num_cores; core++) {
+        profiles[core] = calloc(PROFILE_TEXT_WORDS, sizeof(ProfileEntry));
+        pipes[core].profile = profiles[core];
+    }
+}
+
+void profile_stop() {
+    for (uint32_t core = 0; core < MAX_CORES; core++) {
+        free(profiles[core]);
+        profiles[core] = NULL;
+        pipes[core].profile = NULL;
+    }
+}
+
+// profile being sorted by compare_hot
+static const ProfileEntry *sorted_profile;
+
+// Order text indices by cycles, most first, then by address
+static int compare_hot(const void *a, const void *b) {
+    uint32_t i = *(const uint32_t *)a, j = *(const uint32_t *)b;
+    uint64_t ci = sorted_profile[i].cycles, cj = sorted_profile[j].cycles;
+    if (ci != cj) {
+        return ci > cj ? -1 : 1;
+    }
+    return i < j ? -1 : i > j;
+}
+
+static int compare_address(const void *a, const void *b) {
+    uint32_t i = *(const uint32_t *)a, j = *(const uint32_t *)b;
+    return i < j ? -1 : i > j;
+}
+
+static int profiled(const ProfileEntry *e) {
+    return e->cycles || e->retired || e->icache_misses || e->flushes;
+}
+
+// Column headers, with a D-cache miss column per level below the core's L1
+// D-cache; the last cache column also counts misses served by deeper levels
+static void print_header(uint32_t core) {
+    printf("%12s %6s %10s %7s", "cycles", "share", "retired", "I-miss");
+    const Cache *c = dcache[core]->next;
+    for (uint32_t level = 0; level < PROFILE_LEVELS - 1; level++) {
+        if (c) {
+            printf(" %7.7s", c->name);
+            c = c->next;
+        } else {
+            printf(" %7s", "-");
+        }
+    }
+    printf(" %7s %7s %7s  %-10s %s\n", "memory", "rowconf", "flushes", "address", "instruction");
+}
+
+static void print_entry(uint32_t core, const ProfileEntry *profile, uint32_t i, uint64_t total) {
+    const ProfileEntry *e = &profile[i];
+    uint32_t pc = PROFILE_TEXT_START + 4 * i;
+    char text[DISASM_LEN];
+    disassemble(mem_read_32(core_address(core, pc)), pc, text, sizeof(text));
+
+    printf("%12llu %5.1f%% %10u %7u", (unsigned long long)e->cycles,
+           total ? 100.0 * e->cycles / total : 0.0, e->retired, e->icache_misses);
+    for (uint32_t level = 0; level < PROFILE_LEVELS; level++) {
+        printf(" %7u", e->dcache_misses[level]);
+    }
+    printf(" %7u %7u  0x%08x %s\n", e->row_conflicts, e->flushes, pc, text);
+}
+
+static void print_core_profile(uint32_t core, uint32_t top) {
+    const ProfileEntry *profile = profiles[core];
+
+    uint64_t total = 0, retired = 0;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < PROFILE_TEXT_WORDS; i++) {
+        total += profile[i].cycles;
+        retired += profile[i].retired;
+        n += profiled(&profile[i]);
+    }
+
+    uint32_t *order = malloc((n ? n : 1) * sizeof(uint32_t));
+    n = 0;
+    for (uint32_t i = 0; i < PROFILE_TEXT_WORDS; i++) {
+        if (profiled(&profile[i])) {
+            order[n++] = i;
+        }
+    }
+
+    printf("Profile of core %u: %llu cycles, %llu retired\n", core, (unsigned long long)total,
+           (unsigned long long)retired);
+
+    // hot spots
+    sorted_profile = profile;
+    qsort(order, n, sizeof(uint32_t), compare_hot);
+    printf("\nTop %u instructions by cycles:\n", top < n ? top : n);
+    print_header(core);
+    for (uint32_t k = 0; k < n && k < top; k++) {
+        print_entry(core, profile, order[k], total);
+    }
+
+    // annotated listing, a blank line where unprofiled instructions are left out
+    qsort(order, n, sizeof(uint32_t), compare_address);
+    printf("\nAnnotated listing:\n");
+    print_header(core);
+    for (uint32_t k = 0; k < n; k++) {
+        if (k > 0 && order[k] != order[k - 1] + 1) {
+            printf("\n");
+        }
+        print_entry(core, profile, order[k], total);
+    }
+    printf("\n");
+    free(order);
+}
+
+void print_profile(uint32_t top) {
+    if (profiles[0] == NULL) {
+        printf("Profiling is off, start it with: profile on\n");
+        return;
+    }
+    for (uint32_t core = 0; core < num_cores; core++) {
+        print_core_profile(core, top);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// text segment of a program (shell.c), a profile has an entry per word
+#define PROFILE_TEXT_START 0x00400000
+#define PROFILE_TEXT_WORDS (0x00100000 / 4)
+
+// levels below the L1 D-cache a profile tells D-cache misses apart by, the
+// last one is memory and deeper cache levels count as the one before it
+#define PROFILE_LEVELS 4
+
+// hottest instructions listed by default
+#define PROFILE_TOP 20
+
+// Events of one static instruction
+typedef struct ProfileEntry {
+    uint64_t cycles;                        // cycles it was the oldest in the pipeline
+    uint32_t retired;                       // times it retired
+    uint32_t icache_misses;                 // I-cache misses fetching it
+    uint32_t dcache_misses[PROFILE_LEVELS]; // D-cache misses by the level that served them
+    uint32_t row_conflicts;                 // of its misses, DRAM accesses that found another
+                                            // row open
+    uint32_t flushes;                       // times it flushed the pipeline as a taken branch
+} ProfileEntry;
+
+/**
+ * Per-PC profile of each core: a flat array indexed by text offset, which the
+ * pipeline stages update through Pipe_State.profile while profiling is on. A
+ * cycle is charged to the oldest instruction in the pipeline, the one about to
+ * retire, so a stall is charged to the instruction that causes it; with an
+ * empty pipeline the cycle goes to the instruction being fetched.
+ */
+
+/* Start profiling every core from zero */
+void profile_start();
+
+/* Stop profiling and drop the profiles */
+void profile_stop();
+
+/* Entry of the instruction at pc in a core's profile, NULL if profiling is
+ * off (profile is NULL) or pc is outside the text segment */
+static inline ProfileEntry *profile_at(ProfileEntry *profile, uint32_t pc) {
+    uint32_t i = (pc - PROFILE_TEXT_START) / 4;
+    return profile && i < PROFILE_TEXT_WORDS ? &profile[i] : NULL;
+}
+
+/* Print the top instructions of each core by cycles, then the profiled
+ * instructions in address order, annotated with their share of the cycles */
+void print_profile(uint32_t top);
+
+#endif
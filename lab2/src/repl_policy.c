@@ -0,0 +1,308 @@
+#include "repl_policy.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// All replacement state of a set is packed into its set_meta word and updated
+// with SWAR (SIMD within a register) bit tricks:
+//   LRU, FIFO: 4-bit recency nibble per way (up to 16 ways)
+//   LFU:       4-bit saturating use counter per way (up to 16 ways)
+//   RRIP:      2-bit RRPV per way (up to 32 ways)
+//   tree-PLRU: num_ways - 1 tree node bits (up to 32 ways)
+
+#define NIBBLE_ONES 0x1111111111111111ull
+#define NIBBLE_HIGH 0x8888888888888888ull
+#define BYTE_LOW_NIBBLES 0x0F0F0F0F0F0F0F0Full
+#define BYTE_HIGH 0x8080808080808080ull
+#define BYTE_ONES 0x0101010101010101ull
+#define RRPV_ONES 0x5555555555555555ull
+#define RRPV_HIGH 0xAAAAAAAAAAAAAAAAull
+
+static inline uint32_t nibble(uint64_t word, uint32_t way) { return (word >> (4 * way)) & 0xF; }
+
+static inline uint64_t set_nibble(uint64_t word, uint32_t way, uint64_t value) {
+    return (word & ~(0xFull << (4 * way))) | (value << (4 * way));
+}
+
+// Index of the first nibble equal to value, the word must contain it. A zero
+// nibble of word ^ value has no borrow coming in from below, so the lowest
+// flagged nibble is always exact.
+static inline uint32_t find_nibble(uint64_t word, uint32_t value) {
+    uint64_t x = word ^ (value * NIBBLE_ONES);
+    uint64_t zero = (x - NIBBLE_ONES) & ~x & NIBBLE_HIGH;
+    assert(zero);
+    return __builtin_ctzll(zero) / 4;
+}
+
+// Per byte lane "a >= b" for lanes holding values 0..15: setting the high bit
+// of every lane in a keeps the subtraction from borrowing across lanes, and
+// the high bit survives exactly where a >= b. Returns 0x01 per such lane.
+static inline uint64_t bytes_ge(uint64_t a, uint64_t b) {
+    return (((a | BYTE_HIGH) - b) & BYTE_HIGH) >> 7;
+}
+
+// Per byte lane minimum of lanes holding values 0..15
+static inline uint64_t bytes_min(uint64_t a, uint64_t b) {
+    uint64_t a_ge = bytes_ge(a, b) * 0xFF;
+    return (b & a_ge) | (a & ~a_ge);
+}
+
+// Nibbles of padding ways (num_ways..15) are kept at 15, so they are never
+// below a recency and never win a minimum search over the real ways.
+static uint64_t padding_nibbles(Cache *c) {
+    return c->num_ways >= 16 ? 0 : ~0ull << (4 * c->num_ways);
+}
+
+// callers reject caches with more ways than max_ways before init
+static void check_nibble_ways(Cache *c) {
+    assert(c->num_ways <= NIBBLE_MAX_WAYS && "4-bit packed metadata supports up to 16 ways");
+}
+
+// ======================
+// LRU: nibble = recency, 0 -> most recently used, num_ways - 1 -> LRU
+
+static void lru_init(Cache *c) {
+    check_nibble_ways(c);
+
+    // recencies of a set always form a permutation of [0, num_ways)
+    uint64_t word = padding_nibbles(c);
+    for (uint32_t w = 0; w < c->num_ways; w++) {
+        word = set_nibble(word, w, w);
+    }
+    for (size_t s = 0; s < c->num_sets; s++) {
+        c->set_meta[s] = word;
+    }
+}
+
+static void update_lru(Cache *c, uint32_t set, uint32_t block) {
+    uint64_t word = c->set_meta[set];
+    uint64_t prev_recency = nibble(word, block);
+
+    // increment the recency for blocks that were prev. more recent: spread
+    // even and odd nibbles into byte lanes, so every lane has headroom for
+    // the compare and the increment
+    uint64_t prev = prev_recency * BYTE_ONES;
+    uint64_t even = word & BYTE_LOW_NIBBLES;
+    uint64_t odd = (word >> 4) & BYTE_LOW_NIBBLES;
+    even += bytes_ge(even, prev) ^ BYTE_ONES;
+    odd += bytes_ge(odd, prev) ^ BYTE_ONES;
+    word = even | (odd << 4);
+
+    // and most recently updated block gets the lru pos 0;
+    c->set_meta[set] = set_nibble(word, block, 0);
+}
+
+static uint32_t lru_victim(Cache *c, uint32_t set) {
+    // evict the least recently used block
+    return find_nibble(c->set_meta[set], c->num_ways - 1);
+}
+
+// ======================
+// Random: no metadata
+
+static void no_init(Cache *c) {}
+
+static void no_update(Cache *c, uint32_t set, uint32_t way) {}
+
+static uint32_t rand_victim(Cache *c, uint32_t set) { return rand() % c->num_ways; }
+
+// ======================
+// RRIP family: 2-bit RRPV per way
+// https://people.csail.mit.edu/emer/media/papers/2010.06.isca.rrip.pdf
+
+static inline uint64_t set_rrpv(uint64_t word, uint32_t way, uint64_t rrpv) {
+    return (word & ~(3ull << (2 * way))) | (rrpv << (2 * way));
+}
+
+// mask with the low bit of every real way's RRPV set
+static uint64_t rrpv_lanes(Cache *c) {
+    return c->num_ways >= 32 ? RRPV_ONES : RRPV_ONES & ((1ull << (2 * c->num_ways)) - 1);
+}
+
+static void rrip_init(Cache *c) {
+    assert(c->num_ways <= 32);
+    for (size_t s = 0; s < c->num_sets; s++) {
+        c->set_meta[s] = DISTANT_RRPV * rrpv_lanes(c);
+    }
+    c->psel = PSEL_MAX / 2;
+    c->tick = 0;
+}
+
+static void rrip_hit(Cache *c, uint32_t set, uint32_t way) {
+    // hit priority: predict near-immediate re-reference
+    c->set_meta[set] = set_rrpv(c->set_meta[set], way, IMMEDIATE_RRPV);
+}
+
+static uint32_t rrip_victim(Cache *c, uint32_t set) {
+    uint64_t word = c->set_meta[set];
+
+    // age the whole set until some block reaches DISTANT_RRPV, done in one
+    // add of the distance between the oldest block and DISTANT_RRPV
+    uint64_t distant = word & (word >> 1) & RRPV_ONES;
+    if (!distant) {
+        uint64_t age;
+        if (word & RRPV_HIGH) {
+            age = 1; // oldest is LONG_RRPV
+        } else if (word) {
+            age = 2;
+        } else {
+            age = 3;
+        }
+        word += age * rrpv_lanes(c);
+        c->set_meta[set] = word;
+        distant = word & (word >> 1) & RRPV_ONES;
+    }
+
+    return __builtin_ctzll(distant) / 2;
+}
+
+static void srrip_fill(Cache *c, uint32_t set, uint32_t way) {
+    c->set_meta[set] = set_rrpv(c->set_meta[set], way, LONG_RRPV);
+}
+
+static void brrip_fill(Cache *c, uint32_t set, uint32_t way) {
+    // mostly insert at distant, infrequently at long re-reference interval
+    uint64_t rrpv = (c->tick++ % BRRIP_THROTTLE == 0) ? LONG_RRPV : DISTANT_RRPV;
+    c->set_meta[set] = set_rrpv(c->set_meta[set], way, rrpv);
+}
+
+typedef enum { DUEL_FOLLOWER, DUEL_SRRIP_LEADER, DUEL_BRRIP_LEADER } DuelRole;
+
+static DuelRole drrip_role(Cache *c, uint32_t set) {
+    // spread the leader sets evenly over the cache
+    uint32_t stride = c->num_sets / DUEL_LEADER_SETS;
+    if (stride < 2) {
+        stride = 2;
+    }
+
+    if (set % stride == 0) {
+        return DUEL_SRRIP_LEADER;
+    }
+    if (set % stride == 1) {
+        return DUEL_BRRIP_LEADER;
+    }
+    return DUEL_FOLLOWER;
+}
+
+static void drrip_fill(Cache *c, uint32_t set, uint32_t way) {
+    // a fill means a miss: leader sets train the policy selector
+    switch (drrip_role(c, set)) {
+    case DUEL_SRRIP_LEADER:
+        if (c->psel < PSEL_MAX) {
+            c->psel++;
+        }
+        srrip_fill(c, set, way);
+        break;
+    case DUEL_BRRIP_LEADER:
+        if (c->psel > 0) {
+            c->psel--;
+        }
+        brrip_fill(c, set, way);
+        break;
+    case DUEL_FOLLOWER:
+        // high PSEL -> SRRIP leaders miss more -> follow BRRIP
+        if (c->psel > PSEL_MAX / 2) {
+            brrip_fill(c, set, way);
+        } else {
+            srrip_fill(c, set, way);
+        }
+        break;
+    }
+}
+
+// ======================
+// Tree-PLRU: node n of the tree (heap order, root = 1) is bit n - 1 of the
+// set word. A node bit points towards the pseudo-LRU half of its subtree
+// (0 = left, 1 = right).
+
+static uint32_t plru_levels(Cache *c) { return __builtin_ctz(c->num_ways); }
+
+static void plru_init(Cache *c) {
+    assert((c->num_ways & (c->num_ways - 1)) == 0 && "tree-PLRU needs power-of-two ways");
+    assert(c->num_ways <= 32 && "tree-PLRU bits must fit in one word");
+    memset(c->set_meta, 0, c->num_sets * sizeof(uint64_t));
+}
+
+static void plru_touch(Cache *c, uint32_t set, uint32_t way) {
+    uint32_t levels = plru_levels(c);
+    uint32_t node = 1;
+
+    // walk from the root to the accessed leaf, pointing each node away from it
+    for (uint32_t l = 0; l < levels; l++) {
+        uint64_t dir = (way >> (levels - 1 - l)) & 1;
+        c->set_meta[set] = (c->set_meta[set] & ~(1ull << (node - 1))) | ((dir ^ 1) << (node - 1));
+        node = 2 * node + dir;
+    }
+}
+
+static uint32_t plru_victim(Cache *c, uint32_t set) {
+    uint32_t levels = plru_levels(c);
+    uint32_t node = 1;
+
+    // follow the node bits down to the pseudo-LRU leaf
+    for (uint32_t l = 0; l < levels; l++) {
+        node = 2 * node + ((c->set_meta[set] >> (node - 1)) & 1);
+    }
+    return node - c->num_ways;
+}
+
+// ======================
+// LFU: nibble = saturating use count, ties broken towards the lowest way
+
+static void lfu_init(Cache *c) {
+    check_nibble_ways(c);
+    for (size_t s = 0; s < c->num_sets; s++) {
+        c->set_meta[s] = padding_nibbles(c);
+    }
+}
+
+static void lfu_hit(Cache *c, uint32_t set, uint32_t way) {
+    if (nibble(c->set_meta[set], way) < 0xF) {
+        c->set_meta[set] += 1ull << (4 * way);
+    }
+}
+
+static void lfu_fill(Cache *c, uint32_t set, uint32_t way) {
+    c->set_meta[set] = set_nibble(c->set_meta[set], way, 1);
+}
+
+static uint32_t lfu_victim(Cache *c, uint32_t set) {
+    uint64_t word = c->set_meta[set];
+
+    // minimum over all nibbles as a log(ways) reduction of byte lanes
+    uint64_t m = bytes_min(word & BYTE_LOW_NIBBLES, (word >> 4) & BYTE_LOW_NIBBLES);
+    m = bytes_min(m, m >> 32);
+    m = bytes_min(m, m >> 16);
+    m = bytes_min(m, m >> 8);
+
+    return find_nibble(word, m & 0xF);
+}
+
+// ======================
+// FIFO: same recency nibbles as LRU, but only insertion updates the order
+
+const ReplPolicy repl_lru = {"lru", NIBBLE_MAX_WAYS, lru_init, update_lru, update_lru, lru_victim};
+const ReplPolicy repl_rand = {"rand", CACHE_MAX_WAYS, no_init, no_update, no_update, rand_victim};
+const ReplPolicy repl_srrip = {"srrip", CACHE_MAX_WAYS, rrip_init, rrip_hit, srrip_fill,
+                               rrip_victim};
+const ReplPolicy repl_brrip = {"brrip", CACHE_MAX_WAYS, rrip_init, rrip_hit, brrip_fill,
+                               rrip_victim};
+const ReplPolicy repl_drrip = {"drrip", CACHE_MAX_WAYS, rrip_init, rrip_hit, drrip_fill,
+                               rrip_victim};
+const ReplPolicy repl_plru = {"plru", CACHE_MAX_WAYS, plru_init, plru_touch, plru_touch,
+                              plru_victim};
+const ReplPolicy repl_lfu = {"lfu", NIBBLE_MAX_WAYS, lfu_init, lfu_hit, lfu_fill, lfu_victim};
+const ReplPolicy repl_fifo = {"fifo", NIBBLE_MAX_WAYS, lru_init, no_update, update_lru, lru_victim};
+
+const ReplPolicy *const repl_policies[] = {&repl_lru,   &repl_rand, &repl_srrip, &repl_brrip,
+                                           &repl_drrip, &repl_plru, &repl_lfu,   &repl_fifo,
+                                           NULL};
+
+const ReplPolicy *find_repl_policy(const char *name) {
+    for (size_t i = 0; repl_policies[i] != NULL; i++) {
+        if (strcmp(repl_policies[i]->name, name) == 0) {
+            return repl_policies[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef _REPL_POLICY_H_
+#define _REPL_POLICY_H_
+
+#include "cache.h"
+#include <stdint.h>
+
+// RRIP re-reference prediction values (2-bit RRPV)
+#define IMMEDIATE_RRPV 0
+#define LONG_RRPV 2
+#define DISTANT_RRPV 3
+
+// BRRIP inserts with LONG_RRPV once every BRRIP_THROTTLE fills
+#define BRRIP_THROTTLE 32
+
+// ways of a set whose replacement state packs a 4-bit nibble per way into
+// one 64-bit word (LRU, FIFO, LFU)
+#define NIBBLE_MAX_WAYS 16
+
+// DRRIP set dueling: number of leader sets per component policy, PSEL width
+#define DUEL_LEADER_SETS 32
+#define PSEL_BITS 10
+#define PSEL_MAX ((1 << PSEL_BITS) - 1)
+
+/**
+ * Replacement policy interface. Each cache holds a pointer to one of these,
+ * so L1 and L2 can be configured with different policies at runtime.
+ *
+ * Invalid ways are always filled first by the cache itself, pick_victim is
+ * only called when every way in the set holds a valid block.
+ */
+typedef struct ReplPolicy {
+    const char *name;
+
+    /* ways of a set the packed metadata can hold */
+    uint32_t max_ways;
+
+    /* (re)initialize the replacement metadata of every block in the cache */
+    void (*init)(Cache *c);
+
+    /* block at (set, way) was accessed and hit */
+    void (*on_hit)(Cache *c, uint32_t set, uint32_t way);
+
+    /* block at (set, way) was just filled on a miss */
+    void (*on_fill)(Cache *c, uint32_t set, uint32_t way);
+
+    /* choose the way to evict from a set with no invalid ways */
+    uint32_t (*pick_victim)(Cache *c, uint32_t set);
+} ReplPolicy;
+
+extern const ReplPolicy repl_lru, repl_rand, repl_srrip, repl_brrip, repl_drrip, repl_plru,
+    repl_lfu, repl_fifo;
+
+// NULL-terminated table of all available policies
+extern const ReplPolicy *const repl_policies[];
+
+/* Look up a policy by name, returns NULL if unknown */
+const ReplPolicy *find_repl_policy(const char *name);
+
+#endif
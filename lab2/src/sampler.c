@@ -0,0 +1,121 @@
+#include "sampler.h"
+#include "mem_controller.h"
+#include "pipe.h"
+#include "shell.h"
+#include <stdio.h>
+#include <string.h>
+
+uint32_t sample_due = SAMPLER_OFF;
+
+static FILE *sample_file;
+static int binary;
+static uint32_t sample_interval;
+
+// running counters at the last sample
+static SampleRecord last;
+
+// Sum of the misses of the distinct caches among the cores' copies of a level
+static uint32_t level_misses(Cache *const *level) {
+    uint32_t misses = 0;
+    for (uint32_t core = 0; core < num_cores; core++) {
+        uint32_t seen = 0;
+        while (seen < core && level[seen] != level[core]) {
+            seen++;
+        }
+        if (level[core] && seen == core) {
+            misses += level[core]->misses;
+        }
+    }
+    return misses;
+}
+
+// Running counters of the whole machine at cycle
+static void snapshot(SampleRecord *r, uint32_t cycle) {
+    Cache *l2[MAX_CORES];
+    for (uint32_t core = 0; core < num_cores; core++) {
+        l2[core] = dcache[core]->next;
+    }
+
+    memset(r, 0, sizeof(SampleRecord));
+    r->cycle = cycle;
+    r->retired = stat_inst_retire;
+    r->l1i_misses = level_misses(icache);
+    r->l1d_misses = level_misses(dcache);
+    r->l2_misses = level_misses(l2);
+    for (uint32_t ch = 0; ch < mem_system.num_channels; ch++) {
+        const MemController *mc = &mem_system.channels[ch];
+        r->row_hits += mc->row_status[ROW_BUFFER_HIT];
+        r->row_accesses += mc->row_status[ROW_BUFFER_HIT] + mc->row_status[ROW_BUFFER_MISS] +
+                           mc->row_status[ROW_BUFFER_CONFLICT];
+        r->queue += mc->queue_size;
+    }
+    r->mshrs = mshrs_in_use();
+}
+
+static double per_kilo(uint32_t events, uint32_t retired) {
+    return retired ? 1000.0 * events / retired : 0.0;
+}
+
+int sampler_start(const char *path, uint32_t interval) {
+    sampler_stop();
+    sample_file = fopen(path, "wb");
+    if (sample_file == NULL) {
+        printf("Can't create %s\n", path);
+        return -1;
+    }
+
+    size_t len = strlen(path);
+    binary = len >= 4 && strcmp(path + len - 4, ".bin") == 0;
+    if (binary) {
+        uint32_t header[2] = {interval, sizeof(SampleRecord)};
+        fwrite("MIPSSMP1", 1, 8, sample_file);
+        fwrite(header, sizeof(header), 1, sample_file);
+    } else {
+        fprintf(sample_file, "cycle,ipc,l1i_mpki,l1d_mpki,l2_mpki,mshrs,mem_queue,row_hit_rate\n");
+    }
+
+    sample_interval = interval;
+    snapshot(&last, stat_cycles);
+    sample_due = stat_cycles + interval;
+    return 0;
+}
+
+void sampler_stop() {
+    if (sample_file) {
+        fclose(sample_file);
+        sample_file = NULL;
+    }
+    sample_due = SAMPLER_OFF;
+}
+
+void take_sample(uint32_t cycle) {
+    SampleRecord now, r;
+    snapshot(&now, cycle);
+
+    r = now;
+    r.cycles = cycle - last.cycle;
+    r.retired -= last.retired;
+    r.l1i_misses -= last.l1i_misses;
+    r.l1d_misses -= last.l1d_misses;
+    r.l2_misses -= last.l2_misses;
+    r.row_hits -= last.row_hits;
+    r.row_accesses -= last.row_accesses;
+    last = now;
+
+    // a quantum of parallel simulation may cover several intervals
+    while (sample_due <= cycle) {
+        sample_due += sample_interval;
+    }
+
+    if (r.cycles == 0) {
+        return;
+    }
+    if (binary) {
+        fwrite(&r, sizeof(r), 1, sample_file);
+        return;
+    }
+    fprintf(sample_file, "%u,%.4f,%.3f,%.3f,%.3f,%u,%u,%.4f\n", r.cycle,
+            (double)r.retired / r.cycles, per_kilo(r.l1i_misses, r.retired),
+            per_kilo(r.l1d_misses, r.retired), per_kilo(r.l2_misses, r.retired), r.mshrs, r.queue,
+            r.row_accesses ? (double)r.row_hits / r.row_accesses : 0.0);
+}
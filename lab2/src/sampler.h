@@ -0,0 +1,58 @@
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+#include <stdint.h>
+
+// sample_due while sampling is off
+#define SAMPLER_OFF UINT32_MAX
+
+// Statistics of one interval, one record of a binary sample file
+typedef struct SampleRecord {
+    uint32_t cycle;        // last cycle of the interval
+    uint32_t cycles;       // length of the interval
+    uint32_t retired;      // instructions retired by all cores
+    uint32_t l1i_misses;   // misses of the L1 I-caches
+    uint32_t l1d_misses;   // misses of the L1 D-caches
+    uint32_t l2_misses;    // misses of the level below the L1 D-caches
+    uint32_t row_hits;     // DRAM requests served from an open row
+    uint32_t row_accesses; // DRAM requests served
+    uint16_t mshrs;        // MSHRs in use at the end of the interval
+    uint16_t queue;        // requests queued at the memory controllers then
+} SampleRecord;
+
+/**
+ * Time series of the machine's statistics, sampled every interval cycles.
+ * A sample snapshots the running counters of the cores, caches and memory
+ * controllers and records their differences from the previous one, nothing
+ * is counted per cycle. A file ending in .bin gets an 8 byte magic
+ * "MIPSSMP1", the interval and the record size as uint32_t, then a
+ * SampleRecord per interval in host byte order; any other file gets CSV
+ * with IPC, MPKI and the row buffer hit rate computed per interval.
+ */
+
+/* Start sampling every interval cycles into the file at path, ending the
+ * previous series. Returns -1 if the file can't be created. */
+int sampler_start(const char *path, uint32_t interval);
+
+/* End the series and close its file */
+void sampler_stop();
+
+// cycle the next sample is taken in, SAMPLER_OFF if sampling is off
+extern uint32_t sample_due;
+
+/* Record the interval ending at cycle */
+void take_sample(uint32_t cycle);
+
+/* Called after each simulated cycle (or quantum) with the cycle count and
+ * whether the last core halted, which ends the series with a partial
+ * interval */
+static inline void sample_cycle(uint32_t cycle, int halted) {
+    if (cycle >= sample_due || (halted && sample_due != SAMPLER_OFF)) {
+        take_sample(cycle);
+        if (halted) {
+            sampler_stop();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "sched_policy.h"
+#include <stddef.h>
+#include <string.h>
+
+int request_before(const MemRequest *a, const MemRequest *b) {
+    if (a->arrival_cycle != b->arrival_cycle) {
+        return a->arrival_cycle < b->arrival_cycle;
+    }
+    return a->from_mem_stage && !b->from_mem_stage;
+}
+
+static void no_init(MemController *mc) {}
+
+static void no_cycle(MemController *mc, uint32_t now) {}
+
+static void no_issue(MemController *mc, MemRequest *req, uint32_t service, uint32_t now) {}
+
+// Rank sources by ascending key, ties by source number
+static void rank_sources(SchedState *st, const double *key) {
+    for (uint32_t s = 0; s < MAX_MEM_SOURCES; s++) {
+        st->rank[s] = 0;
+        for (uint32_t o = 0; o < MAX_MEM_SOURCES; o++) {
+            st->rank[s] += key[o] < key[s] || (key[o] == key[s] && o < s);
+        }
+    }
+}
+
+// ======================
+// FCFS: oldest first
+
+static int fcfs_before(MemController *mc, MemRequest *a, int a_hit, MemRequest *b, int b_hit,
+                       uint32_t now) {
+    return request_before(a, b);
+}
+
+// ======================
+// FR-FCFS, optionally capping row hit streaks
+
+// row hits first, then oldest first
+static int frfcfs_before(MemController *mc, MemRequest *a, int a_hit, MemRequest *b, int b_hit,
+                         uint32_t now) {
+    if (a_hit != b_hit) {
+        return a_hit;
+    }
+    return request_before(a, b);
+}
+
+// a row hit only counts as one while its bank is below the streak cap
+static int frfcfs_cap_before(MemController *mc, MemRequest *a, int a_hit, MemRequest *b,
+                             int b_hit, uint32_t now) {
+    a_hit = a_hit && mc->banks[a->bank].hit_streak < ROW_HIT_CAP;
+    b_hit = b_hit && mc->banks[b->bank].hit_streak < ROW_HIT_CAP;
+    return frfcfs_before(mc, a, a_hit, b, b_hit, now);
+}
+
+// ======================
+// PAR-BS: parallelism-aware batch scheduling
+// (Mutlu and Moscibroda, ISCA 2008)
+
+static void parbs_init(MemController *mc) {
+    SchedState *st = &mc->sched_state;
+    st->marked = 0;
+    memset(st->rank, 0, sizeof(st->rank));
+    for (uint32_t i = 0; i < mc->queue_capacity; i++) {
+        mc->queue[i].marked = 0;
+    }
+}
+
+// Mark the oldest requests of each source in a bank into the batch, walking
+// its two lists in service order. Returns the number of marked requests per
+// source through count.
+static void parbs_mark_bank(SchedState *st, Bank *bank, uint32_t now, uint32_t *count) {
+    MemRequest *a = bank->hits.head, *b = bank->others.head;
+    while (a || b) {
+        MemRequest *req;
+        if (b == NULL || (a && !request_before(b, a))) {
+            req = a;
+            a = a->next;
+        } else {
+            req = b;
+            b = b->next;
+        }
+        if (req->arrival_cycle <= now && count[req->source] < PARBS_MARKING_CAP) {
+            req->marked = 1;
+            count[req->source]++;
+            st->marked++;
+        }
+    }
+}
+
+// Form a new batch once the previous one is served. Sources with the lowest
+// load on their busiest bank, then the fewest marked requests, rank highest.
+static void parbs_cycle(MemController *mc, uint32_t now) {
+    SchedState *st = &mc->sched_state;
+    if (st->marked != 0 || mc->queue_size == 0) {
+        return;
+    }
+
+    uint32_t max_load[MAX_MEM_SOURCES] = {0}, total[MAX_MEM_SOURCES] = {0};
+    for (uint32_t b = 0; b < mc->num_banks; b++) {
+        uint32_t count[MAX_MEM_SOURCES] = {0};
+        parbs_mark_bank(st, &mc->banks[b], now, count);
+        for (uint32_t s = 0; s < MAX_MEM_SOURCES; s++) {
+            max_load[s] = count[s] > max_load[s] ? count[s] : max_load[s];
+            total[s] += count[s];
+        }
+    }
+
+    double key[MAX_MEM_SOURCES];
+    for (uint32_t s = 0; s < MAX_MEM_SOURCES; s++) {
+        key[s] = (double)max_load[s] * mc->queue_capacity + total[s];
+    }
+    rank_sources(st, key);
+}
+
+// marked first, then row hits, then higher ranked sources, then oldest
+static int parbs_before(MemController *mc, MemRequest *a, int a_hit, MemRequest *b, int b_hit,
+                        uint32_t now) {
+    const SchedState *st = &mc->sched_state;
+    if (a->marked != b->marked) {
+        return a->marked;
+    }
+    if (a_hit != b_hit) {
+        return a_hit;
+    }
+    if (st->rank[a->source] != st->rank[b->source]) {
+        return st->rank[a->source] < st->rank[b->source];
+    }
+    return request_before(a, b);
+}
+
+static void parbs_issue(MemController *mc, MemRequest *req, uint32_t service, uint32_t now) {
+    if (req->marked) {
+        req->marked = 0;
+        mc->sched_state.marked--;
+    }
+}
+
+// ======================
+// ATLAS: least attained service first
+// (Kim et al., HPCA 2010)
+
+static void atlas_init(MemController *mc) {
+    SchedState *st = &mc->sched_state;
+    memset(st->rank, 0, sizeof(st->rank));
+    memset(st->attained, 0, sizeof(st->attained));
+    memset(st->total_attained, 0, sizeof(st->total_attained));
+    st->quantum_end = ATLAS_QUANTUM;
+}
+
+// At the end of a quantum, rank sources by least attained service
+static void atlas_cycle(MemController *mc, uint32_t now) {
+    SchedState *st = &mc->sched_state;
+    if (now < st->quantum_end) {
+        return;
+    }
+    for (uint32_t s = 0; s < MAX_MEM_SOURCES; s++) {
+        st->total_attained[s] = ATLAS_HISTORY_WEIGHT * st->total_attained[s] +
+                                (1 - ATLAS_HISTORY_WEIGHT) * st->attained[s];
+        st->attained[s] = 0;
+    }
+    rank_sources(st, st->total_attained);
+    st->quantum_end = now + ATLAS_QUANTUM;
+}
+
+// requests waiting past the age threshold first, then higher ranked
+// sources, then row hits, then oldest
+static int atlas_before(MemController *mc, MemRequest *a, int a_hit, MemRequest *b, int b_hit,
+                        uint32_t now) {
+    const SchedState *st = &mc->sched_state;
+    int a_old = now - a->arrival_cycle >= ATLAS_AGE_THRESHOLD;
+    int b_old = now - b->arrival_cycle >= ATLAS_AGE_THRESHOLD;
+    if (a_old != b_old) {
+        return a_old;
+    }
+    if (!a_old && st->rank[a->source] != st->rank[b->source]) {
+        return st->rank[a->source] < st->rank[b->source];
+    }
+    if (a_hit != b_hit) {
+        return a_hit;
+    }
+    return request_before(a, b);
+}
+
+static void atlas_issue(MemController *mc, MemRequest *req, uint32_t service, uint32_t now) {
+    mc->sched_state.attained[req->source] += service;
+}
+
+// ======================
+// BLISS: blacklist sources served many times in a row
+// (Subramanian et al., ICCD 2014)
+
+static void bliss_init(MemController *mc) {
+    SchedState *st = &mc->sched_state;
+    memset(st->blacklisted, 0, sizeof(st->blacklisted));
+    st->last_source = 0;
+    st->streak = 0;
+    st->clear_at = BLISS_CLEAR_INTERVAL;
+}
+
+static void bliss_cycle(MemController *mc, uint32_t now) {
+    SchedState *st = &mc->sched_state;
+    if (now >= st->clear_at) {
+        memset(st->blacklisted, 0, sizeof(st->blacklisted));
+        st->clear_at = now + BLISS_CLEAR_INTERVAL;
+    }
+}
+
+// sources not blacklisted first, then row hits, then oldest
+static int bliss_before(MemController *mc, MemRequest *a, int a_hit, MemRequest *b, int b_hit,
+                        uint32_t now) {
+    const SchedState *st = &mc->sched_state;
+    if (st->blacklisted[a->source] != st->blacklisted[b->source]) {
+        return !st->blacklisted[a->source];
+    }
+    return frfcfs_before(mc, a, a_hit, b, b_hit, now);
+}
+
+// A source served BLISS_THRESHOLD times in a row is blacklisted
+static void bliss_issue(MemController *mc, MemRequest *req, uint32_t service, uint32_t now) {
+    SchedState *st = &mc->sched_state;
+    if (req->source != st->last_source) {
+        st->last_source = req->source;
+        st->streak = 0;
+    }
+    if (++st->streak >= BLISS_THRESHOLD) {
+        st->blacklisted[req->source] = 1;
+        st->streak = 0;
+    }
+}
+
+// ======================
+// Policy table
+
+const SchedPolicy sched_fcfs = {"fcfs", 0, no_init, no_cycle, fcfs_before, no_issue};
+const SchedPolicy sched_frfcfs = {"frfcfs", 0, no_init, no_cycle, frfcfs_before, no_issue};
+const SchedPolicy sched_frfcfs_cap = {"frfcfs-cap", 0, no_init, no_cycle, frfcfs_cap_before,
+                                      no_issue};
+const SchedPolicy sched_parbs = {"parbs", 1, parbs_init, parbs_cycle, parbs_before, parbs_issue};
+const SchedPolicy sched_atlas = {"atlas", 1, atlas_init, atlas_cycle, atlas_before, atlas_issue};
+const SchedPolicy sched_bliss = {"bliss", 1, bliss_init, bliss_cycle, bliss_before, bliss_issue};
+
+const SchedPolicy *const sched_policies[] = {&sched_fcfs,  &sched_frfcfs, &sched_frfcfs_cap,
+                                             &sched_parbs, &sched_atlas,  &sched_bliss,
+                                             NULL};
+
+const SchedPolicy *find_sched_policy(const char *name) {
+    for (size_t i = 0; sched_policies[i] != NULL; i++) {
+        if (strcmp(sched_policies[i]->name, name) == 0) {
+            return sched_policies[i];
+        }
+    }
+    return NULL;
+}
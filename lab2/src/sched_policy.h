@@ -0,0 +1,64 @@
+#ifndef _SCHED_POLICY_H_
+#define _SCHED_POLICY_H_
+
+#include "mem_controller.h"
+#include <stdint.h>
+
+// FR-FCFS+Cap: row hits stop bypassing older requests after this many in a row
+#define ROW_HIT_CAP 4
+
+// PAR-BS: requests of one source per bank marked into a batch
+#define PARBS_MARKING_CAP 5
+
+// ATLAS: ranking quantum, weight of past quanta, age that overrides ranking
+#define ATLAS_QUANTUM 10000
+#define ATLAS_HISTORY_WEIGHT 0.875
+#define ATLAS_AGE_THRESHOLD 5000
+
+// BLISS: requests served in a row that blacklist a source, blacklist lifetime
+#define BLISS_THRESHOLD 4
+#define BLISS_CLEAR_INTERVAL 10000
+
+/**
+ * Memory request scheduling policy interface. Each channel's controller holds
+ * a pointer to one of these, selected at runtime.
+ *
+ * The controller only offers requests whose commands fit the DRAM timing in
+ * the current cycle and issues the one the policy ranks first. Requests of a
+ * bank list have the same row buffer status; policies that rank only by row
+ * hit, bank and age see just the oldest of each list.
+ */
+typedef struct SchedPolicy {
+    const char *name;
+
+    /* 1 = rank every queued request, 0 = only the oldest of each bank list */
+    uint8_t scan_all;
+
+    /* (re)initialize the policy state of a controller */
+    void (*init)(MemController *mc);
+
+    /* called each cycle before a request is selected */
+    void (*on_cycle)(MemController *mc, uint32_t now);
+
+    /* 1 if request a (a row hit if a_hit) goes before b */
+    int (*before)(MemController *mc, MemRequest *a, int a_hit, MemRequest *b, int b_hit,
+                  uint32_t now);
+
+    /* req was issued, keeping its bank busy for service cycles */
+    void (*on_issue)(MemController *mc, MemRequest *req, uint32_t service, uint32_t now);
+} SchedPolicy;
+
+extern const SchedPolicy sched_fcfs, sched_frfcfs, sched_frfcfs_cap, sched_parbs, sched_atlas,
+    sched_bliss;
+
+// NULL-terminated table of all available policies
+extern const SchedPolicy *const sched_policies[];
+
+/* Look up a policy by name, returns NULL if unknown */
+const SchedPolicy *find_sched_policy(const char *name);
+
+/* 1 if a is served before b among requests of the same priority: earlier
+ * arrival first, MEM stage before fetch among equals */
+int request_before(const MemRequest *a, const MemRequest *b);
+
+#endif
@@ -18,6 +18,12 @@
 
 #include "shell.h"
 #include "pipe.h"
+#include "hierarchy.h"
+#include "frontend.h"
+#include "lockstep.h"
+#include "parallel.h"
+#include "profile.h"
+#include "sampler.h"
 
 /***************************************************************/
 /* Statistics.                                                 */
@@ -41,13 +47,11 @@ uint32_t stat_squash = 0;
 #define MEM_KTEXT_START 0x80000000
 #define MEM_KTEXT_SIZE  0x00100000
 
-typedef struct {
-    uint32_t start, size;
-    uint8_t *mem;
-} mem_region_t;
+#define MEM_REGIONS_PER_CORE 5
 
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
+/* memory will be dynamically allocated at initialization, each core gets
+   its own copy of the regions at its physical addresses (see pipe.h) */
+mem_region_t MEM_REGIONS[MEM_REGIONS_PER_CORE * MAX_CORES] = {
     { MEM_TEXT_START, MEM_TEXT_SIZE, NULL },
     { MEM_DATA_START, MEM_DATA_SIZE, NULL },
     { MEM_STACK_START, MEM_STACK_SIZE, NULL },
@@ -55,7 +59,8 @@ mem_region_t MEM_REGIONS[] = {
     { MEM_KTEXT_START, MEM_KTEXT_SIZE, NULL }
 };
 
-#define MEM_NREGIONS (sizeof(MEM_REGIONS)/sizeof(mem_region_t))
+/* regions in use, those of all cores */
+int MEM_NREGIONS = MEM_REGIONS_PER_CORE;
 
 int RUN_BIT = TRUE;
 
@@ -123,6 +128,48 @@ void help() {
   printf("rdump                  -  dump architectural registers      \n");
   printf("mdump low high         -  dump memory from low to high      \n");
   printf("input reg_no reg_value - set GPR reg_no to reg_value  \n");
+  printf("policy cache name      -  set replacement policy of cache   \n");
+  printf("                          (icache|dcache|l2|..., lru|rand|srrip|\n");
+  printf("                          brrip|drrip|plru|lfu|fifo)        \n");
+  printf("victim n               -  set D-cache victim cache entries  \n");
+  printf("                          (0 = off, 4 to 32)                \n");
+  printf("inclusion name         -  set inclusion of the lower levels \n");
+  printf("                          (nine|inclusive|exclusive)        \n");
+  printf("config file            -  load cache hierarchy from a file  \n");
+  printf("dram preset|file       -  set DRAM timing                   \n");
+  printf("                          (lab|ddr3|ddr4|lpddr4|hbm or a file)\n");
+  printf("scheduler name         -  set DRAM request scheduler        \n");
+  printf("                          (fcfs|frfcfs|frfcfs-cap|parbs|atlas|\n");
+  printf("                          bliss)                            \n");
+  printf("rowpolicy name         -  set DRAM row buffer policy        \n");
+  printf("                          (open|closed|timeout|adaptive)    \n");
+  printf("refresh mode           -  set DRAM refresh mode             \n");
+  printf("                          (off|all|perbank, -flex suffix to \n");
+  printf("                          postpone and pull in refreshes)   \n");
+  printf("coherence name         -  set D-cache coherence protocol of \n");
+  printf("                          cores sharing memory (mesi|moesi) \n");
+  printf("parallel n             -  run each core on a host thread for\n");
+  printf("                          quanta of n cycles (or lookahead, off)\n");
+  printf("alone core ipc         -  IPC of a core's program run alone \n");
+  printf("                          (for the weighted speedup)        \n");
+  printf("profile on|off         -  start (from zero) or stop the per-PC\n");
+  printf("                          profile of each core              \n");
+  printf("profile n              -  print the n hottest instructions and\n");
+  printf("                          the annotated disassembly         \n");
+  printf("sample n file          -  write IPC, MPKI, MSHRs, DRAM queue \n");
+  printf("                          and row hit rate every n cycles to\n");
+  printf("                          file (.bin binary, else CSV)      \n");
+  printf("sample off             -  stop sampling                     \n");
+  printf("fastforward n          -  run n instructions of each core on\n");
+  printf("                          the functional model, untimed     \n");
+  printf("funcfirst on           -  run the functional model on a host\n");
+  printf("                          thread feeding the pipelines      \n");
+  printf("lockstep on|off        -  check every retired instruction   \n");
+  printf("                          against a functional model        \n");
+  printf("stats                  -  dump core, cache and DRAM statistics\n");
+  printf("memstats               -  dump memory controller queue, bank\n");
+  printf("                          parallelism, bus and row statistics\n");
+  printf("memjson file           -  write them as JSON (- for stdout) \n");
   printf("?                      -  display this help menu            \n");
   printf("quit                   -  exit the program                  \n\n");
 }
@@ -138,6 +185,7 @@ void cycle() {
   pipe_cycle();
 
   stat_cycles++;
+  sample_cycle(stat_cycles, !RUN_BIT);
 }
 
 /***************************************************************/
@@ -148,7 +196,7 @@ void cycle() {
 /*                                                             */
 /***************************************************************/
 void run(int num_cycles) {                                      
-  int i;
+  uint32_t end = stat_cycles + num_cycles;
 
   if (RUN_BIT == FALSE) {
     printf("Can't simulate, Simulator is halted\n\n");
@@ -156,7 +204,10 @@ void run(int num_cycles) {
   }
 
   printf("Simulating for %d cycles...\n\n", num_cycles);
-  for (i = 0; i < num_cycles; i++) {
+  lockstep_begin();
+  frontend_begin();
+  /* a cycle() runs a whole quantum with parallel simulation */
+  while (stat_cycles < end) {
     if (RUN_BIT == FALSE) {
 	    printf("Simulator halted\n\n");
 	    break;
@@ -179,6 +230,8 @@ void go() {
   }
 
   printf("Simulating...\n\n");
+  lockstep_begin();
+  frontend_begin();
   while (RUN_BIT)
     cycle();
   printf("Simulator halted\n\n");
@@ -193,15 +246,21 @@ void go() {
 /***************************************************************/
 void rdump() {
     int i;
+    uint32_t core;
 
-    printf("PC: 0x%08x\n", pipe.PC);
+    for (core = 0; core < num_cores; core++) {
+        if (num_cores > 1)
+            printf("Core %u\n", core);
 
-    for (i = 0; i < 32; i++) {
-        printf("R%d: 0x%08x\n", i, pipe.REGS[i]);
-    }
+        printf("PC: 0x%08x\n", pipes[core].PC);
 
-    printf("HI: 0x%08x\n", pipe.HI);
-    printf("LO: 0x%08x\n", pipe.LO);
+        for (i = 0; i < 32; i++) {
+            printf("R%d: 0x%08x\n", i, pipes[core].REGS[i]);
+        }
+
+        printf("HI: 0x%08x\n", pipes[core].HI);
+        printf("LO: 0x%08x\n", pipes[core].LO);
+    }
     printf("Cycles: %u\n", stat_cycles);
     printf("FetchedInstr: %u\n", stat_inst_fetch);
     printf("RetiredInstr: %u\n", stat_inst_retire);
@@ -235,11 +294,15 @@ void mdump(int start, int stop) {
 /*                                                             */
 /***************************************************************/
 void get_command() {
-  char buffer[20];
+  char buffer[20], filename[256];
+  char cache_name[20], policy_name[20];
   int start, stop, cycles;
   int register_no, register_value;
+  unsigned int core;
+  double ipc;
 
   printf("MIPS-SIM> ");
+  fflush(stdout); /* a reader on a pipe gets the last command's output now */
 
   if (scanf("%s", buffer) == EOF)
       exit(0);
@@ -254,6 +317,20 @@ void get_command() {
 
   case 'M':
   case 'm':
+    if (strcmp(buffer, "memstats") == 0) {
+      pipe_print_memstats();
+      break;
+    }
+
+    if (strcmp(buffer, "memjson") == 0) {
+      if (scanf("%255s", filename) != 1)
+         break;
+
+      if (pipe_write_memstats_json(filename) != 0)
+         printf("Can't create %s\n", filename);
+      break;
+    }
+
     if (scanf("%i %i", &start, &stop) != 2)
         break;
 
@@ -263,6 +340,32 @@ void get_command() {
   case '?':
     help();
     break;
+
+  case 'A':
+  case 'a':
+    if (scanf("%u %lf", &core, &ipc) != 2)
+        break;
+
+    if (pipe_set_alone_ipc(core, ipc) != 0)
+        printf("Alone IPC needs a core below %u and an IPC above 0\n", num_cores);
+    break;
+  case 'F':
+  case 'f':
+    if (scanf("%19s", policy_name) != 1)
+        break;
+
+    if (strcmp(buffer, "funcfirst") == 0) {
+      if (strcmp(policy_name, "on") != 0)
+        printf("Functional-first simulation needs on\n");
+      else if (frontend_start() != 0)
+        printf("Functional-first simulation starts before the first cycle\n");
+      break;
+    }
+
+    if (pipe_fast_forward(strtoull(policy_name, NULL, 0)) != 0)
+        printf("Fast-forward runs before the first cycle\n");
+    break;
+
   case 'Q':
   case 'q':
     printf("Bye.\n");
@@ -270,6 +373,24 @@ void get_command() {
 
   case 'R':
   case 'r':
+    if (strcmp(buffer, "refresh") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (pipe_set_refresh_mode(policy_name) != 0)
+         printf("Unknown refresh mode: %s\n", policy_name);
+      break;
+    }
+
+    if (strcmp(buffer, "rowpolicy") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (pipe_set_row_policy(policy_name) != 0)
+         printf("Unknown row policy: %s\n", policy_name);
+      break;
+    }
+
     if (buffer[1] == 'd' || buffer[1] == 'D')
         rdump();
     else {
@@ -278,13 +399,132 @@ void get_command() {
     }
     break;
 
+  case 'P':
+  case 'p':
+    if (strcmp(buffer, "parallel") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (strcmp(policy_name, "off") == 0) {
+         pipe_set_serial();
+         break;
+      }
+
+      /* quantum 0 = lookahead */
+      cycles = strcmp(policy_name, "lookahead") == 0 ? 0 : atoi(policy_name);
+      if ((cycles == 0 && strcmp(policy_name, "lookahead") != 0) || cycles < 0 ||
+          pipe_set_parallel(cycles) != 0)
+         printf("Parallel simulation needs several cores with private memory, "
+                "inclusion nine and a quantum of 1 to %d cycles or lookahead\n",
+                MAX_QUANTUM);
+      break;
+    }
+
+    if (strcmp(buffer, "profile") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (strcmp(policy_name, "on") == 0)
+         profile_start();
+      else if (strcmp(policy_name, "off") == 0)
+         profile_stop();
+      else if (atoi(policy_name) > 0)
+         print_profile(atoi(policy_name));
+      else
+         printf("Profile needs on, off or a number of instructions\n");
+      break;
+    }
+
+    if (scanf("%19s %19s", cache_name, policy_name) != 2)
+        break;
+
+    if (pipe_set_policy(cache_name, policy_name) != 0)
+        printf("Unknown cache or policy, or too many ways for it: %s %s\n", cache_name,
+               policy_name);
+    break;
+
+  case 'V':
+  case 'v':
+    if (scanf("%i", &register_value) != 1)
+        break;
+
+    if (pipe_set_victim_entries(register_value) != 0)
+        printf("Victim cache needs 0 or 4 to 32 entries and private memory\n");
+    break;
+
+  case 'C':
+  case 'c':
+    if (strcmp(buffer, "coherence") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (pipe_set_coherence(policy_name) != 0)
+         printf("Unknown coherence protocol: %s\n", policy_name);
+      break;
+    }
+
+    if (scanf("%255s", filename) != 1)
+        break;
+
+    if (load_hierarchy_config(filename) == 0)
+        print_hierarchy();
+    break;
+
+  case 'D':
+  case 'd':
+    if (scanf("%255s", filename) != 1)
+        break;
+
+    pipe_set_dram_config(filename); // reports unknown presets and bad files
+    break;
+
+  case 'S':
+  case 's':
+    if (strcmp(buffer, "sample") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (strcmp(policy_name, "off") == 0) {
+         sampler_stop();
+         break;
+      }
+
+      if (atoi(policy_name) <= 0 || scanf("%255s", filename) != 1) {
+         printf("Sampling needs an interval above 0 cycles and a file\n");
+         break;
+      }
+      sampler_start(filename, atoi(policy_name)); // reports files it can't create
+      break;
+    }
+
+    if (strcmp(buffer, "scheduler") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (pipe_set_mem_scheduler(policy_name) != 0)
+         printf("Unknown DRAM scheduler: %s\n", policy_name);
+      break;
+    }
+
+    pipe_print_stats();
+    break;
+
   case 'I':
   case 'i':
+   if (strcmp(buffer, "inclusion") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (set_inclusion_policy(policy_name) != 0)
+         printf("Unknown inclusion policy: %s\n", policy_name);
+      break;
+   }
+
    if (scanf("%i %i", &register_no, &register_value) != 2)
       break;
    
    printf("%i %i\n", register_no, register_value);
-   pipe.REGS[register_no] = register_value;
+   pipes[0].REGS[register_no] = register_value;
    break;
    
   case 'H':
@@ -292,15 +532,28 @@ void get_command() {
    if (scanf("%i", &register_value) != 1)
       break;
 
-   pipe.HI = register_value; 
+   pipes[0].HI = register_value; 
    break;
   
   case 'L':
   case 'l':
+   if (strcmp(buffer, "lockstep") == 0) {
+      if (scanf("%19s", policy_name) != 1)
+         break;
+
+      if (strcmp(policy_name, "off") == 0)
+         lockstep_stop();
+      else if (strcmp(policy_name, "on") != 0)
+         printf("Lockstep needs on or off\n");
+      else if (lockstep_start() != 0)
+         printf("Lockstep starts with the simulation, before the first cycle\n");
+      break;
+   }
+
    if (scanf("%i", &register_value) != 1)
       break;
 
-   pipe.LO = register_value; 
+   pipes[0].LO = register_value; 
    break;
 
   default:
@@ -316,9 +569,13 @@ void get_command() {
 /* Purpose   : Allocate and zero memoryy                       */
 /*                                                             */
 /***************************************************************/
-void init_memory() {                                           
+void init_memory(int num_cores) {
     int i;
+    MEM_NREGIONS = MEM_REGIONS_PER_CORE * num_cores;
     for (i = 0; i < MEM_NREGIONS; i++) {
+        mem_region_t *base = &MEM_REGIONS[i % MEM_REGIONS_PER_CORE];
+        MEM_REGIONS[i].start = core_address(i / MEM_REGIONS_PER_CORE, base->start);
+        MEM_REGIONS[i].size = base->size;
         MEM_REGIONS[i].mem = malloc(MEM_REGIONS[i].size);
         memset(MEM_REGIONS[i].mem, 0, MEM_REGIONS[i].size);
     }
@@ -328,10 +585,11 @@ void init_memory() {
 /*                                                            */
 /* Procedure : load_program                                   */
 /*                                                            */
-/* Purpose   : Load program and service routines into mem.    */
+/* Purpose   : Load program and service routines into the     */
+/*             memory of a core.                              */
 /*                                                            */
 /**************************************************************/
-void load_program(char *program_filename) {                   
+void load_program(char *program_filename, int core) {
   FILE * prog;
   int ii, word;
 
@@ -346,7 +604,7 @@ void load_program(char *program_filename) {
 
   ii = 0;
   while (fscanf(prog, "%x\n", &word) != EOF) {
-    mem_write_32(MEM_TEXT_START + ii, word);
+    mem_write_32(core_address(core, MEM_TEXT_START) + ii, word);
     ii += 4;
   }
 
@@ -357,20 +615,22 @@ void load_program(char *program_filename) {
 /*                                                          */
 /* Procedure : initialize                                   */
 /*                                                          */
-/* Purpose   : Load machine language program                */ 
-/*             and set up initial state of the machine.     */
+/* Purpose   : Load machine language programs into one core   */
+/*             or one per core, or one program all cores    */
+/*             share memory with, and set up initial state  */
+/*             of the machine.                              */
 /*                                                          */
 /************************************************************/
-void initialize(char *program_filename, int num_prog_files) { 
+void initialize(char *program_files[], int num_prog_files, int num_cores,
+                int shared) {
   int i;
 
-  init_memory();
-  pipe_init();
+  init_memory(shared ? 1 : num_cores);
+  pipe_init(num_cores, shared);
   for ( i = 0; i < num_prog_files; i++ ) {
-    load_program(program_filename);
-    while(*program_filename++ != '\0');
+    load_program(program_files[i], num_cores > 1 && !shared ? i : 0);
   }
-    
+
   RUN_BIT = TRUE;
 }
 
@@ -379,18 +639,40 @@ void initialize(char *program_filename, int num_prog_files) {
 /* Procedure : main                                            */
 /*                                                             */
 /***************************************************************/
-int main(int argc, char *argv[]) {                              
+int main(int argc, char *argv[]) {
+  /* -s n file: sample statistics every n cycles into file
+     -m: multiprogrammed, each program runs on its own core
+     -t n: one parallel program on n cores sharing memory */
+  int sampling = argc > 3 && strcmp(argv[1], "-s") == 0;
+  int first = 1 + 3 * sampling;
+  int multicore = argc > first && strcmp(argv[first], "-m") == 0;
+  int shared = argc > first + 1 && strcmp(argv[first], "-t") == 0;
+  int threads = shared ? atoi(argv[first + 1]) : 0;
+  first += multicore + 2 * shared;
 
   /* Error Checking */
-  if (argc < 2) {
-    printf("Error: usage: %s <program_file_1> <program_file_2> ...\n",
-           argv[0]);
+  if (argc - first < 1 || (shared && argc - first != 1) ||
+      (sampling && atoi(argv[2]) <= 0)) {
+    printf("Error: usage: %s [-s <interval> <file>] [-m] <program_file_1> "
+           "<program_file_2> ...\n"
+           "       %s [-s <interval> <file>] -t <cores> <program_file>\n", argv[0], argv[0]);
+    exit(1);
+  }
+  if ((multicore && argc - first > MAX_CORES) ||
+      (shared && (threads < 1 || threads > MAX_CORES))) {
+    printf("Error: 1 to %d cores\n", MAX_CORES);
     exit(1);
   }
 
   printf("MIPS Simulator\n\n");
 
-  initialize(argv[1], argc - 1);
+  if (shared)
+    initialize(&argv[first], 1, threads, 1);
+  else
+    initialize(&argv[first], argc - first, multicore ? argc - first : 1, 0);
+
+  if (sampling && sampler_start(argv[3], atoi(argv[2])) != 0)
+    exit(1);
 
   while (1)
     get_command();
@@ -25,6 +25,15 @@ extern int RUN_BIT;	/* run bit */
 uint32_t mem_read_32(uint32_t address);
 void     mem_write_32(uint32_t address, uint32_t value);
 
+/* memory regions of all cores, for models that keep their own copy */
+typedef struct {
+    uint32_t start, size;
+    uint8_t *mem;
+} mem_region_t;
+
+extern mem_region_t MEM_REGIONS[];
+extern int MEM_NREGIONS;
+
 /* statistics */
 extern uint32_t stat_cycles, stat_inst_retire, stat_inst_fetch, stat_squash;
 